@@ -0,0 +1,36 @@
+{
+  'targets': [
+    {
+      'target_name': 'event_objects_bench',
+      'sources': [
+        'event_objects_bench.c',
+        '../src/lib/event_objects.c',
+        '../src/lib/napi_helpers.c',
+      ],
+      'include_dirs': [
+        '../libuiohook/include',
+        '../src/lib',
+      ],
+    },
+    {
+      'target_name': 'xtest_injector',
+      'sources': [
+        'xtest_injector.c',
+        '../src/lib/napi_helpers.c',
+      ],
+      'include_dirs': [
+        '../src/lib',
+      ],
+      'conditions': [
+        ['OS=="linux"', {
+          'link_settings': {
+            'libraries': [
+              '-lX11', '-lXtst'
+            ],
+          },
+          'cflags': ['-std=c99', '-Wall'],
+        }]
+      ]
+    }
+  ]
+}
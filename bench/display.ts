@@ -0,0 +1,19 @@
+import { spawn, ChildProcess } from 'child_process'
+import { existsSync } from 'fs'
+
+export function sleep (ms: number) {
+  return new Promise(resolve => setTimeout(resolve, ms))
+}
+
+export async function startXvfb (display: string): Promise<ChildProcess> {
+  const xvfb = spawn('Xvfb', [display, '-screen', '0', '1280x1024x24', '-nolisten', 'tcp'], { stdio: 'ignore' })
+  const socket = `/tmp/.X11-unix/X${display.slice(1)}`
+  for (let i = 0; i < 100 && !existsSync(socket); i++) {
+    await sleep(50)
+  }
+  if (!existsSync(socket)) {
+    xvfb.kill()
+    throw new Error(`Xvfb didn't start on ${display}`)
+  }
+  return xvfb
+}
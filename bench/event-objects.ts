@@ -0,0 +1,45 @@
+// Measures how fast the addon turns native events into JS objects, with the
+// event classes registered by index.ts and with the plain objects built
+// before them as the baseline. The hook is not started.
+// Run with `npm run bench-events`.
+import { join } from 'path'
+
+interface EventObjectsBench {
+  // Both return the elapsed time in ms
+  createClassEvents (count: number, classes: Function[]): number
+  createPlainEvents (count: number): number
+}
+
+const bench: EventObjectsBench = require(join(__dirname, 'build/Release/event_objects_bench.node'))
+
+// The event classes are private to index.ts, take them on the way to the addon
+const lib = require('node-gyp-build')(join(__dirname, '..'))
+let classes: Function[] = []
+const setEventClasses = lib.setEventClasses
+lib.setEventClasses = (...args: Function[]) => {
+  classes = args
+  setEventClasses(...args)
+}
+require('../src')
+
+const COUNT = 1_000_000
+const RUNS = 5
+
+function measure (name: string, create: () => number) {
+  // Let V8 optimize the event constructors first
+  create()
+
+  const results: number[] = []
+  for (let i = 0; i < RUNS; i++) {
+    results.push(COUNT / create() * 1000)
+  }
+  results.sort((a, b) => a - b)
+
+  const median = results[RUNS >> 1]
+  console.log(`${name}: ${(median / 1e6).toFixed(2)}M/s (median of ${RUNS} runs, ${COUNT} objects each)`)
+}
+
+;(function main () {
+  measure('plain objects', () => bench.createPlainEvents(COUNT))
+  measure('event classes', () => bench.createClassEvents(COUNT, classes))
+})()
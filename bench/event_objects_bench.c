@@ -0,0 +1,253 @@
+#include <string.h>
+#include <node_api.h>
+#include <uiohook.h>
+#include <uv.h>
+#include "event_objects.h"
+#include "napi_helpers.h"
+
+// Creates event objects the way a drain does, with the event classes
+// registered by index.ts, and the way it did before them, as plain
+// objects with every property defined from a C string. See event-objects.ts.
+
+// The construction path before event classes, kept as the baseline.
+static napi_value plain_to_js_event(napi_env env, uiohook_event* event) {
+  napi_status status;
+
+  napi_value event_obj;
+  status = napi_create_object(env, &event_obj);
+  NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_create_object");
+
+  napi_value e_type;
+  status = napi_create_uint32(env, event->type, &e_type);
+  NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_create_uint32");
+
+  napi_value e_altKey;
+  status = napi_get_boolean(env, (event->mask & (MASK_ALT)), &e_altKey);
+  NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_get_boolean");
+
+  napi_value e_ctrlKey;
+  status = napi_get_boolean(env, (event->mask & (MASK_CTRL)), &e_ctrlKey);
+  NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_get_boolean");
+
+  napi_value e_metaKey;
+  status = napi_get_boolean(env, (event->mask & (MASK_META)), &e_metaKey);
+  NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_get_boolean");
+
+  napi_value e_shiftKey;
+  status = napi_get_boolean(env, (event->mask & (MASK_SHIFT)), &e_shiftKey);
+  NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_get_boolean");
+
+  napi_value e_time;
+  status = napi_create_double(env, (double)event->time, &e_time);
+  NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_create_double");
+
+  if (event->type == EVENT_KEY_PRESSED || event->type == EVENT_KEY_RELEASED) {
+    napi_value e_keycode;
+    status = napi_create_uint32(env, event->data.keyboard.keycode, &e_keycode);
+    NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_create_uint32");
+
+    napi_property_descriptor descriptors[] = {
+      { "type",     NULL, NULL, NULL, NULL, e_type,     napi_enumerable, NULL },
+      { "time",     NULL, NULL, NULL, NULL, e_time,     napi_enumerable, NULL },
+      { "altKey",   NULL, NULL, NULL, NULL, e_altKey,   napi_enumerable, NULL },
+      { "ctrlKey",  NULL, NULL, NULL, NULL, e_ctrlKey,  napi_enumerable, NULL },
+      { "metaKey",  NULL, NULL, NULL, NULL, e_metaKey,  napi_enumerable, NULL },
+      { "shiftKey", NULL, NULL, NULL, NULL, e_shiftKey, napi_enumerable, NULL },
+      { "keycode",  NULL, NULL, NULL, NULL, e_keycode,  napi_enumerable, NULL },
+    };
+    status = napi_define_properties(env, event_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+    NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_define_properties");
+    return event_obj;
+  }
+  else if (event->type == EVENT_MOUSE_WHEEL) {
+    napi_value e_x;
+    status = napi_create_int32(env, event->data.wheel.x, &e_x);
+    NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_create_int32");
+
+    napi_value e_y;
+    status = napi_create_int32(env, event->data.wheel.y, &e_y);
+    NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_create_int32");
+
+    napi_value e_clicks;
+    status = napi_create_uint32(env, event->data.wheel.clicks, &e_clicks);
+    NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_create_uint32");
+
+    napi_value e_amount;
+    status = napi_create_uint32(env, event->data.wheel.amount, &e_amount);
+    NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_create_uint32");
+
+    napi_value e_direction;
+    status = napi_create_uint32(env, event->data.wheel.direction, &e_direction);
+    NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_create_uint32");
+
+    napi_value e_rotation;
+    status = napi_create_int32(env, event->data.wheel.rotation, &e_rotation);
+    NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_create_int32");
+
+    napi_property_descriptor descriptors[] = {
+      { "type",      NULL, NULL, NULL, NULL, e_type,      napi_enumerable, NULL },
+      { "time",      NULL, NULL, NULL, NULL, e_time,      napi_enumerable, NULL },
+      { "altKey",    NULL, NULL, NULL, NULL, e_altKey,    napi_enumerable, NULL },
+      { "ctrlKey",   NULL, NULL, NULL, NULL, e_ctrlKey,   napi_enumerable, NULL },
+      { "metaKey",   NULL, NULL, NULL, NULL, e_metaKey,   napi_enumerable, NULL },
+      { "shiftKey",  NULL, NULL, NULL, NULL, e_shiftKey,  napi_enumerable, NULL },
+      { "x",         NULL, NULL, NULL, NULL, e_x,         napi_enumerable, NULL },
+      { "y",         NULL, NULL, NULL, NULL, e_y,         napi_enumerable, NULL },
+      { "clicks",    NULL, NULL, NULL, NULL, e_clicks,    napi_enumerable, NULL },
+      { "amount",    NULL, NULL, NULL, NULL, e_amount,    napi_enumerable, NULL },
+      { "direction", NULL, NULL, NULL, NULL, e_direction, napi_enumerable, NULL },
+      { "rotation",  NULL, NULL, NULL, NULL, e_rotation,  napi_enumerable, NULL },
+    };
+    status = napi_define_properties(env, event_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+    NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_define_properties");
+    return event_obj;
+  }
+  else {
+    napi_value e_x;
+    status = napi_create_int32(env, event->data.mouse.x, &e_x);
+    NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_create_int32");
+
+    napi_value e_y;
+    status = napi_create_int32(env, event->data.mouse.y, &e_y);
+    NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_create_int32");
+
+    napi_value e_button;
+    status = napi_create_uint32(env, event->data.mouse.button, &e_button);
+    NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_create_uint32");
+
+    napi_value e_clicks;
+    status = napi_create_uint32(env, event->data.mouse.clicks, &e_clicks);
+    NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_create_uint32");
+
+    napi_property_descriptor descriptors[] = {
+      { "type",     NULL, NULL, NULL, NULL, e_type,     napi_enumerable, NULL },
+      { "time",     NULL, NULL, NULL, NULL, e_time,     napi_enumerable, NULL },
+      { "altKey",   NULL, NULL, NULL, NULL, e_altKey,   napi_enumerable, NULL },
+      { "ctrlKey",  NULL, NULL, NULL, NULL, e_ctrlKey,  napi_enumerable, NULL },
+      { "metaKey",  NULL, NULL, NULL, NULL, e_metaKey,  napi_enumerable, NULL },
+      { "shiftKey", NULL, NULL, NULL, NULL, e_shiftKey, napi_enumerable, NULL },
+      { "x",        NULL, NULL, NULL, NULL, e_x,        napi_enumerable, NULL },
+      { "y",        NULL, NULL, NULL, NULL, e_y,        napi_enumerable, NULL },
+      { "button",   NULL, NULL, NULL, NULL, e_button,   napi_enumerable, NULL },
+      { "clicks",   NULL, NULL, NULL, NULL, e_clicks,   napi_enumerable, NULL },
+    };
+    status = napi_define_properties(env, event_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+    NAPI_FATAL_IF_FAILED(status, "plain_to_js_event", "napi_define_properties");
+    return event_obj;
+  }
+}
+
+// Creates `count` events, a mix of moves, key presses, wheel and clicks,
+// and returns the elapsed time in ms. Without `classes` the plain path is
+// measured. Drains keep all their objects alive until the callback returns,
+// they are released in chunks of the default batch size here.
+static napi_value create_events(napi_env env, uint32_t count, napi_value* classes) {
+  napi_status status;
+
+  uiohook_event samples[4];
+  memset(samples, 0, sizeof(samples));
+  samples[0].type = EVENT_MOUSE_MOVED;
+  samples[0].data.mouse.x = 640;
+  samples[0].data.mouse.y = 480;
+  samples[1].type = EVENT_KEY_PRESSED;
+  samples[1].mask = MASK_CTRL_L;
+  samples[1].data.keyboard.keycode = 0x001E;
+  samples[2].type = EVENT_MOUSE_WHEEL;
+  samples[2].data.wheel.amount = 3;
+  samples[2].data.wheel.rotation = -1;
+  samples[2].data.wheel.direction = 3;
+  samples[3].type = EVENT_MOUSE_CLICKED;
+  samples[3].data.mouse.button = 1;
+  samples[3].data.mouse.clicks = 1;
+
+  napi_handle_scope scope = NULL;
+  uint64_t start = uv_hrtime();
+  for (uint32_t i = 0; i < count; i++) {
+    if ((i & 1023) == 0) {
+      status = napi_open_handle_scope(env, &scope);
+      NAPI_THROW_IF_FAILED(env, status, NULL);
+    }
+
+    samples[i & 3].time = i;
+    if (classes != NULL) {
+      uiohook_to_js_event(env, classes, &samples[i & 3]);
+    }
+    else {
+      plain_to_js_event(env, &samples[i & 3]);
+    }
+
+    if ((i & 1023) == 1023 || i + 1 == count) {
+      status = napi_close_handle_scope(env, scope);
+      NAPI_THROW_IF_FAILED(env, status, NULL);
+    }
+  }
+  uint64_t elapsed = uv_hrtime() - start;
+
+  napi_value result;
+  status = napi_create_double(env, (double)elapsed / 1e6, &result);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  return result;
+}
+
+napi_value CreateClassEvents(napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 2;
+  napi_value info_argv[2];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Count
+  uint32_t count;
+  status = napi_get_value_uint32(env, info_argv[0], &count);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [1] Event classes, in the order of setEventClasses
+  uint32_t length;
+  status = napi_get_array_length(env, info_argv[1], &length);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (length != event_class_count) {
+    NAPI_THROW(env, "ERR_INVALID_ARG_VALUE", "Expected a class for every event kind.", NULL);
+  }
+
+  napi_value classes[event_class_count];
+  for (uint32_t i = 0; i < event_class_count; i++) {
+    status = napi_get_element(env, info_argv[1], i, &classes[i]);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
+
+  return create_events(env, count, classes);
+}
+
+napi_value CreatePlainEvents(napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 1;
+  napi_value info_argv[1];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Count
+  uint32_t count;
+  status = napi_get_value_uint32(env, info_argv[0], &count);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  return create_events(env, count, NULL);
+}
+
+NAPI_MODULE_INIT() {
+  napi_status status;
+  napi_value export_fn;
+
+  status = napi_create_function(env, NULL, 0, CreateClassEvents, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "createClassEvents", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, CreatePlainEvents, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "createPlainEvents", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  return exports;
+}
@@ -0,0 +1,140 @@
+// Records a scripted session against an Xvfb display and replays it at
+// several speeds, checking that the hook sees the same key and button
+// events at the same relative times. Input is posted by the addon itself.
+// Run with `npm run bench-replay [-- --display :99]`.
+import { ChildProcess } from 'child_process'
+import { mkdtempSync, rmSync } from 'fs'
+import { tmpdir } from 'os'
+import { join } from 'path'
+import { uIOhook, UiohookKey, EventType } from '../src'
+import { sleep, startXvfb } from './display'
+
+const SPEEDS = [1, 4]
+const SETTLE_MS = 300
+// ms, relative to the first event
+const MAX_TIMING_ERROR = 10
+
+interface Captured {
+  type: EventType
+  code: number // keycode or button
+  time: number // ms
+}
+
+function arg (name: string): string | undefined {
+  const i = process.argv.indexOf(name)
+  return (i !== -1) ? process.argv[i + 1] : undefined
+}
+
+let captured: Captured[] = []
+let moves = 0
+let lastPosition: [number, number] = [0, 0]
+
+function onInput (e: any) {
+  const time = Number(process.hrtime.bigint()) / 1e6
+  switch (e.type) {
+    case EventType.EVENT_KEY_PRESSED:
+    case EventType.EVENT_KEY_RELEASED:
+      captured.push({ type: e.type, code: e.keycode, time })
+      break
+    case EventType.EVENT_MOUSE_PRESSED:
+    case EventType.EVENT_MOUSE_RELEASED:
+      captured.push({ type: e.type, code: e.button, time })
+      break
+    case EventType.EVENT_MOUSE_MOVED:
+      moves++
+      lastPosition = [e.x, e.y]
+      break
+  }
+}
+
+function resetCapture () {
+  captured = []
+  moves = 0
+}
+
+async function session () {
+  uIOhook.mouseMove(100, 100)
+  await sleep(100)
+  await uIOhook.mouseMovePath([[100, 100], [600, 400]], { duration: 400 })
+  await uIOhook.keySequence([
+    [UiohookKey.H, 'tap', 120],
+    [UiohookKey.Shift, 'down', 40],
+    [UiohookKey.I, 'tap', 80],
+    [UiohookKey.Shift, 'up', 250]
+  ])
+  await uIOhook.mouseMovePath([[600, 400], [300, 700]], { duration: 300, button: 1 })
+  await sleep(150)
+  uIOhook.mouseClick(300, 700, 2)
+}
+
+function compare (reference: Captured[], replayed: Captured[], speed: number) {
+  const sameSequence = reference.length === replayed.length &&
+    reference.every((e, i) => e.type === replayed[i].type && e.code === replayed[i].code)
+  if (!sameSequence || !reference.length) {
+    return { sameSequence, meanError: null, maxError: null }
+  }
+
+  let sum = 0
+  let max = 0
+  for (let i = 0; i < reference.length; i++) {
+    const expected = (reference[i].time - reference[0].time) / speed
+    const error = Math.abs((replayed[i].time - replayed[0].time) - expected)
+    sum += error
+    max = Math.max(max, error)
+  }
+  return { sameSequence, meanError: sum / reference.length, maxError: max }
+}
+
+;(async function main () {
+  let xvfb: ChildProcess | undefined
+  const display = arg('--display')
+  if (display) {
+    process.env.DISPLAY = display
+  } else {
+    process.env.DISPLAY = ':99'
+    xvfb = await startXvfb(process.env.DISPLAY)
+  }
+
+  const dir = mkdtempSync(join(tmpdir(), 'uiohook-replay-'))
+  const file = join(dir, 'session.uiohrec')
+  let failed = false
+
+  try {
+    uIOhook.on('input', onInput)
+    uIOhook.start()
+
+    uIOhook.startRecording(file)
+    await session()
+    await sleep(SETTLE_MS)
+    const recording = uIOhook.stopRecording()!
+    const reference = captured
+    const referenceMoves = moves
+    const referencePosition = lastPosition
+
+    const runs = []
+    for (const speed of SPEEDS) {
+      uIOhook.mouseMove(0, 0)
+      await sleep(SETTLE_MS)
+      resetCapture()
+
+      await uIOhook.replay(file, { speed })
+      await sleep(SETTLE_MS)
+
+      const result = compare(reference, captured, speed)
+      const samePosition = lastPosition[0] === referencePosition[0] && lastPosition[1] === referencePosition[1]
+      failed ||= !result.sameSequence || !samePosition || result.maxError! > MAX_TIMING_ERROR
+      runs.push({ speed, ...result, samePosition, moves, referenceMoves })
+    }
+
+    console.log(JSON.stringify({ recording, events: reference.length, runs }, null, 2))
+  } finally {
+    uIOhook.stop()
+    rmSync(dir, { recursive: true, force: true })
+    xvfb?.kill()
+  }
+
+  if (failed) process.exit(1)
+})().catch((err) => {
+  console.error(err)
+  process.exit(1)
+})
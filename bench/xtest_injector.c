@@ -0,0 +1,186 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <node_api.h>
+#include <uv.h>
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+#include "napi_helpers.h"
+
+// Injects synthetic input with XTest at a fixed rate on a libuv pool
+// thread and records when each event was sent, see xvfb.ts.
+
+typedef enum {
+  inject_move,
+  inject_key
+} inject_kind;
+
+typedef struct {
+  napi_async_work work;
+  napi_deferred deferred;
+  napi_ref times_ref;
+  double* times; // uv_hrtime() in ns after each event was flushed
+  uint32_t count;
+  uint32_t rate; // events per second, 0 - as fast as possible
+  inject_kind kind;
+  int error;
+  int thread_id;
+} inject_job;
+
+// Pointer positions are unique within MOVE_AREA * MOVE_AREA events, so
+// received moves can be matched to their injection times.
+// Must be kept in sync with bench/xvfb.ts
+#define MOVE_AREA 1000
+
+static void sleep_until(uint64_t deadline) {
+  struct timespec ts;
+  ts.tv_sec = (time_t)(deadline / 1000000000);
+  ts.tv_nsec = (long)(deadline % 1000000000);
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {}
+}
+
+static void inject_execute(napi_env env, void* data) {
+  inject_job* job = data;
+  job->thread_id = (int)syscall(SYS_gettid);
+
+  Display* display = XOpenDisplay(NULL);
+  if (display == NULL) {
+    job->error = 1;
+    return;
+  }
+
+  int event_base, error_base, major, minor;
+  if (!XTestQueryExtension(display, &event_base, &error_base, &major, &minor)) {
+    XCloseDisplay(display);
+    job->error = 2;
+    return;
+  }
+
+  KeyCode keycode = XKeysymToKeycode(display, XK_F24);
+  if (keycode == 0) keycode = XKeysymToKeycode(display, XK_a);
+
+  // uv_hrtime() and clock_gettime(CLOCK_MONOTONIC) share the same clock on Linux.
+  // Start from a position outside of the move area, X doesn't report
+  // a move to where the pointer already is.
+  XTestFakeMotionEvent(display, -1, 0, 0, CurrentTime);
+  XSync(display, False);
+
+  uint64_t period = job->rate ? 1000000000ull / job->rate : 0;
+  uint64_t start = uv_hrtime();
+
+  for (uint32_t i = 0; i < job->count; i++) {
+    if (period) sleep_until(start + period * i);
+
+    if (job->kind == inject_move) {
+      int x = 1 + (int)(i % MOVE_AREA);
+      int y = 1 + (int)((i / MOVE_AREA) % MOVE_AREA);
+      XTestFakeMotionEvent(display, -1, x, y, CurrentTime);
+    }
+    else {
+      XTestFakeKeyEvent(display, keycode, True, CurrentTime);
+      XTestFakeKeyEvent(display, keycode, False, CurrentTime);
+    }
+    XFlush(display);
+    job->times[i] = (double)uv_hrtime();
+  }
+
+  XSync(display, False);
+  XCloseDisplay(display);
+}
+
+static void inject_complete(napi_env env, napi_status status, void* data) {
+  inject_job* job = data;
+
+  napi_value result;
+  if (status == napi_ok && job->error == 0) {
+    NAPI_FATAL_IF_FAILED(napi_create_int32(env, job->thread_id, &result), "inject_complete", "napi_create_int32");
+    NAPI_FATAL_IF_FAILED(napi_resolve_deferred(env, job->deferred, result), "inject_complete", "napi_resolve_deferred");
+  }
+  else {
+    napi_value message;
+    const char* text = (job->error == 1) ? "Failed to open X11 display." : "XTest extension is not available.";
+    NAPI_FATAL_IF_FAILED(napi_create_string_utf8(env, text, NAPI_AUTO_LENGTH, &message), "inject_complete", "napi_create_string_utf8");
+    NAPI_FATAL_IF_FAILED(napi_create_error(env, NULL, message, &result), "inject_complete", "napi_create_error");
+    NAPI_FATAL_IF_FAILED(napi_reject_deferred(env, job->deferred, result), "inject_complete", "napi_reject_deferred");
+  }
+
+  napi_delete_reference(env, job->times_ref);
+  napi_delete_async_work(env, job->work);
+  free(job);
+}
+
+// inject(kind: 'move' | 'key', times: Float64Array, rate: number): Promise<number>
+// Injects `times.length` events, resolves with the id of the injecting thread.
+napi_value Inject(napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 3;
+  napi_value info_argv[3];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Kind
+  char kind[8];
+  size_t kind_length;
+  status = napi_get_value_string_utf8(env, info_argv[0], kind, sizeof(kind), &kind_length);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [1] Times
+  napi_typedarray_type array_type;
+  size_t array_length;
+  void* array_data;
+  status = napi_get_typedarray_info(env, info_argv[1], &array_type, &array_length, &array_data, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (array_type != napi_float64_array) {
+    NAPI_THROW(env, "ERR_INVALID_ARG_TYPE", "Times must be a Float64Array.", NULL);
+  }
+
+  // [2] Rate
+  uint32_t rate;
+  status = napi_get_value_uint32(env, info_argv[2], &rate);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  inject_job* job = calloc(1, sizeof(inject_job));
+  if (job == NULL) {
+    NAPI_THROW(env, "ERR_OUT_OF_MEMORY", "Failed to allocate memory.", NULL);
+  }
+  job->kind = (strcmp(kind, "key") == 0) ? inject_key : inject_move;
+  job->times = array_data;
+  job->count = (uint32_t)array_length;
+  job->rate = rate;
+
+  status = napi_create_reference(env, info_argv[1], 1, &job->times_ref);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value promise;
+  status = napi_create_promise(env, &job->deferred, &promise);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value resource_name;
+  status = napi_create_string_utf8(env, "XTEST_INJECTOR", NAPI_AUTO_LENGTH, &resource_name);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  status = napi_create_async_work(env, NULL, resource_name, inject_execute, inject_complete, job, &job->work);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  status = napi_queue_async_work(env, job->work);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  return promise;
+}
+
+NAPI_MODULE_INIT() {
+  napi_status status;
+  napi_value export_fn;
+
+  status = napi_create_function(env, NULL, 0, Inject, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "inject", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  return exports;
+}
@@ -0,0 +1,294 @@
+// End-to-end benchmark of the hook against an Xvfb display, input is
+// injected with XTest by bench/xtest_injector.c at controlled rates.
+// Run with `npm run bench [-- --display :99] [-- --out results.json]`,
+// results are printed as JSON so they can be tracked over time.
+import { execSync, ChildProcess } from 'child_process'
+import { readdirSync, readFileSync, writeFileSync } from 'fs'
+import { cpus } from 'os'
+import { join } from 'path'
+import { uIOhook, UiohookStartOptions } from '../src'
+import { sleep, startXvfb } from './display'
+
+interface XTestInjector {
+  // Injects `times.length` events and fills `times` with the uv_hrtime() of each,
+  // resolves with the id of the injecting thread.
+  inject (kind: 'move' | 'key', times: Float64Array, rate: number): Promise<number>
+}
+
+const injector: XTestInjector = require(join(__dirname, 'build/Release/xtest_injector.node'))
+
+// Must be kept in sync with bench/xtest_injector.c
+const MOVE_AREA = 1000
+
+const RESULTS_VERSION = 1
+const LATENCY_COUNT = 5000
+const LATENCY_RATES = [100, 1000]
+const THROUGHPUT_RATES = [1000, 2000, 4000, 8000, 16000, 32000, 64000, 128000, 256000]
+const THROUGHPUT_MAX_COUNT = 200000
+const STALL_RATE = 5000
+const STALL_MS = 3000
+const SETTLE_MS = 200
+
+function arg (name: string): string | undefined {
+  const i = process.argv.indexOf(name)
+  return (i !== -1) ? process.argv[i + 1] : undefined
+}
+
+function now () {
+  return Number(process.hrtime.bigint())
+}
+
+// ns on CPU per thread of this process
+function threadCpuTimes (): Map<number, number> {
+  const times = new Map<number, number>()
+  for (const tid of readdirSync('/proc/self/task')) {
+    try {
+      const schedstat = readFileSync(`/proc/self/task/${tid}/schedstat`, 'utf8')
+      times.set(Number(tid), Number(schedstat.split(' ')[0]))
+    } catch {
+      // the thread has exited
+    }
+  }
+  return times
+}
+
+function cpuDelta (before: Map<number, number>, after: Map<number, number>, tids: number[]) {
+  let ns = 0
+  for (const tid of tids) {
+    ns += (after.get(tid) ?? 0) - (before.get(tid) ?? 0)
+  }
+  return ns
+}
+
+function percentile (sorted: Float64Array, p: number) {
+  if (!sorted.length) return null
+  return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))]
+}
+
+// Records when every injected event reached a JS listener.
+class Receiver {
+  readonly times: Float64Array
+  count = 0
+
+  constructor (size: number, kind: 'move' | 'key') {
+    this.times = new Float64Array(size)
+    if (kind === 'move') {
+      uIOhook.on('mousemove', this.onMove)
+    } else {
+      uIOhook.on('keydown', this.onKey)
+    }
+  }
+
+  private onMove = (e: { x: number, y: number }) => {
+    const i = (e.y - 1) * MOVE_AREA + (e.x - 1)
+    if (i >= 0 && i < this.times.length && this.times[i] === 0) {
+      this.times[i] = now()
+      this.count++
+    }
+  }
+
+  private onKey = () => {
+    if (this.count < this.times.length) {
+      this.times[this.count++] = now()
+    }
+  }
+
+  // Waits until nothing has arrived for SETTLE_MS
+  async settle () {
+    let count = -1
+    while (count !== this.count) {
+      count = this.count
+      await sleep(SETTLE_MS)
+    }
+  }
+
+  close () {
+    uIOhook.off('mousemove', this.onMove)
+    uIOhook.off('keydown', this.onKey)
+  }
+}
+
+// Threads created by the addon, identified by starting the hook.
+let hookThreads: number[] = []
+
+function startHook (opts: UiohookStartOptions) {
+  const before = threadCpuTimes()
+  uIOhook.start(opts)
+  hookThreads = [...threadCpuTimes().keys()].filter(tid => !before.has(tid))
+}
+
+async function measureLatency (mode: string, opts: UiohookStartOptions, kind: 'move' | 'key', rate: number) {
+  startHook(opts)
+  const receiver = new Receiver(LATENCY_COUNT, kind)
+  const injected = new Float64Array(LATENCY_COUNT)
+  await injector.inject(kind, injected, rate)
+  await receiver.settle()
+  receiver.close()
+  uIOhook.stop()
+
+  const latencies: number[] = []
+  for (let i = 0; i < LATENCY_COUNT; i++) {
+    if (receiver.times[i] !== 0) {
+      latencies.push((receiver.times[i] - injected[i]) / 1000)
+    }
+  }
+  const sorted = new Float64Array(latencies).sort()
+  return {
+    mode,
+    kind,
+    rate,
+    injected: LATENCY_COUNT,
+    received: receiver.count,
+    // µs from XFlush on the injecting thread to the JS listener
+    p50: percentile(sorted, 0.5),
+    p90: percentile(sorted, 0.9),
+    p99: percentile(sorted, 0.99),
+    p999: percentile(sorted, 0.999),
+    max: percentile(sorted, 1)
+  }
+}
+
+async function measureThroughput (opts: UiohookStartOptions) {
+  const runs = []
+  let sustainedRate = 0
+
+  for (const rate of THROUGHPUT_RATES) {
+    const count = Math.min(rate, THROUGHPUT_MAX_COUNT)
+    startHook(opts)
+    const receiver = new Receiver(count, 'move')
+    const injected = new Float64Array(count)
+    const cpuBefore = threadCpuTimes()
+
+    await injector.inject('move', injected, rate)
+    await receiver.settle()
+
+    const cpuAfter = threadCpuTimes()
+    const drops = uIOhook.getDropCounters()
+    receiver.close()
+    uIOhook.stop()
+
+    const seconds = (injected[count - 1] - injected[0]) / 1e9
+    const achievedRate = Math.round((count - 1) / seconds)
+    const dropped = drops.mouseMove + drops.other
+    const lost = count - receiver.count
+    runs.push({
+      rate,
+      achievedRate,
+      injected: count,
+      received: receiver.count,
+      dropped,
+      // ns on CPU per injected event
+      jsThreadCpu: Math.round(cpuDelta(cpuBefore, cpuAfter, [process.pid]) / count),
+      hookThreadsCpu: Math.round(cpuDelta(cpuBefore, cpuAfter, hookThreads) / count)
+    })
+
+    if (lost !== 0 || dropped !== 0) break
+    sustainedRate = achievedRate
+    // The injector can't go faster, higher targets measure the same thing
+    if (achievedRate < rate * 0.9) break
+  }
+
+  return { runs, sustainedRate }
+}
+
+// Injects at a fixed rate while the JS thread is blocked, the queue is
+// preallocated so RSS shouldn't grow with the number of pending events.
+async function measureStall (opts: UiohookStartOptions) {
+  startHook(opts)
+  const count = STALL_RATE * STALL_MS / 1000
+  const receiver = new Receiver(count, 'move')
+  const injected = new Float64Array(count)
+
+  global.gc?.()
+  const rssBefore = process.memoryUsage().rss
+  const done = injector.inject('move', injected, STALL_RATE)
+  Atomics.wait(new Int32Array(new SharedArrayBuffer(4)), 0, 0, STALL_MS)
+  const rssStalled = process.memoryUsage().rss
+
+  await done
+  await receiver.settle()
+  global.gc?.()
+  const rssAfter = process.memoryUsage().rss
+  const drops = uIOhook.getDropCounters()
+  receiver.close()
+  uIOhook.stop()
+
+  return {
+    rate: STALL_RATE,
+    stallMs: STALL_MS,
+    injected: count,
+    received: receiver.count,
+    dropped: drops.mouseMove + drops.other,
+    rssBefore,
+    rssGrowthStalled: rssStalled - rssBefore,
+    rssGrowthAfter: rssAfter - rssBefore
+  }
+}
+
+function gitCommit () {
+  try {
+    return execSync('git rev-parse HEAD', { cwd: __dirname, stdio: ['ignore', 'pipe', 'ignore'] }).toString().trim()
+  } catch {
+    return null
+  }
+}
+
+;(async function main () {
+  let xvfb: ChildProcess | undefined
+  const display = arg('--display')
+  if (display) {
+    process.env.DISPLAY = display
+  } else {
+    process.env.DISPLAY = ':99'
+    xvfb = await startXvfb(process.env.DISPLAY)
+  }
+
+  try {
+    // Spawn the libuv pool before the hook, so its threads are not counted as hook threads
+    await injector.inject('move', new Float64Array(0), 0)
+
+    const modes: Array<[string, UiohookStartOptions]> = [
+      ['default', {}],
+      ['batch', { batch: true }]
+    ]
+
+    const latency = []
+    for (const [mode, opts] of modes) {
+      for (const kind of ['move', 'key'] as const) {
+        for (const rate of LATENCY_RATES) {
+          latency.push(await measureLatency(mode, opts, kind, rate))
+        }
+      }
+    }
+
+    const throughput: Record<string, unknown> = {}
+    for (const [mode, opts] of modes) {
+      throughput[mode] = await measureThroughput(opts)
+    }
+
+    const stall = await measureStall({})
+
+    const results = {
+      version: RESULTS_VERSION,
+      timestamp: new Date().toISOString(),
+      commit: gitCommit(),
+      node: process.version,
+      platform: `${process.platform}-${process.arch}`,
+      cpu: cpus()[0]?.model,
+      cores: cpus().length,
+      latency,
+      throughput,
+      stall
+    }
+
+    const json = JSON.stringify(results, null, 2)
+    const out = arg('--out')
+    if (out) writeFileSync(out, json + '\n')
+    console.log(json)
+  } finally {
+    xvfb?.kill()
+  }
+})().catch((err) => {
+  console.error(err)
+  process.exit(1)
+})
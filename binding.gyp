@@ -4,8 +4,22 @@
       'target_name': 'uiohook_napi',
       'dependencies': ['libuiohook'],
       'sources': [
+        'src/lib/activity.c',
         'src/lib/addon.c',
+        'src/lib/event_objects.c',
+        'src/lib/event_ring.c',
+        'src/lib/event_stream.c',
+        'src/lib/heatmap.c',
+        'src/lib/hotkeys.c',
+        'src/lib/idle.c',
+        'src/lib/injector.c',
+        'src/lib/keymap.c',
+        'src/lib/log_ring.c',
         'src/lib/napi_helpers.c',
+        'src/lib/recorder.c',
+        'src/lib/regions.c',
+        'src/lib/sequences.c',
+        'src/lib/stats.c',
         'src/lib/uiohook_worker.c',
       ],
       'include_dirs': [
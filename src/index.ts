@@ -3,17 +3,191 @@ import { join } from 'path'
 const lib: AddonExports = require('node-gyp-build')(join(__dirname, '..'))
 
 interface AddonExports {
-  start (cb: (e: any) => void): void
+  start (cb: ((e: any) => void) | null, opts?: AddonStartOptions): void
+  startAsync (cb: ((e: any) => void) | null, opts?: AddonStartOptions): Promise<UiohookStartTimings>
   stop (): void
+  setPaused (paused: boolean): void
   keyTap (key: number, type: KeyToggle): void
+  injectKeys (steps: Uint32Array, id: number): Promise<boolean>
+  mouseTap (x: number, y: number, button: number, type: KeyToggle): void
+  mouseMove (x: number, y: number): void
+  mouseWheel (x: number, y: number, rotation: number, direction: WheelDirection): void
+  injectText (text: string, cps: number, id: number): Promise<boolean>
+  injectMousePath (points: Int32Array, duration: number, easing: number, rate: number, button: number, id: number): Promise<boolean>
+  cancelInjection (id: number): boolean
+  startRecording (path: string): void
+  stopRecording (): UiohookRecordingSummary | null
+  replay (path: string, speed: number, id: number): Promise<boolean>
+  getDropCounters (): UiohookDropCounters
+  getMergeCounters (): UiohookMergeCounters
+  getStats (): AddonStats | null
+  isKeyDown (keycode: number): boolean
+  isMouseButtonDown (button: number): boolean
+  getPressedKeys (): number[]
+  getCursor (): { x: number, y: number } | null
+  getScreens (): UiohookScreen[]
+  startHeatmap (cells: Uint32Array, left: number, top: number, cellSize: number, columns: number, rows: number): void
+  takeHeatmap (): number | null
+  stopHeatmap (): void
+  takeActivity (): UiohookActivity | null
+  setHookThreadOptions (opts: AddonHookThreadOptions): void
+  getHookThreadReport (): AddonHookThreadReport
+  watchIdle (cb: (idle: boolean, threshold: number, idleTime: number) => void, thresholds: Uint32Array, jitter: number): void
+  unwatchIdle (): void
+  setLogHandler (cb: ((level: LogLevel, message: string) => void) | null): void
+  setLogLevel (level: LogLevel): void
+  getLogCounters (): UiohookLogCounters
+  setEventMask (mask: number): void
+  setHotkeys (hotkeys: Uint32Array): void
+  setSequences (sequences: Uint32Array, backspace: SequenceBackspace, resetOnClick: boolean): void
+  setRegions (regions: Int32Array): void
+  setEventClasses (
+    keyboard: typeof KeyboardEventObject,
+    mouse: typeof MouseEventObject,
+    wheel: typeof WheelEventObject,
+    hotkey: typeof HotkeyEventObject,
+    sequence: typeof SequenceEventObject
+  ): void
 }
 
-enum KeyToggle {
+interface AddonStartOptions {
+  batchMaxSize?: number
+  batchMaxLatency?: number
+  queueSize?: number
+  queueOverflow?: QueueOverflow
+  queueBlockTimeout?: number
+  coalesceWindow?: number
+  coalesceWheel?: number
+  stats?: number
+  stream?: Int32Array
+  aggregate?: number
+  dropKeyRepeat?: number
+}
+
+interface AddonHookThreadOptions {
+  policy?: SchedPolicy
+  priority?: number
+  cpus?: number[]
+  lockMemory?: number
+  measureJitter?: number
+}
+
+interface AddonHookThreadReport {
+  started: boolean
+  policy: SchedPolicy
+  priority: number
+  schedError: string | null
+  cpus: number[]
+  affinityError: string | null
+  lockedBytes: number
+  memoryError: string | null
+  jitter: UiohookHistogram
+}
+
+interface AddonStats {
+  stages: UiohookStats['stages']
+  eventsPerSecond: number[] // by EventType
+  queueDepth: number
+  dropped: UiohookDropCounters
+}
+
+const COALESCE_UNTIL_DRAIN = 0xFFFFFFFF
+
+enum QueueOverflow {
+  DropNewest = 0,
+  DropMouseMove = 1,
+  Block = 2
+}
+
+// libuiohook log_level, LogLevel.Off is the addon's
+enum LogLevel {
+  Debug = 1,
+  Info = 2,
+  Warn = 3,
+  Error = 4,
+  Off = 5
+}
+
+const LOG_LEVELS = {
+  debug: LogLevel.Debug,
+  info: LogLevel.Info,
+  warn: LogLevel.Warn,
+  error: LogLevel.Error,
+  off: LogLevel.Off
+}
+
+const LOG_LEVEL_NAMES = ['off', 'debug', 'info', 'warn', 'error'] as const
+
+enum SequenceBackspace {
+  Undo = 0,
+  Reset = 1,
+  Key = 2
+}
+
+const SEQUENCE_BACKSPACE = {
+  undo: SequenceBackspace.Undo,
+  reset: SequenceBackspace.Reset,
+  key: SequenceBackspace.Key
+}
+
+enum SchedPolicy {
+  Default = 0,
+  Inherit = 1,
+  Other = 2,
+  RoundRobin = 3,
+  Fifo = 4
+}
+
+const SCHED_POLICIES = {
+  default: SchedPolicy.Default,
+  inherit: SchedPolicy.Inherit,
+  other: SchedPolicy.Other,
+  rr: SchedPolicy.RoundRobin,
+  fifo: SchedPolicy.Fifo
+}
+
+export enum KeyToggle {
   Tap = 0,
   Down = 1,
   Up = 2
 }
 
+// [key, toggle, ms to wait after the step]
+export type KeySequenceStep = [key: number, toggle: 'tap' | 'down' | 'up', delay?: number]
+
+export interface UiohookInjectOptions {
+  signal?: AbortSignal
+}
+
+export interface UiohookTypeTextOptions extends UiohookInjectOptions {
+  cps?: number // characters per second, default unlimited
+}
+
+const MOUSE_PATH_EASINGS = {
+  linear: 0,
+  'ease-in': 1,
+  'ease-out': 2,
+  'ease-in-out': 3
+}
+
+export interface UiohookMousePathOptions extends UiohookInjectOptions {
+  duration: number // ms
+  easing?: keyof typeof MOUSE_PATH_EASINGS // default 'ease-in-out'
+  rate?: number // moves per second, default 120
+  button?: number // held from the first waypoint to the last one
+}
+
+export interface UiohookReplayOptions extends UiohookInjectOptions {
+  speed?: number // multiplier, default 1
+}
+
+export interface UiohookRecordingSummary {
+  events: number
+  bytes: number
+  /** Events lost because the file couldn't be written fast enough */
+  dropped: number
+}
+
 export enum EventType {
   EVENT_KEY_PRESSED = 4,
   EVENT_KEY_RELEASED = 5,
@@ -21,7 +195,48 @@ export enum EventType {
   EVENT_MOUSE_PRESSED = 7,
   EVENT_MOUSE_RELEASED = 8,
   EVENT_MOUSE_MOVED = 9,
-  EVENT_MOUSE_WHEEL = 11
+  EVENT_MOUSE_WHEEL = 11,
+  EVENT_HOTKEY = 16,
+  EVENT_REGION_ENTER = 17,
+  EVENT_REGION_LEAVE = 18,
+  EVENT_SEQUENCE = 19
+}
+
+const EVENT_MOUSE_DRAGGED = 10
+
+const STATS_EVENT_TYPES = {
+  keydown: EventType.EVENT_KEY_PRESSED,
+  keyup: EventType.EVENT_KEY_RELEASED,
+  click: EventType.EVENT_MOUSE_CLICKED,
+  mousedown: EventType.EVENT_MOUSE_PRESSED,
+  mouseup: EventType.EVENT_MOUSE_RELEASED,
+  mousemove: EventType.EVENT_MOUSE_MOVED,
+  wheel: EventType.EVENT_MOUSE_WHEEL,
+  hotkey: EventType.EVENT_HOTKEY
+} as const
+
+const REGION_EVENT_TYPES = {
+  click: EventType.EVENT_MOUSE_CLICKED,
+  mousedown: EventType.EVENT_MOUSE_PRESSED,
+  mouseup: EventType.EVENT_MOUSE_RELEASED,
+  mousemove: EventType.EVENT_MOUSE_MOVED,
+  wheel: EventType.EVENT_MOUSE_WHEEL
+} as const
+
+// Native event types needed by each EventEmitter event
+const EVENT_MASKS: Record<string, number> = {
+  input: 0xFFFF,
+  hotkey: 1 << EventType.EVENT_HOTKEY,
+  sequence: 1 << EventType.EVENT_SEQUENCE,
+  regionenter: 1 << EventType.EVENT_REGION_ENTER,
+  regionleave: 1 << EventType.EVENT_REGION_LEAVE,
+  keydown: 1 << EventType.EVENT_KEY_PRESSED,
+  keyup: 1 << EventType.EVENT_KEY_RELEASED,
+  click: 1 << EventType.EVENT_MOUSE_CLICKED,
+  mousedown: 1 << EventType.EVENT_MOUSE_PRESSED,
+  mouseup: 1 << EventType.EVENT_MOUSE_RELEASED,
+  mousemove: (1 << EventType.EVENT_MOUSE_MOVED) | (1 << EVENT_MOUSE_DRAGGED),
+  wheel: 1 << EventType.EVENT_MOUSE_WHEEL
 }
 
 export interface UiohookKeyboardEvent {
@@ -32,6 +247,10 @@ export interface UiohookKeyboardEvent {
   metaKey: boolean
   shiftKey: boolean
   keycode: number
+  /** Key down: this is an auto-repeat. Key up: the key auto-repeated while held */
+  repeat: boolean
+  /** Key down: which auto-repeat this is. Key up: how many auto-repeats preceded it */
+  repeatCount: number
 }
 
 export interface UiohookMouseEvent {
@@ -48,6 +267,8 @@ export interface UiohookMouseEvent {
   y: number
   button: unknown
   clicks: number
+  /** Region the event is in, 0 when no regions are registered */
+  region: number
 }
 
 export interface UiohookWheelEvent {
@@ -63,6 +284,55 @@ export interface UiohookWheelEvent {
   amount: number
   direction: WheelDirection
   rotation: number
+  /** Region the event is in, 0 when no regions are registered */
+  region: number
+}
+
+export interface UiohookRegionEvent {
+  type: EventType.EVENT_REGION_ENTER | EventType.EVENT_REGION_LEAVE
+  time: number
+  altKey: boolean
+  ctrlKey: boolean
+  metaKey: boolean
+  shiftKey: boolean
+  /** Pointer position of the event that crossed the region border */
+  x: number
+  y: number
+  region: number
+}
+
+export interface UiohookRegion {
+  x: number
+  y: number
+  width: number
+  height: number
+  /** Event types passed to JS inside the region, default all of them */
+  events?: Array<keyof typeof REGION_EVENT_TYPES>
+}
+
+export interface UiohookHotkeyEvent {
+  type: EventType.EVENT_HOTKEY
+  time: number
+  id: number
+}
+
+export interface UiohookSequenceEvent {
+  type: EventType.EVENT_SEQUENCE
+  time: number
+  id: number
+  /** Key presses the sequence consists of, e.g. how many to erase when expanding it */
+  length: number
+}
+
+export interface UiohookSequenceOptions {
+  /**
+   * - 'undo' - steps back one key press (default)
+   * - 'reset' - starts matching over
+   * - 'key' - an ordinary key sequences may contain
+   */
+  backspace?: 'undo' | 'reset' | 'key'
+  /** Start matching over on a mouse button press, default true */
+  resetOnClick?: boolean
 }
 
 export enum WheelDirection {
@@ -197,6 +467,606 @@ export const UiohookKey = {
   PrintScreen: 0x0E37,
 } as const
 
+export interface UiohookBatchOptions {
+  /** Max number of events passed to JS in one native call */
+  maxSize?: number
+  /** Max time in ms an event may wait for the batch to fill up, 0 - deliver on the next event loop tick */
+  maxLatency?: number
+}
+
+export interface UiohookQueueOptions {
+  /** Number of preallocated event slots, rounded up to a power of two */
+  size?: number
+  /**
+   * What to do when the queue is full because JS doesn't keep up:
+   * - 'drop-newest' - drop the event that doesn't fit
+   * - 'drop-mouse-move' - evict the oldest queued mouse move, or drop the new event if none is queued
+   * - 'block' - block the hook thread up to `blockTimeout` ms, then drop the new event
+   */
+  overflow?: 'drop-newest' | 'drop-mouse-move' | 'block'
+  /** Max time in ms to block the hook thread with the 'block' policy */
+  blockTimeout?: number
+}
+
+export interface UiohookCoalesceOptions {
+  /**
+   * Consecutive mouse moves within this many ms are merged into one event with the last position,
+   * 'drain' - merge until JS takes the queued events. Delivery of merged events is delayed up to the window.
+   */
+  window: number | 'drain'
+  /** Also merge consecutive wheel events in the same direction by summing `rotation`, default true */
+  wheel?: boolean
+}
+
+export interface UiohookStartOptions {
+  /** Deliver events from the native side in batches, listeners are still called per event */
+  batch?: boolean | UiohookBatchOptions
+  /** Bounded queue between the hook thread and JS */
+  queue?: UiohookQueueOptions
+  /** Merge mouse moves and wheel events natively, key and button events are never reordered */
+  coalesce?: UiohookCoalesceOptions
+  /** Measure latency of every stage an event goes through, see getStats() */
+  stats?: boolean
+  /** 'drop' discards auto-repeated key presses on the hook thread, default 'forward' */
+  keyRepeat?: 'forward' | 'drop'
+}
+
+export interface UiohookStartTimings {
+  /** False if the hook was already running in another worker_thread, the hook phases are 0 then */
+  hookStarted: boolean
+  /** ms, reading options and setting up delivery on the JS thread */
+  prepare: number
+  /** ms, waiting for a libuv threadpool thread */
+  queued: number
+  /** ms, until the new hook thread was running */
+  threadCreate: number
+  /** ms, applying setHookThreadOptions() on the hook thread */
+  threadSetup: number
+  /** ms, installing the OS hook, on X11 opening the display and enabling the XRecord context */
+  hookSetup: number
+  /** ms, from the call until the promise settled */
+  total: number
+}
+
+export interface UiohookStartResult {
+  timings: UiohookStartTimings
+}
+
+export interface UiohookStreamStartResult extends UiohookStartResult {
+  stream: UiohookEventStream
+}
+
+export interface UiohookMergeCounters {
+  /** Mouse moves merged into a previous move */
+  mouseMove: number
+  /** Wheel events merged into a previous wheel event */
+  wheel: number
+}
+
+export interface UiohookHistogram {
+  count: number
+  /** ns */
+  min: number
+  max: number
+  mean: number
+  p50: number
+  p90: number
+  p99: number
+  p999: number
+  /** Non-empty buckets as [upper bound in ns, count], bounds are ~6% apart */
+  buckets: Array<[number, number]>
+}
+
+export interface UiohookStats {
+  stages: {
+    /** Captured by the hook thread -> queued for JS */
+    hook: UiohookHistogram
+    /** Queued -> taken by the JS thread */
+    queue: UiohookHistogram
+    /** Taken -> JS callback returned, per callback call */
+    js: UiohookHistogram
+    /** Captured -> JS callback returned */
+    total: UiohookHistogram
+  }
+  /** Captured events by type since the previous getStats() call, before filtering by listeners */
+  eventsPerSecond: Record<keyof typeof STATS_EVENT_TYPES, number>
+  /** Events waiting for JS */
+  queueDepth: number
+  dropped: UiohookDropCounters
+}
+
+export interface UiohookStreamOptions {
+  /** Number of records in the ring, rounded up to a power of two */
+  capacity?: number
+}
+
+export interface UiohookStreamStartOptions {
+  /** Write events into a SharedArrayBuffer ring instead of emitting them */
+  stream: true | UiohookStreamOptions
+  keyRepeat?: 'forward' | 'drop'
+}
+
+export interface UiohookAggregateStartOptions {
+  /** Count activity natively and emit one 'activity' event per interval instead of input events */
+  aggregate: {
+    /** ms */
+    interval: number
+  }
+}
+
+export interface UiohookActivity {
+  /** Key presses, auto-repeat included */
+  keys: number
+  /** Mouse button presses */
+  clicks: number
+  /** Wheel rotation in both directions */
+  scroll: number
+  /** Mouse travel in px */
+  distance: number
+  /** ms covered by this record */
+  duration: number
+}
+
+export interface UiohookIdleOptions {
+  /** ms without input, an 'idle' event is emitted when each of them is crossed */
+  thresholds: number[]
+  /** Mouse moves up to this many px from the last counted position are not input, default 0 */
+  jitter?: number
+}
+
+export interface UiohookIdleEvent {
+  /** The threshold crossed, ms */
+  threshold: number
+  /** ms without input so far */
+  idleTime: number
+}
+
+export interface UiohookActiveEvent {
+  /** ms the user was idle for */
+  idleTime: number
+}
+
+export interface UiohookHookThreadOptions {
+  /**
+   * - 'default' - SCHED_RR at half the max priority, time critical priority on Windows
+   * - 'inherit' - leave the thread as it was created
+   * - 'other', 'rr', 'fifo' - SCHED_OTHER, SCHED_RR, SCHED_FIFO, normal or time critical priority on Windows
+   */
+  policy?: keyof typeof SCHED_POLICIES
+  /** Priority for the policy (Windows thread priority on Windows), default half the max */
+  priority?: number
+  /**
+   * Pin the hook thread to these CPUs, not supported on macOS. On Windows only CPUs
+   * below 64 (32 in 32-bit processes) can be used, others fail with ERROR_NOT_SUPPORTED
+   */
+  cpus?: number[]
+  /** Lock the hook thread stack and the event queues in memory, may need a higher RLIMIT_MEMLOCK */
+  lockMemory?: boolean
+  /** Record dispatch jitter, see getHookThreadReport() */
+  measureJitter?: boolean
+}
+
+export interface UiohookHookThreadReport {
+  /** False until the hook thread has started once */
+  started: boolean
+  /** Policy and priority in effect */
+  policy: 'inherit' | 'other' | 'rr' | 'fifo'
+  priority: number
+  /** CPUs the thread may run on, null if not pinned */
+  cpus: number[] | null
+  /** Bytes locked in memory */
+  lockedBytes: number
+  /** Error names like 'EPERM' for settings that couldn't be applied */
+  errors: {
+    scheduling: string | null
+    affinity: string | null
+    memory: string | null
+  }
+  /**
+   * ns an event was dispatched later than the fastest event since the hook started,
+   * null until an event is measured with `measureJitter`. The OS event clock has ms resolution.
+   */
+  jitter: UiohookHistogram | null
+}
+
+export interface UiohookDropCounters {
+  /** Mouse moves dropped because the queue was full */
+  mouseMove: number
+  /** Other events dropped because the queue was full */
+  other: number
+}
+
+export interface UiohookScreen {
+  number: number
+  x: number
+  y: number
+  width: number
+  height: number
+}
+
+export interface UiohookHeatmapOptions {
+  /** px per side of a cell */
+  cellSize: number
+  /** Desktop area covered by the grid, default the bounding box of all screens */
+  bounds?: { x: number, y: number, width: number, height: number }
+}
+
+export interface UiohookHeatmapCounts {
+  /** Mouse events per cell, row by row */
+  moves: Uint32Array
+  /** Mouse button presses per cell, row by row */
+  clicks: Uint32Array
+  /** ms covered by the counts */
+  duration: number
+}
+
+export type UiohookLogLevel = 'debug' | 'info' | 'warn' | 'error'
+
+export interface UiohookLogOptions {
+  /** Messages below it are discarded before they are formatted, default 'warn' */
+  level?: UiohookLogLevel | 'off'
+  /** Receives the messages instead of stderr, null goes back to stderr */
+  handler?: ((level: UiohookLogLevel, message: string) => void) | null
+}
+
+export interface UiohookLogCounters {
+  /** Messages logged at an enabled level */
+  messages: number
+  /** Messages lost because the log buffer or the handler queue was full */
+  dropped: number
+}
+
+const DEFAULT_BATCH_MAX_SIZE = 1024
+const DEFAULT_STREAM_CAPACITY = 1024
+const DEFAULT_QUEUE_BLOCK_TIMEOUT = 5
+
+// Must be kept in sync with src/lib/event_stream.h
+const STREAM_HEAD = 0
+const STREAM_TAIL = 1
+const STREAM_CAPACITY = 2
+const STREAM_DROPPED = 3
+const STREAM_HEADER_WORDS = 4
+const STREAM_RECORD_WORDS = 10
+
+const MASK_SHIFT = (1 << 0) | (1 << 4)
+const MASK_CTRL = (1 << 1) | (1 << 5)
+const MASK_META = (1 << 2) | (1 << 6)
+const MASK_ALT = (1 << 3) | (1 << 7)
+
+// Packed fields decoded on access, see uiohook_to_js_event in src/lib/addon.c
+const EVENT_DATA = Symbol('data')
+
+class KeyboardEventObject implements UiohookKeyboardEvent {
+  type: UiohookKeyboardEvent['type']
+  time: number
+  altKey: boolean
+  ctrlKey: boolean
+  metaKey: boolean
+  shiftKey: boolean
+  keycode: number
+  repeat: boolean
+  repeatCount: number
+
+  constructor (type: UiohookKeyboardEvent['type'], time: number, mask: number, keycode: number) {
+    this.type = type
+    this.time = time
+    this.altKey = (mask & MASK_ALT) !== 0
+    this.ctrlKey = (mask & MASK_CTRL) !== 0
+    this.metaKey = (mask & MASK_META) !== 0
+    this.shiftKey = (mask & MASK_SHIFT) !== 0
+    this.keycode = keycode
+    this.repeatCount = mask >>> 16
+    this.repeat = this.repeatCount !== 0
+  }
+}
+
+class MouseEventObject implements UiohookMouseEvent {
+  type: UiohookMouseEvent['type'] | UiohookRegionEvent['type']
+  time: number
+  altKey: boolean
+  ctrlKey: boolean
+  metaKey: boolean
+  shiftKey: boolean
+  x: number
+  y: number
+  button: number
+  region: number
+  private [EVENT_DATA]: number
+
+  constructor (type: UiohookMouseEvent['type'] | UiohookRegionEvent['type'], time: number, mask: number, x: number, y: number, data: number) {
+    this.type = type
+    this.time = time
+    this.altKey = (mask & MASK_ALT) !== 0
+    this.ctrlKey = (mask & MASK_CTRL) !== 0
+    this.metaKey = (mask & MASK_META) !== 0
+    this.shiftKey = (mask & MASK_SHIFT) !== 0
+    this.x = x
+    this.y = y
+    this.button = data & 0xFFFF
+    this.region = mask >>> 16
+    this[EVENT_DATA] = data
+  }
+
+  get clicks () { return this[EVENT_DATA] >>> 16 }
+
+  toJSON () {
+    return { ...this, clicks: this.clicks }
+  }
+}
+
+class WheelEventObject implements UiohookWheelEvent {
+  type: UiohookWheelEvent['type']
+  time: number
+  altKey: boolean
+  ctrlKey: boolean
+  metaKey: boolean
+  shiftKey: boolean
+  x: number
+  y: number
+  direction: WheelDirection
+  region: number
+  private [EVENT_DATA]: number
+
+  constructor (type: UiohookWheelEvent['type'], time: number, mask: number, x: number, y: number, direction: WheelDirection, data: number) {
+    this.type = type
+    this.time = time
+    this.altKey = (mask & MASK_ALT) !== 0
+    this.ctrlKey = (mask & MASK_CTRL) !== 0
+    this.metaKey = (mask & MASK_META) !== 0
+    this.shiftKey = (mask & MASK_SHIFT) !== 0
+    this.x = x
+    this.y = y
+    this.direction = direction
+    this.region = mask >>> 16
+    this[EVENT_DATA] = data
+  }
+
+  get clicks () { return this[EVENT_DATA] % 0x10000 }
+  get amount () { return Math.floor(this[EVENT_DATA] / 0x10000) % 0x10000 }
+  get rotation () { return Math.floor(this[EVENT_DATA] / 0x100000000) - 0x8000 }
+
+  toJSON () {
+    return { ...this, clicks: this.clicks, amount: this.amount, rotation: this.rotation }
+  }
+}
+
+class HotkeyEventObject implements UiohookHotkeyEvent {
+  type: EventType.EVENT_HOTKEY
+  time: number
+  id: number
+
+  constructor (type: EventType.EVENT_HOTKEY, time: number, id: number) {
+    this.type = type
+    this.time = time
+    this.id = id
+  }
+}
+
+class SequenceEventObject implements UiohookSequenceEvent {
+  type: EventType.EVENT_SEQUENCE
+  time: number
+  id: number
+  length: number
+
+  constructor (type: EventType.EVENT_SEQUENCE, time: number, id: number, length: number) {
+    this.type = type
+    this.time = time
+    this.id = id
+    this.length = length
+  }
+}
+
+lib.setEventClasses(KeyboardEventObject, MouseEventObject, WheelEventObject, HotkeyEventObject, SequenceEventObject)
+
+/**
+ * Reader for events written by the hook thread into a SharedArrayBuffer.
+ * Fields are decoded on access from the current record, so reading doesn't allocate.
+ *
+ * ```
+ * while (stream.next()) {
+ *   if (stream.type === EventType.EVENT_MOUSE_MOVED) cursor = [stream.x, stream.y]
+ * }
+ * ```
+ */
+export class UiohookEventStream {
+  readonly buffer: SharedArrayBuffer
+  private readonly view: Int32Array
+  private readonly mask: number
+  private cursor = -1
+  private offset = 0
+
+  constructor (capacity: number) {
+    let size = 2
+    while (size < capacity) size *= 2
+
+    this.buffer = new SharedArrayBuffer((STREAM_HEADER_WORDS + size * STREAM_RECORD_WORDS) * 4)
+    this.view = new Int32Array(this.buffer)
+    this.view[STREAM_CAPACITY] = size
+    this.mask = size - 1
+  }
+
+  /** @internal */
+  get array () { return this.view }
+
+  /** Records dropped because the reader didn't keep up */
+  get dropped () { return Atomics.load(this.view, STREAM_DROPPED) >>> 0 }
+
+  /** Number of records ready to be read */
+  get pending () {
+    const tail = (this.cursor === -1) ? Atomics.load(this.view, STREAM_TAIL) : this.cursor + 1
+    return (Atomics.load(this.view, STREAM_HEAD) - tail) >>> 0
+  }
+
+  /**
+   * Releases the current record and moves to the next one.
+   * Returns false when there are no more records.
+   */
+  next (): boolean {
+    const view = this.view
+    let tail: number
+    if (this.cursor !== -1) {
+      tail = (this.cursor + 1) >>> 0
+      Atomics.store(view, STREAM_TAIL, tail)
+      this.cursor = -1
+    } else {
+      tail = Atomics.load(view, STREAM_TAIL) >>> 0
+    }
+
+    if (tail === (Atomics.load(view, STREAM_HEAD) >>> 0)) return false
+
+    this.cursor = tail
+    this.offset = STREAM_HEADER_WORDS + (tail & this.mask) * STREAM_RECORD_WORDS
+    return true
+  }
+
+  /** Skips all unread records */
+  skip () {
+    Atomics.store(this.view, STREAM_TAIL, Atomics.load(this.view, STREAM_HEAD))
+    this.cursor = -1
+  }
+
+  get type (): EventType { return this.view[this.offset] }
+  get time () { return (this.view[this.offset + 3] >>> 0) * 0x100000000 + (this.view[this.offset + 2] >>> 0) }
+  get altKey () { return (this.view[this.offset + 1] & MASK_ALT) !== 0 }
+  get ctrlKey () { return (this.view[this.offset + 1] & MASK_CTRL) !== 0 }
+  get metaKey () { return (this.view[this.offset + 1] & MASK_META) !== 0 }
+  get shiftKey () { return (this.view[this.offset + 1] & MASK_SHIFT) !== 0 }
+  get keycode () { return this.view[this.offset + 4] }
+  get x () { return this.view[this.offset + 4] }
+  get y () { return this.view[this.offset + 5] }
+  get button () { return this.view[this.offset + 6] }
+  get clicks () { return this.view[this.offset + 6 + (this.type === EventType.EVENT_MOUSE_WHEEL ? 0 : 1)] }
+  get amount () { return this.view[this.offset + 7] }
+  get direction (): WheelDirection { return this.view[this.offset + 8] }
+  get rotation () { return this.view[this.offset + 9] }
+  get region () { return this.view[this.offset + 1] >>> 16 }
+  get length () { return this.view[this.offset + 1] >>> 16 }
+  get repeatCount () { return this.view[this.offset + 1] >>> 16 }
+  get repeat () { return this.repeatCount !== 0 }
+
+  get id () { return this.view[this.offset + 4] >>> 0 }
+
+  /** Copies the current record into a regular event object */
+  toEvent (): UiohookKeyboardEvent | UiohookMouseEvent | UiohookWheelEvent | UiohookHotkeyEvent | UiohookSequenceEvent | UiohookRegionEvent {
+    const common = {
+      time: this.time,
+      altKey: this.altKey,
+      ctrlKey: this.ctrlKey,
+      metaKey: this.metaKey,
+      shiftKey: this.shiftKey
+    }
+    switch (this.type) {
+      case EventType.EVENT_HOTKEY:
+        return { type: this.type, time: common.time, id: this.id }
+      case EventType.EVENT_SEQUENCE:
+        return { type: this.type, time: common.time, id: this.id, length: this.length }
+      case EventType.EVENT_KEY_PRESSED:
+      case EventType.EVENT_KEY_RELEASED:
+        return { type: this.type, ...common, keycode: this.keycode, repeat: this.repeat, repeatCount: this.repeatCount }
+      case EventType.EVENT_MOUSE_WHEEL:
+        return { type: this.type, ...common, x: this.x, y: this.y, clicks: this.clicks, amount: this.amount, direction: this.direction, rotation: this.rotation, region: this.region }
+      case EventType.EVENT_REGION_ENTER:
+      case EventType.EVENT_REGION_LEAVE:
+        return { type: this.type, ...common, x: this.x, y: this.y, region: this.region }
+      default:
+        return { type: this.type, ...common, x: this.x, y: this.y, button: this.button, clicks: this.clicks, region: this.region }
+    }
+  }
+}
+
+/**
+ * Mouse moves and button presses counted per grid cell by the hook thread, straight into
+ * a SharedArrayBuffer. It holds two sets of counters: the hook thread counts into one
+ * while the other, returned by take(), can be read at leisure.
+ *
+ * ```
+ * setInterval(() => {
+ *   const { moves, clicks } = heatmap.take()
+ *   report(moves[heatmap.cellAt(x, y)])
+ * }, 60_000)
+ * ```
+ */
+export class UiohookHeatmap {
+  readonly buffer: SharedArrayBuffer
+  /** Desktop coordinates of the top left cell */
+  readonly left: number
+  readonly top: number
+  readonly cellSize: number
+  readonly columns: number
+  readonly rows: number
+  /** Screens when the heatmap was started, the grid doesn't follow later changes */
+  readonly screens: UiohookScreen[]
+  private readonly view: Uint32Array
+  private readonly halves: Array<{ moves: Uint32Array, clicks: Uint32Array }>
+  private active = 0
+  private takenAt = Date.now()
+
+  /** @internal */
+  constructor (opts: UiohookHeatmapOptions, screens: UiohookScreen[]) {
+    let bounds = opts.bounds
+    if (!bounds) {
+      if (!screens.length) throw new Error('No screens found, heatmap bounds must be set.')
+      const left = Math.min(...screens.map(s => s.x))
+      const top = Math.min(...screens.map(s => s.y))
+      const right = Math.max(...screens.map(s => s.x + s.width))
+      const bottom = Math.max(...screens.map(s => s.y + s.height))
+      bounds = { x: left, y: top, width: right - left, height: bottom - top }
+    }
+
+    this.left = bounds.x
+    this.top = bounds.y
+    this.cellSize = opts.cellSize
+    this.columns = Math.ceil(bounds.width / opts.cellSize)
+    this.rows = Math.ceil(bounds.height / opts.cellSize)
+    this.screens = screens
+
+    const plane = this.columns * this.rows
+    this.buffer = new SharedArrayBuffer(plane * 4 * 4)
+    this.view = new Uint32Array(this.buffer)
+    this.halves = [0, 1].map((half) => ({
+      moves: this.view.subarray(plane * 2 * half, plane * (2 * half + 1)),
+      clicks: this.view.subarray(plane * (2 * half + 1), plane * (2 * half + 2))
+    }))
+  }
+
+  /** @internal */
+  get array () { return this.view }
+
+  /** Counters being written right now */
+  get moves () { return this.halves[this.active].moves }
+  get clicks () { return this.halves[this.active].clicks }
+
+  /**
+   * Returns the counts since the previous take() and starts counting from zero.
+   * The arrays are not written until the next take(), which reuses them.
+   */
+  take (): UiohookHeatmapCounts {
+    const half = lib.takeHeatmap()
+    if (half === null) throw new Error('The heatmap was stopped.')
+    this.active = half ^ 1
+
+    const now = Date.now()
+    const duration = now - this.takenAt
+    this.takenAt = now
+    return { ...this.halves[half], duration }
+  }
+
+  /** Index of the cell with this desktop position, -1 if it is outside of the grid */
+  cellAt (x: number, y: number): number {
+    const column = Math.floor((x - this.left) / this.cellSize)
+    const row = Math.floor((y - this.top) / this.cellSize)
+    if (column < 0 || row < 0 || column >= this.columns || row >= this.rows) return -1
+    return row * this.columns + column
+  }
+}
+
+export const HotkeyModifier = {
+  Ctrl: 1 << 0,
+  Shift: 1 << 1,
+  Alt: 1 << 2,
+  Meta: 1 << 3
+} as const
+
 declare interface UiohookNapi {
   on(event: 'input', listener: (e: UiohookKeyboardEvent | UiohookMouseEvent | UiohookWheelEvent) => void): this
 
@@ -209,10 +1079,68 @@ declare interface UiohookNapi {
   on(event: 'click', listener: (e: UiohookMouseEvent) => void): this
 
   on(event: 'wheel', listener: (e: UiohookWheelEvent) => void): this
+
+  on(event: 'hotkey', listener: (e: UiohookHotkeyEvent) => void): this
+  on(event: 'sequence', listener: (e: UiohookSequenceEvent) => void): this
+
+  on(event: 'regionenter', listener: (e: UiohookRegionEvent) => void): this
+  on(event: 'regionleave', listener: (e: UiohookRegionEvent) => void): this
+
+  on(event: 'activity', listener: (e: UiohookActivity) => void): this
+
+  on(event: 'idle', listener: (e: UiohookIdleEvent) => void): this
+  on(event: 'active', listener: (e: UiohookActiveEvent) => void): this
+}
+
+type StartMode = 'events' | 'stream' | 'aggregate'
+
+interface RunningHook {
+  mode: StartMode
+  stream?: UiohookEventStream
 }
 
 class UiohookNapi extends EventEmitter {
-  private handler (e: UiohookKeyboardEvent | UiohookMouseEvent | UiohookWheelEvent) {
+  constructor () {
+    super()
+    // Only event types with listeners cross into JS
+    this.on('newListener', (name: string) => { this.updateEventMask(name) })
+    this.on('removeListener', () => { this.updateEventMask() })
+    this.updateEventMask()
+  }
+
+  /** Set from start() until stop(), a stream gets every event type */
+  private running?: RunningHook
+
+  private updateEventMask (adding?: string) {
+    let mask = this.running?.stream ? 0xFFFFFFFF : 0
+    for (const name in EVENT_MASKS) {
+      if (name === adding || this.listenerCount(name) > 0) {
+        mask |= EVENT_MASKS[name]
+      }
+    }
+    lib.setEventMask(mask >>> 0)
+  }
+
+  private hotkeys = new Map<number, number[]>()
+  private sequences = new Map<number, number[]>()
+  private sequenceOptions: Required<UiohookSequenceOptions> = { backspace: 'undo', resetOnClick: true }
+
+  private handler (e: UiohookKeyboardEvent | UiohookMouseEvent | UiohookWheelEvent | UiohookHotkeyEvent | UiohookSequenceEvent | UiohookRegionEvent) {
+    switch (e.type) {
+      case EventType.EVENT_HOTKEY:
+        this.emit('hotkey', e)
+        return
+      case EventType.EVENT_SEQUENCE:
+        this.emit('sequence', e)
+        return
+      case EventType.EVENT_REGION_ENTER:
+        this.emit('regionenter', e)
+        return
+      case EventType.EVENT_REGION_LEAVE:
+        this.emit('regionleave', e)
+        return
+    }
+
     this.emit('input', e)
     switch (e.type) {
       case EventType.EVENT_KEY_PRESSED:
@@ -239,12 +1167,400 @@ class UiohookNapi extends EventEmitter {
     }
   }
 
-  start () {
-    lib.start(this.handler.bind(this))
+  private batchHandler (events: Array<UiohookKeyboardEvent | UiohookMouseEvent | UiohookWheelEvent | UiohookHotkeyEvent | UiohookSequenceEvent | UiohookRegionEvent>) {
+    for (const e of events) {
+      this.handler(e)
+    }
+  }
+
+  private activityTimer?: ReturnType<typeof setInterval>
+
+  private emitActivity () {
+    const activity = lib.takeActivity()
+    if (activity) this.emit('activity', activity)
+  }
+
+  start (opts: UiohookStreamStartOptions): UiohookEventStream
+  start (opts: UiohookAggregateStartOptions): void
+  start (opts?: UiohookStartOptions): void
+  start (opts: UiohookStartOptions | UiohookStreamStartOptions | UiohookAggregateStartOptions = {}): UiohookEventStream | void {
+    if (this.running) {
+      // The addon ignores a start() while the hook runs, only the same mode can be kept
+      if (this.running.mode !== startMode(opts)) throw alreadyStarted()
+      return this.running.stream
+    }
+
+    const running: RunningHook = { mode: startMode(opts) }
+    this.running = running
+    const { cb, addonOpts, started } = this.startArgs(opts, running)
+    try {
+      lib.start(cb, addonOpts)
+    } catch (err) {
+      this.startFailed(running)
+      throw err
+    }
+    return started()
+  }
+
+  /**
+   * Same as start(), but the hook thread is created and the OS hook installed off the event loop,
+   * which matters with a slow or remote X server. Resolves once the hook is enabled, rejects with
+   * the same error codes as start() and with ABORT_ERR if stop() was called in the meantime.
+   * Errors carry `timings` as well.
+   */
+  startAsync (opts: UiohookStreamStartOptions): Promise<UiohookStreamStartResult>
+  startAsync (opts: UiohookAggregateStartOptions): Promise<UiohookStartResult>
+  startAsync (opts?: UiohookStartOptions): Promise<UiohookStartResult>
+  async startAsync (opts: UiohookStartOptions | UiohookStreamStartOptions | UiohookAggregateStartOptions = {}): Promise<UiohookStartResult | UiohookStreamStartResult> {
+    if (this.running) throw alreadyStarted()
+
+    const running: RunningHook = { mode: startMode(opts) }
+    this.running = running
+    const { cb, addonOpts, started } = this.startArgs(opts, running)
+    let timings: UiohookStartTimings
+    try {
+      timings = await lib.startAsync(cb, addonOpts)
+    } catch (err) {
+      this.startFailed(running)
+      throw err
+    }
+    const stream = started()
+    return stream ? { timings, stream } : { timings }
+  }
+
+  /** Translates start() options, `started` is called once the hook runs. */
+  private startArgs (opts: UiohookStartOptions | UiohookStreamStartOptions | UiohookAggregateStartOptions, running: RunningHook) {
+    if ('aggregate' in opts) {
+      return {
+        cb: null,
+        addonOpts: { aggregate: 1 },
+        started: () => {
+          this.activityTimer = setInterval(() => { this.emitActivity() }, opts.aggregate.interval)
+        }
+      }
+    }
+
+    if ('stream' in opts) {
+      const capacity = (opts.stream === true) ? DEFAULT_STREAM_CAPACITY : (opts.stream.capacity ?? DEFAULT_STREAM_CAPACITY)
+      const stream = new UiohookEventStream(capacity)
+      running.stream = stream
+      this.updateEventMask()
+      const addonOpts: AddonStartOptions = { stream: stream.array, dropKeyRepeat: (opts.keyRepeat === 'drop') ? 1 : 0 }
+      return { cb: null, addonOpts, started: () => stream }
+    }
+
+    const queue = opts.queue ?? {}
+    const addonOpts: AddonStartOptions = {
+      queueSize: queue.size,
+      queueOverflow: (queue.overflow === 'drop-mouse-move')
+        ? QueueOverflow.DropMouseMove
+        : (queue.overflow === 'block') ? QueueOverflow.Block : QueueOverflow.DropNewest,
+      queueBlockTimeout: queue.blockTimeout ?? DEFAULT_QUEUE_BLOCK_TIMEOUT,
+      dropKeyRepeat: (opts.keyRepeat === 'drop') ? 1 : 0
+    }
+    if (opts.coalesce) {
+      addonOpts.coalesceWindow = (opts.coalesce.window === 'drain') ? COALESCE_UNTIL_DRAIN : opts.coalesce.window
+      addonOpts.coalesceWheel = (opts.coalesce.wheel ?? true) ? 1 : 0
+    }
+    if (opts.stats) {
+      addonOpts.stats = 1
+    }
+    const started = () => {}
+
+    if (!opts.batch) {
+      return { cb: this.handler.bind(this), addonOpts, started }
+    }
+
+    const batch = (opts.batch === true) ? {} : opts.batch
+    return {
+      cb: this.batchHandler.bind(this),
+      addonOpts: {
+        ...addonOpts,
+        batchMaxSize: batch.maxSize ?? DEFAULT_BATCH_MAX_SIZE,
+        batchMaxLatency: batch.maxLatency ?? 0
+      },
+      started
+    }
+  }
+
+  /** Forgets a start() that failed, unless stop() and another start() came first */
+  private startFailed (running: RunningHook) {
+    if (this.running === running) {
+      this.running = undefined
+      this.updateEventMask()
+    }
+  }
+
+  getDropCounters (): UiohookDropCounters {
+    return lib.getDropCounters()
+  }
+
+  getMergeCounters (): UiohookMergeCounters {
+    return lib.getMergeCounters()
+  }
+
+  /** Returns null unless the hook was started with `stats: true` */
+  getStats (): UiohookStats | null {
+    const stats = lib.getStats()
+    if (!stats) return null
+
+    const eventsPerSecond = {} as UiohookStats['eventsPerSecond']
+    for (const name of Object.keys(STATS_EVENT_TYPES) as Array<keyof typeof STATS_EVENT_TYPES>) {
+      eventsPerSecond[name] = stats.eventsPerSecond[STATS_EVENT_TYPES[name]]
+    }
+    return { ...stats, eventsPerSecond }
+  }
+
+  /**
+   * Pressed keys, buttons and the cursor position are tracked on the hook thread,
+   * listeners are not needed. The state is cleared when the hook starts and stops.
+   */
+  isKeyDown (keycode: number): boolean {
+    return lib.isKeyDown(keycode)
+  }
+
+  /** Buttons: 1 - left, 2 - right, 3 - middle */
+  isMouseButtonDown (button: number): boolean {
+    return lib.isMouseButtonDown(button)
+  }
+
+  /** Keycodes in ascending order */
+  getPressedKeys (): number[] {
+    return lib.getPressedKeys()
+  }
+
+  /** Monitors in desktop coordinates */
+  getScreens (): UiohookScreen[] {
+    return lib.getScreens()
+  }
+
+  /**
+   * Counts mouse moves and button presses per grid cell on the hook thread, no events
+   * cross into JS for it. Input is counted while the hook runs, in any start mode.
+   * Replaces the previous heatmap.
+   */
+  startHeatmap (opts: UiohookHeatmapOptions): UiohookHeatmap {
+    const heatmap = new UiohookHeatmap(opts, lib.getScreens())
+    lib.startHeatmap(heatmap.array, heatmap.left, heatmap.top, heatmap.cellSize, heatmap.columns, heatmap.rows)
+    return heatmap
+  }
+
+  stopHeatmap () {
+    lib.stopHeatmap()
+  }
+
+  /** Position of the last mouse event, null before the first one */
+  getCursor (): { x: number, y: number } | null {
+    return lib.getCursor()
+  }
+
+  /**
+   * Detects idleness natively: JS only receives 'idle' when a threshold is crossed and 'active'
+   * on the first input after that. Input is seen while the hook runs, in any start mode.
+   */
+  watchIdle (opts: UiohookIdleOptions) {
+    const thresholds = Uint32Array.from(opts.thresholds).sort()
+    lib.watchIdle((idle, threshold, idleTime) => {
+      if (idle) {
+        this.emit('idle', { threshold, idleTime })
+      } else {
+        this.emit('active', { idleTime })
+      }
+    }, thresholds, opts.jitter ?? 0)
+  }
+
+  unwatchIdle () {
+    lib.unwatchIdle()
+  }
+
+  /**
+   * Stops delivering events while the OS hook keeps running, so resume() is instant.
+   * Events captured before the call are still delivered. Paused events are discarded
+   * on the hook thread, hotkeys, sequences and aggregation don't see them. Idle detection,
+   * the heatmap, isKeyDown() and the other state queries stay up to date.
+   */
+  pause () {
+    lib.setPaused(true)
+  }
+
+  resume () {
+    lib.setPaused(false)
+  }
+
+  /**
+   * libuiohook and the hook thread log into a preallocated buffer, a separate thread writes
+   * it to stderr or passes it to `handler`, so logging never stalls the hook. Logging is
+   * shared by all worker_threads, the last handler set receives all messages.
+   */
+  setLogging (opts: UiohookLogOptions) {
+    if (opts.level !== undefined) {
+      lib.setLogLevel(LOG_LEVELS[opts.level])
+    }
+    if (opts.handler !== undefined) {
+      const handler = opts.handler
+      lib.setLogHandler(handler && ((level, message) => {
+        handler(LOG_LEVEL_NAMES[level] as UiohookLogLevel, message)
+      }))
+    }
+  }
+
+  getLogCounters (): UiohookLogCounters {
+    return lib.getLogCounters()
+  }
+
+  /** Applied when the hook thread starts next time, it is shared by all worker_threads */
+  setHookThreadOptions (opts: UiohookHookThreadOptions) {
+    lib.setHookThreadOptions({
+      policy: SCHED_POLICIES[opts.policy ?? 'default'],
+      priority: opts.priority,
+      cpus: opts.cpus,
+      lockMemory: opts.lockMemory ? 1 : 0,
+      measureJitter: opts.measureJitter ? 1 : 0
+    })
+  }
+
+  /** What was applied to the hook thread when it started */
+  getHookThreadReport (): UiohookHookThreadReport {
+    const report = lib.getHookThreadReport()
+    const policies = ['inherit', 'inherit', 'other', 'rr', 'fifo'] as const
+    return {
+      started: report.started,
+      policy: policies[report.policy],
+      priority: report.priority,
+      cpus: report.cpus.length ? report.cpus : null,
+      lockedBytes: report.lockedBytes,
+      errors: {
+        scheduling: report.schedError,
+        affinity: report.affinityError,
+        memory: report.memoryError
+      },
+      jitter: report.jitter.count ? report.jitter : null
+    }
   }
 
   stop () {
+    if (this.activityTimer) {
+      // The last, partial interval
+      this.emitActivity()
+      clearInterval(this.activityTimer)
+      this.activityTimer = undefined
+    }
     lib.stop()
+    this.running = undefined
+    this.updateEventMask()
+  }
+
+  /**
+   * Matches a key with modifiers (see HotkeyModifier), or a chord of them like Ctrl+K, Ctrl+S,
+   * on the hook thread. Only matches are passed to JS as 'hotkey' events with this id.
+   * Key events are not passed at all unless there are key listeners.
+   */
+  registerHotkey (keycode: number, modifiers: number, id: number): void
+  registerHotkey (chord: Array<[keycode: number, modifiers: number]>, id: number): void
+  registerHotkey (keycodeOrChord: number | Array<[number, number]>, modifiersOrId: number, id?: number) {
+    const chord = (typeof keycodeOrChord === 'number')
+      ? [[keycodeOrChord, modifiersOrId]]
+      : keycodeOrChord
+    const strokes = chord.map(([keycode, modifiers]) => (keycode | (modifiers << 16)) >>> 0)
+
+    const hotkeys = new Map(this.hotkeys)
+    hotkeys.set((typeof keycodeOrChord === 'number') ? id! : modifiersOrId, strokes)
+    this.setHotkeys(hotkeys)
+  }
+
+  unregisterHotkey (id: number) {
+    const hotkeys = new Map(this.hotkeys)
+    hotkeys.delete(id)
+    this.setHotkeys(hotkeys)
+  }
+
+  /**
+   * Matches typed key sequences, like text expansion abbreviations, on the hook thread.
+   * Each step is a keycode or a [keycode, modifiers] pair (see HotkeyModifier), modifier keys
+   * themselves are not steps. A 'sequence' event with this id and the sequence length is
+   * emitted when the last key is pressed, key events are not passed unless there are key
+   * listeners. Thousands of sequences cost the same per key press as one.
+   */
+  registerSequence (steps: Array<number | [keycode: number, modifiers: number]>, id: number) {
+    const strokes = steps.map((step) => (typeof step === 'number')
+      ? step
+      : (step[0] | (step[1] << 16)) >>> 0)
+
+    const sequences = new Map(this.sequences)
+    sequences.set(id, strokes)
+    this.setSequences(sequences, this.sequenceOptions)
+  }
+
+  unregisterSequence (id: number) {
+    const sequences = new Map(this.sequences)
+    sequences.delete(id)
+    this.setSequences(sequences, this.sequenceOptions)
+  }
+
+  setSequenceOptions (opts: UiohookSequenceOptions) {
+    this.setSequences(this.sequences, { ...this.sequenceOptions, ...opts })
+  }
+
+  private setSequences (sequences: Map<number, number[]>, opts: Required<UiohookSequenceOptions>) {
+    const data: number[] = []
+    for (const [id, strokes] of sequences) {
+      data.push(id, strokes.length, ...strokes)
+    }
+    lib.setSequences(new Uint32Array(data), SEQUENCE_BACKSPACE[opts.backspace], opts.resetOnClick)
+    this.sequences = sequences
+    this.sequenceOptions = opts
+  }
+
+  private regions = new Map<number, UiohookRegion>()
+
+  /**
+   * Mouse events are only passed to JS inside registered regions, tagged with `region`,
+   * plus 'regionenter' and 'regionleave' when the pointer crosses a region border.
+   * Hit-testing is done on the hook thread. Regions added later are on top of earlier ones.
+   * Replaces the region with the same id, ids are 1-65535.
+   */
+  addRegion (id: number, region: UiohookRegion) {
+    const regions = new Map(this.regions)
+    regions.delete(id)
+    regions.set(id, region)
+    this.setRegions(regions)
+  }
+
+  /** Moves, resizes or changes event types of a region, it stays at the same depth */
+  updateRegion (id: number, changes: Partial<UiohookRegion>) {
+    const region = this.regions.get(id)
+    if (!region) throw new Error(`Unknown region ${id}`)
+    const regions = new Map(this.regions)
+    regions.set(id, { ...region, ...changes })
+    this.setRegions(regions)
+  }
+
+  removeRegion (id: number) {
+    const regions = new Map(this.regions)
+    regions.delete(id)
+    this.setRegions(regions)
+  }
+
+  private setRegions (regions: Map<number, UiohookRegion>) {
+    const data: number[] = []
+    for (const [id, region] of regions) {
+      let types = 0
+      for (const name of region.events ?? Object.keys(REGION_EVENT_TYPES) as Array<keyof typeof REGION_EVENT_TYPES>) {
+        types |= 1 << REGION_EVENT_TYPES[name]
+      }
+      data.push(id, region.x, region.y, region.width, region.height, types)
+    }
+    lib.setRegions(new Int32Array(data))
+    this.regions = regions
+  }
+
+  private setHotkeys (hotkeys: Map<number, number[]>) {
+    const data: number[] = []
+    for (const [id, strokes] of hotkeys) {
+      data.push(id, strokes.length, ...strokes)
+    }
+    lib.setHotkeys(new Uint32Array(data))
+    this.hotkeys = hotkeys
   }
 
   keyTap (key: number, modifiers: number[] = []) {
@@ -266,6 +1582,113 @@ class UiohookNapi extends EventEmitter {
   keyToggle (key: number, toggle: 'down' | 'up') {
     lib.keyTap(key, (toggle === 'down' ? KeyToggle.Down : KeyToggle.Up))
   }
+
+  /**
+   * Posts the whole sequence from a native injection thread, delays between
+   * steps don't block the event loop. A Uint32Array holds [keycode, KeyToggle, delay] triples.
+   * Aborting the signal skips the remaining steps, releases keys the sequence still holds
+   * and rejects with the abort reason.
+   */
+  keySequence (steps: KeySequenceStep[] | Uint32Array, opts: UiohookInjectOptions = {}): Promise<void> {
+    let data: Uint32Array
+    if (steps instanceof Uint32Array) {
+      data = steps
+    } else {
+      data = new Uint32Array(steps.length * 3)
+      steps.forEach(([key, toggle, delay = 0], i) => {
+        data[i * 3] = key
+        data[i * 3 + 1] = (toggle === 'down') ? KeyToggle.Down : (toggle === 'up') ? KeyToggle.Up : KeyToggle.Tap
+        data[i * 3 + 2] = delay
+      })
+    }
+    return this.inject(id => lib.injectKeys(data, id), opts.signal)
+  }
+
+  /**
+   * Types the text with the current keyboard layout from the injection thread, at `cps`
+   * characters per second or as fast as possible. Throws if the layout can't type a character.
+   */
+  typeText (text: string, opts: UiohookTypeTextOptions = {}): Promise<void> {
+    return this.inject(id => lib.injectText(text, opts.cps ?? 0, id), opts.signal)
+  }
+
+  /** Buttons: 1 - left, 2 - right, 3 - middle */
+  mouseClick (x: number, y: number, button = 1) {
+    lib.mouseTap(x, y, button, KeyToggle.Tap)
+  }
+
+  mouseToggle (x: number, y: number, button: number, toggle: 'down' | 'up') {
+    lib.mouseTap(x, y, button, (toggle === 'down' ? KeyToggle.Down : KeyToggle.Up))
+  }
+
+  mouseMove (x: number, y: number) {
+    lib.mouseMove(x, y)
+  }
+
+  /** Negative rotation scrolls up or left */
+  mouseWheel (x: number, y: number, rotation: number, direction = WheelDirection.VERTICAL) {
+    lib.mouseWheel(x, y, rotation, direction)
+  }
+
+  /**
+   * Moves the pointer through the waypoints in one native call, intermediate moves
+   * are generated at a fixed rate on the injection thread. With `button` it's a drag.
+   */
+  mouseMovePath (points: Array<[x: number, y: number]>, opts: UiohookMousePathOptions): Promise<void> {
+    const data = new Int32Array(points.length * 2)
+    points.forEach(([x, y], i) => {
+      data[i * 2] = x
+      data[i * 2 + 1] = y
+    })
+    const easing = MOUSE_PATH_EASINGS[opts.easing ?? 'ease-in-out']
+    return this.inject(id => lib.injectMousePath(data, opts.duration, easing, opts.rate ?? 120, opts.button ?? 0, id), opts.signal)
+  }
+
+  /**
+   * Streams every event captured while the hook runs to a compact binary file,
+   * the file is written from a native thread. One recording at a time per process.
+   */
+  startRecording (path: string) {
+    lib.startRecording(path)
+  }
+
+  /** Returns null if this thread isn't recording */
+  stopRecording (): UiohookRecordingSummary | null {
+    return lib.stopRecording() ?? null
+  }
+
+  /** Posts the events of a recording with their original timing divided by `speed` */
+  replay (path: string, opts: UiohookReplayOptions = {}): Promise<void> {
+    return this.inject(id => lib.replay(path, opts.speed ?? 1, id), opts.signal)
+  }
+
+  private lastInjectionId = 0
+
+  private async inject (submit: (id: number) => Promise<boolean>, signal?: AbortSignal): Promise<void> {
+    if (signal?.aborted) throw abortReason(signal)
+
+    const id = this.lastInjectionId = (this.lastInjectionId + 1) >>> 0
+    const onAbort = () => { lib.cancelInjection(id) }
+    signal?.addEventListener('abort', onAbort)
+    try {
+      if (!await submit(id)) throw abortReason(signal)
+    } finally {
+      signal?.removeEventListener('abort', onAbort)
+    }
+  }
+}
+
+function startMode (opts: UiohookStartOptions | UiohookStreamStartOptions | UiohookAggregateStartOptions): StartMode {
+  return ('aggregate' in opts) ? 'aggregate' : ('stream' in opts) ? 'stream' : 'events'
+}
+
+function alreadyStarted () {
+  return Object.assign(new Error('The hook is already started.'), { code: 'ERR_INVALID_STATE' })
+}
+
+function abortReason (signal?: AbortSignal): unknown {
+  if (signal?.reason !== undefined) return signal.reason
+  return Object.assign(new Error('The operation was aborted'), { name: 'AbortError', code: 'ABORT_ERR' })
 }
 
 export const uIOhook = new UiohookNapi()
@@ -0,0 +1,53 @@
+#include <math.h>
+#include <string.h>
+
+#include "activity.h"
+#include "atomic_helpers.h"
+
+void activity_reset(activity_counters* activity) {
+  memset(activity, 0, sizeof(activity_counters));
+}
+
+static void position_update(activity_counters* activity, int16_t x, int16_t y) {
+  if (activity->has_position) {
+    double dx = (double)x - activity->x;
+    double dy = (double)y - activity->y;
+    if (dx != 0 || dy != 0) {
+      atomic_add_u64(&activity->distance, (uint64_t)(sqrt(dx * dx + dy * dy) * ACTIVITY_DISTANCE_SCALE + 0.5));
+    }
+  }
+  activity->has_position = true;
+  activity->x = x;
+  activity->y = y;
+}
+
+void activity_push(activity_counters* activity, const uiohook_event* event) {
+  switch (event->type) {
+  case EVENT_KEY_PRESSED:
+    atomic_add_u64(&activity->keys, 1);
+    break;
+  case EVENT_MOUSE_PRESSED:
+    atomic_add_u64(&activity->clicks, 1);
+    position_update(activity, event->data.mouse.x, event->data.mouse.y);
+    break;
+  case EVENT_MOUSE_RELEASED:
+  case EVENT_MOUSE_MOVED:
+  case EVENT_MOUSE_DRAGGED:
+    position_update(activity, event->data.mouse.x, event->data.mouse.y);
+    break;
+  case EVENT_MOUSE_WHEEL: {
+    int32_t rotation = event->data.wheel.rotation;
+    atomic_add_u64(&activity->scroll, (uint64_t)(rotation < 0 ? -rotation : rotation));
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+void activity_take(activity_counters* activity, activity_summary* summary) {
+  summary->keys = atomic_exchange_u64(&activity->keys, 0);
+  summary->clicks = atomic_exchange_u64(&activity->clicks, 0);
+  summary->scroll = atomic_exchange_u64(&activity->scroll, 0);
+  summary->distance = (double)atomic_exchange_u64(&activity->distance, 0) / ACTIVITY_DISTANCE_SCALE;
+}
@@ -0,0 +1,41 @@
+#ifndef ADDON_SRC_ACTIVITY_H_
+#define ADDON_SRC_ACTIVITY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <uiohook.h>
+
+// Activity totals accumulated on the hook thread, JS takes and resets them
+// once per interval. Every event costs a few atomic adds no matter how
+// many events there are.
+
+#define ACTIVITY_DISTANCE_SCALE 1024 // fixed point fraction of a pixel
+
+typedef struct {
+  volatile uint64_t keys;     // key presses, auto-repeat included
+  volatile uint64_t clicks;   // mouse button presses
+  volatile uint64_t scroll;   // wheel rotation, absolute
+  volatile uint64_t distance; // mouse travel * ACTIVITY_DISTANCE_SCALE
+  // Hook thread only
+  bool has_position;
+  int16_t x;
+  int16_t y;
+} activity_counters;
+
+typedef struct {
+  uint64_t keys;
+  uint64_t clicks;
+  uint64_t scroll;
+  double distance; // px
+} activity_summary;
+
+void activity_reset(activity_counters* activity);
+
+// Hook thread side.
+void activity_push(activity_counters* activity, const uiohook_event* event);
+
+// Returns the totals since the previous call and starts over. Events
+// counted concurrently go into one interval or the next, never both.
+void activity_take(activity_counters* activity, activity_summary* summary);
+
+#endif // !ADDON_SRC_ACTIVITY_H_
@@ -1,336 +1,3035 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <node_api.h>
 #include <uiohook.h>
+#include <uv.h>
+#include "activity.h"
+#include "atomic_helpers.h"
+#include "event_objects.h"
+#include "event_ring.h"
+#include "event_stream.h"
+#include "heatmap.h"
+#include "hotkeys.h"
+#include "idle.h"
+#include "injector.h"
+#include "keymap.h"
+#include "log_ring.h"
 #include "napi_helpers.h"
+#include "recorder.h"
+#include "regions.h"
+#include "sequences.h"
+#include "stats.h"
 #include "uiohook_worker.h"
 
-static napi_threadsafe_function threadsafe_fn = NULL;
-static bool is_worker_running = false;
+#define BATCH_MAX_LATENCY_LIMIT 1000 // ms
 
-void dispatch_proc(uiohook_event* const event) {
-  if (threadsafe_fn == NULL) return;
+typedef enum {
+  drain_idle,
+  drain_armed, // waiting for the flush thread
+  drain_scheduled
+} drain_state_t;
+
+// Latency of every stage an event goes through, enabled with the `stats`
+// start option. When disabled the hook thread doesn't read the clock
+// and the drain only checks a flag.
+typedef enum {
+  stats_stage_hook,  // captured by the hook thread -> queued
+  stats_stage_queue, // queued -> taken by the JS thread
+  stats_stage_js,    // taken -> JS callback returned
+  stats_stage_total, // captured -> JS callback returned
+  stats_stage_count
+} stats_stage;
+
+#define STATS_EVENT_TYPES (EVENT_HOTKEY + 1)
+
+// State of one N-API environment (the main thread or a worker_thread)
+// the addon is loaded into. The hook thread fans out every event to all
+// subscribed environments, each filters and queues it on its own.
+typedef struct {
+  napi_env env;
+  bool is_subscribed; // between start() and stop(), JS thread only
+  struct start_job* start_job; // startAsync() in progress, JS thread only
+  volatile uint32_t paused; // the hook keeps running, events are not aggregated or passed to JS
+  napi_threadsafe_function threadsafe_fn;
+
+  // Bit per event type, events of other types are discarded on the hook thread.
+  volatile uint32_t event_mask;
+  bool drop_key_repeat; // auto-repeated presses
+  hotkey_matcher hotkeys;
+  sequence_matcher sequences;
+  // Mouse events are only passed inside registered regions, if there are any.
+  region_index regions;
+
+  // Events are queued by the hook thread into a preallocated ring and the
+  // JS thread drains everything queued so far in a single threadsafe
+  // function call. Only one call is in flight at a time.
+  event_ring queue;
+  bool queue_locked; // in memory, see setHookThreadOptions()
+  uint32_t queue_capacity;
+  event_ring_overflow queue_overflow;
+  uint32_t queue_block_timeout; // ms
+  uint32_t coalesce_window; // ms
+  bool coalesce_wheel;
+  volatile uint32_t drain_state;
+
+  // Stream mode: events are written straight into a SharedArrayBuffer
+  // that JS polls, no threadsafe function is involved.
+  event_stream stream;
+  napi_ref stream_ref;
+
+  // Aggregation mode: events are only counted, JS takes the totals
+  // periodically with takeActivity().
+  bool activity_enabled;
+  activity_counters activity;
+  uint64_t activity_taken; // uv_hrtime(), JS thread only
+
+  // Fed in every mode while subscribed, see watchIdle().
+  idle_detector* volatile idle;
+  napi_threadsafe_function idle_fn;
+
+  // Fed in every mode while subscribed, see startHeatmap().
+  heatmap* volatile heatmap;
+  napi_ref heatmap_ref; // the counters buffer
+
+  // Batched delivery: the JS callback receives an array of events instead
+  // of being called per event.
+  uint32_t batch_max_size; // 0 - batching is disabled
+  uint32_t batch_max_latency; // ms
+  volatile uint64_t batch_flush_deadline;
+  uv_thread_t batch_flush_thread;
+  uv_sem_t batch_flush_sem;
+  bool batch_flush_running;
+
+  napi_ref event_class_refs[event_class_count];
+
+  bool stats_enabled;
+  stats_histogram stats_stages[stats_stage_count]; // JS thread only
+  uint64_t stats_last_events[STATS_EVENT_TYPES];
+  uint64_t stats_last_time;
+  uint64_t* stats_batch_captured; // capture times of the batch being built
+} subscriber;
+
+// Subscribed environments. The list is immutable except for removed
+// entries being set to NULL, JS threads replace it under
+// subscribers_mutex and the hook thread reads it without locking.
+typedef struct {
+  uint32_t length;
+  subscriber* volatile items[1];
+} subscriber_list;
+
+static uv_once_t subscribers_once = UV_ONCE_INIT;
+static uv_mutex_t subscribers_mutex;
+static subscriber_list* volatile active_subscribers = NULL;
+static uint32_t subscriber_count = 0; // the hook runs while there are subscribers
+static uint32_t stats_subscriber_count = 0;
+
+// Odd while the hook thread dispatches an event.
+static volatile uint32_t dispatch_seq = 0;
+
+static volatile uint64_t stats_events[STATS_EVENT_TYPES]; // counted by the hook thread
+
+// One recording at a time, started and stopped under subscribers_mutex.
+static recorder* volatile active_recorder = NULL;
+static subscriber* recorder_owner = NULL;
+
+// One JS log handler per process, set and cleared under subscribers_mutex.
+static napi_threadsafe_function log_handler_fn = NULL;
+static subscriber* log_handler_owner = NULL;
+
+void subscribers_init() {
+  uv_mutex_init(&subscribers_mutex);
+}
+
+// Waits for the hook thread to finish dispatching the current event,
+// after that it doesn't see a replaced list or a removed subscriber.
+void subscribers_sync() {
+  uint32_t seq = atomic_load_u32(&dispatch_seq);
+  if (seq & 1) {
+    // The dispatch may be blocked by a full queue, don't spin.
+    while (atomic_load_u32(&dispatch_seq) == seq) {
+      uv_sleep(1);
+    }
+  }
+}
+
+// Must hold subscribers_mutex.
+int subscribers_add(subscriber* sub) {
+  subscriber_list* old_list = active_subscribers;
+  subscriber_list* list = malloc(sizeof(subscriber_list) + subscriber_count * sizeof(subscriber*));
+  if (list == NULL) return -1;
+
+  list->length = 0;
+  for (uint32_t i = 0; old_list != NULL && i < old_list->length; i++) {
+    if (old_list->items[i] != NULL) {
+      list->items[list->length++] = old_list->items[i];
+    }
+  }
+  list->items[list->length++] = sub;
+  subscriber_count++;
+
+  atomic_exchange_ptr((void* volatile*)&active_subscribers, list);
+  subscribers_sync();
+  free(old_list);
+  return 0;
+}
+
+// Must hold subscribers_mutex. Never allocates, so leaving can't fail.
+void subscribers_remove(subscriber* sub) {
+  subscriber_list* list = active_subscribers;
+  for (uint32_t i = 0; list != NULL && i < list->length; i++) {
+    if (list->items[i] == sub) {
+      atomic_exchange_ptr((void* volatile*)&list->items[i], NULL);
+      subscriber_count--;
+      break;
+    }
+  }
+  subscribers_sync();
+}
+
+// Must hold subscribers_mutex.
+void subscribers_stats_changed(int delta) {
+  stats_subscriber_count += delta;
+  uiohook_worker_timestamps(stats_subscriber_count != 0);
+}
 
-  uiohook_event* copied_event = malloc(sizeof(uiohook_event));
-  memcpy(copied_event, event, sizeof(uiohook_event));
-  if (copied_event->type == EVENT_MOUSE_DRAGGED) {
-    copied_event->type = EVENT_MOUSE_MOVED;
+void stats_reset(subscriber* sub) {
+  for (int i = 0; i < stats_stage_count; i++) {
+    stats_histogram_reset(&sub->stats_stages[i]);
+  }
+  for (int i = 0; i < STATS_EVENT_TYPES; i++) {
+    sub->stats_last_events[i] = atomic_load_u64(&stats_events[i]);
   }
+  sub->stats_last_time = uv_hrtime();
+}
+
+void stats_record_taken(subscriber* sub, const event_ring_times* times, uint64_t taken) {
+  if (times->captured == 0) return;
+  stats_histogram_record(&sub->stats_stages[stats_stage_hook], times->enqueued - times->captured);
+  stats_histogram_record(&sub->stats_stages[stats_stage_queue], taken - times->enqueued);
+}
+
+void drain_call(subscriber* sub) {
+  napi_threadsafe_function tsfn = sub->threadsafe_fn;
+  if (tsfn == NULL) return;
 
-  napi_status status = napi_call_threadsafe_function(threadsafe_fn, copied_event, napi_tsfn_nonblocking);
+  napi_status status = napi_call_threadsafe_function(tsfn, NULL, napi_tsfn_nonblocking);
   if (status == napi_closing) {
-    threadsafe_fn = NULL;
-    free(copied_event);
+    sub->threadsafe_fn = NULL;
     return;
   }
-  NAPI_FATAL_IF_FAILED(status, "dispatch_proc", "napi_call_threadsafe_function");
+  NAPI_FATAL_IF_FAILED(status, "drain_call", "napi_call_threadsafe_function");
 }
 
-napi_value uiohook_to_js_event(napi_env env, uiohook_event* event) {
-  napi_status status;
-
-  napi_value event_obj;
-  status = napi_create_object(env, &event_obj);
-  NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_object");
+// `latency` is how long the event may wait for the next drain.
+void drain_schedule(subscriber* sub, uint32_t latency) {
+  // Pairs with the fence in tsfn_to_js_proxy: either the drain sees the
+  // event just queued, or this sees the drain idle and schedules another.
+  atomic_fence();
+  uint32_t state = atomic_load_u32(&sub->drain_state);
+  if (state == drain_scheduled) return;
 
-  napi_value e_type;
-  status = napi_create_uint32(env, event->type, &e_type);
-  NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_uint32");
+  if (latency == 0 || (sub->batch_max_size != 0 && event_ring_size(&sub->queue) >= sub->batch_max_size)) {
+    if (atomic_cas_u32(&sub->drain_state, state, drain_scheduled)) {
+      drain_call(sub);
+    }
+  }
+  else if (state == drain_idle) {
+    // Let the flush thread wake JS when the oldest event gets too old.
+    if (atomic_cas_u32(&sub->drain_state, drain_idle, drain_armed)) {
+      atomic_store_u64(&sub->batch_flush_deadline, uv_hrtime() + (uint64_t)latency * 1000000);
+      uv_sem_post(&sub->batch_flush_sem);
+    }
+  }
+}
 
-  napi_value e_altKey;
-  status = napi_get_boolean(env, (event->mask & (MASK_ALT)), &e_altKey);
-  NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_get_boolean");
+void batch_flush_proc(void* arg) {
+  subscriber* sub = arg;
 
-  napi_value e_ctrlKey;
-  status = napi_get_boolean(env, (event->mask & (MASK_CTRL)), &e_ctrlKey);
-  NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_get_boolean");
+  for (;;) {
+    uv_sem_wait(&sub->batch_flush_sem);
+    if (!sub->batch_flush_running) break;
 
-  napi_value e_metaKey;
-  status = napi_get_boolean(env, (event->mask & (MASK_META)), &e_metaKey);
-  NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_get_boolean");
+    uint64_t deadline = atomic_load_u64(&sub->batch_flush_deadline);
+    uint64_t now = uv_hrtime();
+    if (deadline > now) {
+      uv_sleep((unsigned int)((deadline - now + 999999) / 1000000));
+    }
 
-  napi_value e_shiftKey;
-  status = napi_get_boolean(env, (event->mask & (MASK_SHIFT)), &e_shiftKey);
-  NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_get_boolean");
+    if (atomic_cas_u32(&sub->drain_state, drain_armed, drain_scheduled)) {
+      drain_call(sub);
+    }
+  }
+}
 
-  napi_value e_time;
-  status = napi_create_double(env, (double)event->time, &e_time);
-  NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_double");
+int queue_start(subscriber* sub) {
+  if (event_ring_init(&sub->queue, sub->queue_capacity, sub->queue_overflow, sub->queue_block_timeout) != 0)
+    return UIOHOOK_ERROR_OUT_OF_MEMORY;
 
-  if (event->type == EVENT_KEY_PRESSED || event->type == EVENT_KEY_RELEASED) {
-    napi_value e_keycode;
-    status = napi_create_uint32(env, event->data.keyboard.keycode, &e_keycode);
-    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_uint32");
+  sub->queue_locked = uiohook_worker_lock_memory(sub->queue.slots, (sub->queue.mask + 1) * sizeof(event_ring_slot));
+  event_ring_coalesce(&sub->queue, sub->coalesce_window, sub->coalesce_wheel);
+  sub->drain_state = drain_idle;
 
-    napi_property_descriptor descriptors[] = {
-      { "type",     NULL, NULL, NULL, NULL, e_type,     napi_enumerable, NULL },
-      { "time",     NULL, NULL, NULL, NULL, e_time,     napi_enumerable, NULL },
-      { "altKey",   NULL, NULL, NULL, NULL, e_altKey,   napi_enumerable, NULL },
-      { "ctrlKey",  NULL, NULL, NULL, NULL, e_ctrlKey,  napi_enumerable, NULL },
-      { "metaKey",  NULL, NULL, NULL, NULL, e_metaKey,  napi_enumerable, NULL },
-      { "shiftKey", NULL, NULL, NULL, NULL, e_shiftKey, napi_enumerable, NULL },
-      { "keycode",  NULL, NULL, NULL, NULL, e_keycode,  napi_enumerable, NULL },
-    };
-    status = napi_define_properties(env, event_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
-    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_define_properties");
-    return event_obj;
+  if (sub->stats_enabled && sub->batch_max_size != 0) {
+    sub->stats_batch_captured = malloc(sub->batch_max_size * sizeof(uint64_t));
+    if (sub->stats_batch_captured == NULL) return UIOHOOK_ERROR_OUT_OF_MEMORY;
   }
-  else if (event->type == EVENT_MOUSE_MOVED || event->type == EVENT_MOUSE_PRESSED || event->type == EVENT_MOUSE_RELEASED || event->type == EVENT_MOUSE_CLICKED) {
-    napi_value e_x;
-    status = napi_create_int32(env, event->data.mouse.x, &e_x);
-    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_int32");
 
-    napi_value e_y;
-    status = napi_create_int32(env, event->data.mouse.y, &e_y);
-    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_int32");
+  if (sub->batch_max_latency == 0 && (sub->coalesce_window == 0 || sub->coalesce_window == EVENT_RING_COALESCE_UNTIL_DRAIN))
+    return UIOHOOK_SUCCESS;
 
-    napi_value e_button;
-    status = napi_create_uint32(env, event->data.mouse.button, &e_button);
-    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_uint32");
+  uv_sem_init(&sub->batch_flush_sem, 0);
+  sub->batch_flush_running = true;
+  if (uv_thread_create(&sub->batch_flush_thread, batch_flush_proc, sub) != 0) {
+    sub->batch_flush_running = false;
+    uv_sem_destroy(&sub->batch_flush_sem);
+    return UIOHOOK_ERROR_THREAD_CREATE;
+  }
+  return UIOHOOK_SUCCESS;
+}
 
-    napi_value e_clicks;
-    status = napi_create_uint32(env, event->data.mouse.clicks, &e_clicks);
-    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_uint32");
+void queue_stop(subscriber* sub) {
+  if (sub->batch_flush_running) {
+    sub->batch_flush_running = false;
+    uv_sem_post(&sub->batch_flush_sem);
+    uv_thread_join(&sub->batch_flush_thread);
+    uv_sem_destroy(&sub->batch_flush_sem);
+  }
+  if (sub->queue_locked) {
+    uiohook_worker_unlock_memory(sub->queue.slots, (sub->queue.mask + 1) * sizeof(event_ring_slot));
+    sub->queue_locked = false;
+  }
+  event_ring_destroy(&sub->queue);
+  free(sub->stats_batch_captured);
+  sub->stats_batch_captured = NULL;
+}
 
-    napi_property_descriptor descriptors[] = {
-      { "type",     NULL, NULL, NULL, NULL, e_type,     napi_enumerable, NULL },
-      { "time",     NULL, NULL, NULL, NULL, e_time,     napi_enumerable, NULL },
-      { "altKey",   NULL, NULL, NULL, NULL, e_altKey,   napi_enumerable, NULL },
-      { "ctrlKey",  NULL, NULL, NULL, NULL, e_ctrlKey,  napi_enumerable, NULL },
-      { "metaKey",  NULL, NULL, NULL, NULL, e_metaKey,  napi_enumerable, NULL },
-      { "shiftKey", NULL, NULL, NULL, NULL, e_shiftKey, napi_enumerable, NULL },
-      { "x",        NULL, NULL, NULL, NULL, e_x,        napi_enumerable, NULL },
-      { "y",        NULL, NULL, NULL, NULL, e_y,        napi_enumerable, NULL },
-      { "button",   NULL, NULL, NULL, NULL, e_button,   napi_enumerable, NULL },
-      { "clicks",   NULL, NULL, NULL, NULL, e_clicks,   napi_enumerable, NULL },
-    };
-    status = napi_define_properties(env, event_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
-    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_define_properties");
-    return event_obj;
+// Passes the event to JS through the stream or the queue.
+void dispatch_to_js(subscriber* sub, uiohook_event* const event, uint64_t captured) {
+  if (sub->stream_ref != NULL) {
+    event_stream_push(&sub->stream, event);
+    return;
   }
-  else if (event->type == EVENT_MOUSE_WHEEL) {
-    napi_value e_x;
-    status = napi_create_int32(env, event->data.wheel.x, &e_x);
-    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_int32");
 
-    napi_value e_y;
-    status = napi_create_int32(env, event->data.wheel.y, &e_y);
-    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_int32");
+  if (sub->threadsafe_fn == NULL) return;
 
-    napi_value e_clicks;
-    status = napi_create_uint32(env, event->data.wheel.clicks, &e_clicks);
-    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_uint32");
+  event_ring_push(&sub->queue, event, captured);
 
-    napi_value e_amount;
-    status = napi_create_uint32(env, event->data.wheel.amount, &e_amount);
-    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_uint32");
+  // Moves are merged while waiting for the drain, so waking JS
+  // can be delayed up to the coalescing window.
+  uint32_t latency = sub->batch_max_latency;
+  if ((event->type == EVENT_MOUSE_MOVED || (event->type == EVENT_MOUSE_WHEEL && sub->coalesce_wheel)) &&
+      sub->coalesce_window != EVENT_RING_COALESCE_UNTIL_DRAIN && sub->coalesce_window > latency) {
+    latency = sub->coalesce_window;
+  }
+  drain_schedule(sub, latency);
+}
 
-    napi_value e_direction;
-    status = napi_create_uint32(env, event->data.wheel.direction, &e_direction);
-    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_uint32");
+void region_transition_dispatch(subscriber* sub, const uiohook_event* event, uint32_t type, uint16_t id, uint32_t mask, uint64_t captured) {
+  if ((mask & (1u << type)) == 0) return;
 
-    napi_value e_rotation;
-    status = napi_create_int32(env, event->data.wheel.rotation, &e_rotation);
-    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_int32");
+  uiohook_event transition;
+  memset(&transition, 0, sizeof(transition));
+  transition.type = type;
+  transition.time = event->time;
+  transition.mask = event->mask;
+  if (event->type == EVENT_MOUSE_WHEEL) {
+    transition.data.mouse.x = event->data.wheel.x;
+    transition.data.mouse.y = event->data.wheel.y;
+  }
+  else {
+    transition.data.mouse.x = event->data.mouse.x;
+    transition.data.mouse.y = event->data.mouse.y;
+  }
+  REGION_EVENT_SET_ID(&transition, id);
+  dispatch_to_js(sub, &transition, captured);
+}
 
-    napi_property_descriptor descriptors[] = {
-      { "type",      NULL, NULL, NULL, NULL, e_type,      napi_enumerable, NULL },
-      { "time",      NULL, NULL, NULL, NULL, e_time,      napi_enumerable, NULL },
-      { "altKey",    NULL, NULL, NULL, NULL, e_altKey,    napi_enumerable, NULL },
-      { "ctrlKey",   NULL, NULL, NULL, NULL, e_ctrlKey,   napi_enumerable, NULL },
-      { "metaKey",   NULL, NULL, NULL, NULL, e_metaKey,   napi_enumerable, NULL },
-      { "shiftKey",  NULL, NULL, NULL, NULL, e_shiftKey,  napi_enumerable, NULL },
-      { "x",         NULL, NULL, NULL, NULL, e_x,         napi_enumerable, NULL },
-      { "y",         NULL, NULL, NULL, NULL, e_y,         napi_enumerable, NULL },
-      { "clicks",    NULL, NULL, NULL, NULL, e_clicks,    napi_enumerable, NULL },
-      { "amount",    NULL, NULL, NULL, NULL, e_amount,    napi_enumerable, NULL },
-      { "direction", NULL, NULL, NULL, NULL, e_direction, napi_enumerable, NULL },
-      { "rotation",  NULL, NULL, NULL, NULL, e_rotation,  napi_enumerable, NULL },
-    };
-    status = napi_define_properties(env, event_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
-    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_define_properties");
-    return event_obj;
+// Passes enter and leave transitions and the event if it is inside a region
+// that wants it. Returns false if there are no regions to filter by.
+bool region_dispatch(subscriber* sub, const uiohook_event* event, uiohook_event* copied_event, uint32_t mask, uint64_t captured) {
+  region_hit hit;
+  bool filtered = regions_match(&sub->regions, copied_event, &hit);
+
+  if (hit.left != 0) {
+    region_transition_dispatch(sub, copied_event, EVENT_REGION_LEAVE, hit.left, mask, captured);
+  }
+  if (hit.entered) {
+    region_transition_dispatch(sub, copied_event, EVENT_REGION_ENTER, hit.id, mask, captured);
+  }
+  if (!filtered) return false;
+
+  if (hit.id != 0 && (hit.types & (1u << copied_event->type)) && (mask & (1u << event->type))) {
+    uiohook_event tagged = *copied_event;
+    REGION_EVENT_SET_ID(&tagged, hit.id);
+    dispatch_to_js(sub, &tagged, captured);
   }
+  return true;
+}
 
-  return NULL; // never
+// Passes every sequence the key press completes, longest first.
+void sequence_dispatch(subscriber* sub, const uiohook_event* event, uint64_t captured) {
+  sequence_match matches[SEQUENCE_MAX_MATCHES];
+  uint32_t count = sequences_push(&sub->sequences, event, matches);
+
+  for (uint32_t i = 0; i < count; i++) {
+    uiohook_event sequence_event;
+    memset(&sequence_event, 0, sizeof(sequence_event));
+    sequence_event.type = EVENT_SEQUENCE;
+    sequence_event.time = event->time;
+    sequence_event.mask = event->mask;
+    SEQUENCE_EVENT_SET(&sequence_event, matches[i].id, matches[i].length);
+    dispatch_to_js(sub, &sequence_event, captured);
+  }
 }
 
-void tsfn_to_js_proxy(napi_env env, napi_value js_callback, void* context, void* _event) {
-  uiohook_event* event = (uiohook_event*)_event;
+// `event` is the original uiohook event, `copied_event` has drags reported as moves.
+void subscriber_dispatch(subscriber* sub, const uiohook_event* event, uiohook_event* copied_event, uint64_t captured) {
+  idle_detector* idle = atomic_load_ptr((void* volatile*)&sub->idle);
+  if (idle != NULL) {
+    idle_detector_push(idle, event);
+  }
+
+  heatmap* map = atomic_load_ptr((void* volatile*)&sub->heatmap);
+  if (map != NULL) {
+    heatmap_push(map, event);
+  }
+
+  // Idle detection and the heatmap keep seeing input while paused
+  if (atomic_load_u32(&sub->paused)) return;
 
-  if (env == NULL || js_callback == NULL || is_worker_running == false) {
-    free(event);
+  if (sub->activity_enabled) {
+    activity_push(&sub->activity, event);
     return;
   }
 
+  if (sub->drop_key_repeat && event->type == EVENT_KEY_PRESSED && KEY_EVENT_REPEAT(copied_event) != 0) return;
+
+  uint32_t mask = atomic_load_u32(&sub->event_mask);
+
+  uint32_t hotkey_id;
+  if (event->type == EVENT_KEY_PRESSED && (mask & (1u << EVENT_HOTKEY)) &&
+      hotkeys_match(&sub->hotkeys, event, &hotkey_id)) {
+    uiohook_event hotkey_event;
+    memset(&hotkey_event, 0, sizeof(hotkey_event));
+    hotkey_event.type = EVENT_HOTKEY;
+    hotkey_event.time = event->time;
+    hotkey_event.mask = event->mask;
+    HOTKEY_EVENT_SET_ID(&hotkey_event, hotkey_id);
+    if (captured != 0) {
+      atomic_add_u64(&stats_events[EVENT_HOTKEY], 1);
+    }
+    dispatch_to_js(sub, &hotkey_event, captured);
+  }
+
+  if ((event->type == EVENT_KEY_PRESSED || event->type == EVENT_MOUSE_PRESSED) && (mask & (1u << EVENT_SEQUENCE))) {
+    sequence_dispatch(sub, event, captured);
+  }
+
+  if (copied_event->type >= EVENT_MOUSE_CLICKED && copied_event->type <= EVENT_MOUSE_WHEEL &&
+      region_dispatch(sub, event, copied_event, mask, captured)) return;
+
+  if ((mask & (1u << event->type)) == 0) return;
+
+  dispatch_to_js(sub, copied_event, captured);
+}
+
+void dispatch_proc(uiohook_event* const event, uint64_t captured) {
+  // Timestamps are only captured with stats enabled
+  if (captured != 0) {
+    atomic_add_u64(&stats_events[event->type == EVENT_MOUSE_DRAGGED ? EVENT_MOUSE_MOVED : event->type], 1);
+  }
+
+  uiohook_event copied_event = *event;
+  if (event->type == EVENT_KEY_PRESSED || event->type == EVENT_KEY_RELEASED) {
+    KEY_EVENT_SET_REPEAT(&copied_event, uiohook_worker_key_repeat());
+  }
+  else {
+    REGION_EVENT_SET_ID(&copied_event, 0);
+  }
+  if (copied_event.type == EVENT_MOUSE_DRAGGED) {
+    copied_event.type = EVENT_MOUSE_MOVED;
+  }
+
+  atomic_add_u32(&dispatch_seq, 1);
+
+  subscriber_list* list = atomic_load_ptr((void* volatile*)&active_subscribers);
+  for (uint32_t i = 0; list != NULL && i < list->length; i++) {
+    subscriber* sub = atomic_load_ptr((void* volatile*)&list->items[i]);
+    if (sub != NULL) {
+      subscriber_dispatch(sub, event, &copied_event, captured);
+    }
+  }
+
+  recorder* rec = atomic_load_ptr((void* volatile*)&active_recorder);
+  if (rec != NULL) {
+    recorder_push(rec, event);
+  }
+
+  atomic_add_u32(&dispatch_seq, 1);
+}
+
+void event_classes_get(napi_env env, subscriber* sub, napi_value* classes) {
+  for (int i = 0; i < event_class_count; i++) {
+    napi_status status = napi_get_reference_value(env, sub->event_class_refs[i], &classes[i]);
+    NAPI_FATAL_IF_FAILED(status, "event_classes_get", "napi_get_reference_value");
+  }
+}
+
+void tsfn_to_js_proxy(napi_env env, napi_value js_callback, void* context, void* data) {
+  subscriber* sub = context;
+  if (env == NULL || js_callback == NULL || sub->is_subscribed == false)
+    return;
+
   napi_status status;
 
-  napi_value event_obj = uiohook_to_js_event(env, event);
+  // Events that arrive after this point will schedule another drain,
+  // so only take what is already queued to not starve the event loop.
+  atomic_store_u32(&sub->drain_state, drain_idle);
+  atomic_fence();
+  uint32_t length = event_ring_size(&sub->queue);
+  if (length == 0) return;
 
   napi_value global;
   status = napi_get_global(env, &global);
   NAPI_FATAL_IF_FAILED(status, "tsfn_to_js_proxy", "napi_get_global");
 
-  status = napi_call_function(env, global, js_callback, 1, &event_obj, NULL);
-  NAPI_FATAL_IF_FAILED(status, "tsfn_to_js_proxy", "napi_call_function");
+  napi_value classes[event_class_count];
+  event_classes_get(env, sub, classes);
+
+  uiohook_event event;
+  event_ring_times times;
+  event_ring_times* times_ptr = sub->stats_enabled ? &times : NULL;
+
+  if (sub->batch_max_size == 0) {
+    for (uint32_t i = 0; i < length && event_ring_pop(&sub->queue, &event, times_ptr); i++) {
+      uint64_t taken = 0;
+      if (sub->stats_enabled) {
+        taken = uv_hrtime();
+        stats_record_taken(sub, &times, taken);
+      }
+
+      napi_value event_obj = uiohook_to_js_event(env, classes, &event);
+
+      status = napi_call_function(env, global, js_callback, 1, &event_obj, NULL);
+      NAPI_FATAL_IF_FAILED(status, "tsfn_to_js_proxy", "napi_call_function");
+
+      // The callback may have called stop(), which frees the queue
+      if (sub->is_subscribed == false) return;
+
+      if (sub->stats_enabled && times.captured != 0) {
+        uint64_t returned = uv_hrtime();
+        stats_histogram_record(&sub->stats_stages[stats_stage_js], returned - taken);
+        stats_histogram_record(&sub->stats_stages[stats_stage_total], returned - times.captured);
+      }
+    }
+    return;
+  }
+
+  for (uint32_t offset = 0; offset < length; offset += sub->batch_max_size) {
+    napi_value batch;
+    status = napi_create_array(env, &batch);
+    NAPI_FATAL_IF_FAILED(status, "tsfn_to_js_proxy", "napi_create_array");
+
+    uint64_t taken = 0;
+    uint32_t count = 0;
+    while (offset + count < length && count < sub->batch_max_size && event_ring_pop(&sub->queue, &event, times_ptr)) {
+      if (sub->stats_enabled) {
+        if (count == 0) taken = uv_hrtime();
+        stats_record_taken(sub, &times, taken);
+        sub->stats_batch_captured[count] = times.captured;
+      }
 
-  free(event);
+      napi_value event_obj = uiohook_to_js_event(env, classes, &event);
+      status = napi_set_element(env, batch, count++, event_obj);
+      NAPI_FATAL_IF_FAILED(status, "tsfn_to_js_proxy", "napi_set_element");
+    }
+    if (count == 0) break;
+
+    status = napi_call_function(env, global, js_callback, 1, &batch, NULL);
+    NAPI_FATAL_IF_FAILED(status, "tsfn_to_js_proxy", "napi_call_function");
+    if (sub->is_subscribed == false) return;
+
+    // The JS stage of a batch starts when its first event is taken
+    if (sub->stats_enabled) {
+      uint64_t returned = uv_hrtime();
+      stats_histogram_record(&sub->stats_stages[stats_stage_js], returned - taken);
+      for (uint32_t i = 0; i < count; i++) {
+        if (sub->stats_batch_captured[i] != 0) {
+          stats_histogram_record(&sub->stats_stages[stats_stage_total], returned - sub->stats_batch_captured[i]);
+        }
+      }
+    }
+  }
 }
 
-napi_value AddonStart(napi_env env, napi_callback_info info) {
-  if (is_worker_running == true)
-    return NULL;
+subscriber* subscriber_get(napi_env env) {
+  subscriber* sub = NULL;
+  napi_status status = napi_get_instance_data(env, (void**)&sub);
+  NAPI_FATAL_IF_FAILED(status, "subscriber_get", "napi_get_instance_data");
+  return sub;
+}
 
-  napi_status status;
+// Adds the subscriber to the fan-out, the first one starts the hook.
+// `times` are zeroed if the hook was already running.
+int subscriber_join(subscriber* sub, worker_start_times* times) {
+  uv_mutex_lock(&subscribers_mutex);
 
-  size_t info_argc = 1;
-  napi_value info_argv[1];
-  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
-  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (sub->stats_enabled) {
+    subscribers_stats_changed(1);
+  }
+
+  int status = UIOHOOK_SUCCESS;
+  if (times != NULL) {
+    memset(times, 0, sizeof(worker_start_times));
+  }
+  if (subscribers_add(sub) != 0) {
+    status = UIOHOOK_ERROR_OUT_OF_MEMORY;
+  }
+  else if (subscriber_count == 1) {
+    status = uiohook_worker_start(dispatch_proc);
+    if (times != NULL) {
+      uiohook_worker_start_times(times);
+    }
+    if (status != UIOHOOK_SUCCESS) {
+      subscribers_remove(sub);
+    }
+  }
+
+  if (status != UIOHOOK_SUCCESS && sub->stats_enabled) {
+    subscribers_stats_changed(-1);
+  }
+
+  uv_mutex_unlock(&subscribers_mutex);
+  return status;
+}
+
+// Removes the subscriber from the fan-out, the last one stops the hook.
+// Afterwards the hook thread doesn't touch the subscriber anymore.
+int subscriber_leave(subscriber* sub) {
+  uv_mutex_lock(&subscribers_mutex);
+
+  int status = UIOHOOK_SUCCESS;
+  if (subscriber_count == 1) {
+    status = uiohook_worker_stop();
+  }
+  if (status == UIOHOOK_SUCCESS) {
+    subscribers_remove(sub);
+    if (sub->stats_enabled) {
+      subscribers_stats_changed(-1);
+    }
+  }
+
+  uv_mutex_unlock(&subscribers_mutex);
+  return status;
+}
+
+// Releases everything acquired in AddonStart, the subscriber must have left.
+void addon_release(napi_env env, subscriber* sub) {
+  if (sub->activity_enabled) {
+    sub->activity_enabled = false;
+    return;
+  }
+  if (sub->stream_ref != NULL) {
+    napi_delete_reference(env, sub->stream_ref);
+    sub->stream_ref = NULL;
+    return;
+  }
+
+  queue_stop(sub);
+  if (sub->threadsafe_fn != NULL) {
+    napi_release_threadsafe_function(sub->threadsafe_fn, napi_tsfn_release);
+    sub->threadsafe_fn = NULL;
+  }
+}
+
+// Reads the start() options and sets up delivery to JS, everything but
+// joining the hook. Returns false with an exception pending, otherwise
+// `worker_status` tells if the setup succeeded.
+bool start_prepare(napi_env env, subscriber* sub, size_t info_argc, napi_value* info_argv, int* worker_status) {
+  napi_status status;
 
   napi_value cb = info_argv[0];
 
-  napi_value async_resource_name;
-  status = napi_create_string_utf8(env, "UIOHOOK_NAPI", NAPI_AUTO_LENGTH, &async_resource_name);
-  NAPI_THROW_IF_FAILED(env, status, NULL);
+  // [1] Options
+  sub->batch_max_size = 0;
+  sub->batch_max_latency = 0;
+  sub->queue_capacity = EVENT_RING_DEFAULT_CAPACITY;
+  sub->queue_overflow = EVENT_RING_DROP_NEWEST;
+  sub->queue_block_timeout = 0;
+  sub->coalesce_window = 0;
+  uint32_t coalesce_wheel_opt = 0;
+  uint32_t stats_opt = 0;
+  uint32_t aggregate_opt = 0;
+  uint32_t drop_key_repeat_opt = 0;
+  if (info_argc > 1) {
+    status = object_get_uint32(env, info_argv[1], "batchMaxSize", &sub->batch_max_size);
+    NAPI_THROW_IF_FAILED(env, status, false);
+    status = object_get_uint32(env, info_argv[1], "batchMaxLatency", &sub->batch_max_latency);
+    NAPI_THROW_IF_FAILED(env, status, false);
+    status = object_get_uint32(env, info_argv[1], "queueSize", &sub->queue_capacity);
+    NAPI_THROW_IF_FAILED(env, status, false);
+    status = object_get_uint32(env, info_argv[1], "queueOverflow", (uint32_t*)&sub->queue_overflow);
+    NAPI_THROW_IF_FAILED(env, status, false);
+    status = object_get_uint32(env, info_argv[1], "queueBlockTimeout", &sub->queue_block_timeout);
+    NAPI_THROW_IF_FAILED(env, status, false);
+    status = object_get_uint32(env, info_argv[1], "coalesceWindow", &sub->coalesce_window);
+    NAPI_THROW_IF_FAILED(env, status, false);
+    status = object_get_uint32(env, info_argv[1], "coalesceWheel", &coalesce_wheel_opt);
+    NAPI_THROW_IF_FAILED(env, status, false);
+    status = object_get_uint32(env, info_argv[1], "stats", &stats_opt);
+    NAPI_THROW_IF_FAILED(env, status, false);
+    status = object_get_uint32(env, info_argv[1], "aggregate", &aggregate_opt);
+    NAPI_THROW_IF_FAILED(env, status, false);
+    status = object_get_uint32(env, info_argv[1], "dropKeyRepeat", &drop_key_repeat_opt);
+    NAPI_THROW_IF_FAILED(env, status, false);
+  }
+  sub->drop_key_repeat = drop_key_repeat_opt != 0;
+  sub->coalesce_wheel = coalesce_wheel_opt != 0;
+  sub->stats_enabled = stats_opt != 0;
+  if (sub->stats_enabled) {
+    stats_reset(sub);
+  }
+  if (sub->coalesce_window > BATCH_MAX_LATENCY_LIMIT && sub->coalesce_window != EVENT_RING_COALESCE_UNTIL_DRAIN) {
+    NAPI_THROW(env, "ERR_OUT_OF_RANGE", "Coalescing window must not exceed 1000 ms.", false);
+  }
+  if (sub->queue_overflow > EVENT_RING_BLOCK) {
+    NAPI_THROW(env, "ERR_OUT_OF_RANGE", "Unknown queue overflow policy.", false);
+  }
+  if (sub->queue_block_timeout > BATCH_MAX_LATENCY_LIMIT) {
+    NAPI_THROW(env, "ERR_OUT_OF_RANGE", "Queue block timeout must not exceed 1000 ms.", false);
+  }
+  if (sub->batch_max_size == 0) {
+    sub->batch_max_latency = 0;
+  }
+  else if (sub->batch_max_latency > BATCH_MAX_LATENCY_LIMIT) {
+    NAPI_THROW(env, "ERR_OUT_OF_RANGE", "Batch latency must not exceed 1000 ms.", false);
+  }
 
-  status = napi_create_threadsafe_function(env, cb, NULL, async_resource_name, 0, 1, NULL, NULL, NULL, tsfn_to_js_proxy, &threadsafe_fn);
-  NAPI_THROW_IF_FAILED(env, status, NULL);
+  napi_value stream_array = NULL;
+  if (info_argc > 1) {
+    bool has_stream;
+    status = napi_has_named_property(env, info_argv[1], "stream", &has_stream);
+    NAPI_THROW_IF_FAILED(env, status, false);
+    if (has_stream) {
+      status = napi_get_named_property(env, info_argv[1], "stream", &stream_array);
+      NAPI_THROW_IF_FAILED(env, status, false);
+    }
+  }
+
+  if (stream_array == NULL && aggregate_opt == 0 && sub->event_class_refs[0] == NULL) {
+    NAPI_THROW(env, "ERR_INVALID_STATE", "Event classes are not registered.", false);
+  }
 
-  int worker_status = uiohook_worker_start(dispatch_proc);
+  sub->paused = false;
 
-  if (worker_status != UIOHOOK_SUCCESS) {
-    napi_release_threadsafe_function(threadsafe_fn, napi_tsfn_release);
-    threadsafe_fn = NULL;
+  if (aggregate_opt != 0) {
+    activity_reset(&sub->activity);
+    sub->activity_taken = uv_hrtime();
+    sub->activity_enabled = true;
+    *worker_status = UIOHOOK_SUCCESS;
   }
+  else if (stream_array != NULL) {
+    napi_typedarray_type array_type;
+    size_t array_length;
+    void* array_data;
+    status = napi_get_typedarray_info(env, stream_array, &array_type, &array_length, &array_data, NULL, NULL);
+    NAPI_THROW_IF_FAILED(env, status, false);
 
-  switch (worker_status) {
-  case UIOHOOK_SUCCESS: {
-    is_worker_running = true;
-    return NULL;
+    if (array_type != napi_int32_array || event_stream_init(&sub->stream, array_data, array_length) != 0) {
+      NAPI_THROW(env, "ERR_INVALID_ARG_VALUE", "Invalid event stream buffer.", false);
+    }
+
+    // Keep the buffer alive while the hook thread writes into it.
+    status = napi_create_reference(env, stream_array, 1, &sub->stream_ref);
+    NAPI_THROW_IF_FAILED(env, status, false);
+
+    *worker_status = UIOHOOK_SUCCESS;
+  }
+  else {
+    napi_value async_resource_name;
+    status = napi_create_string_utf8(env, "UIOHOOK_NAPI", NAPI_AUTO_LENGTH, &async_resource_name);
+    NAPI_THROW_IF_FAILED(env, status, false);
+
+    status = napi_create_threadsafe_function(env, cb, NULL, async_resource_name, 0, 1, NULL, NULL, sub, tsfn_to_js_proxy, &sub->threadsafe_fn);
+    NAPI_THROW_IF_FAILED(env, status, false);
+
+    *worker_status = queue_start(sub);
   }
+  return true;
+}
+
+// Error code and message for a failed hook start or stop.
+const char* hook_error_code(int worker_status, const char** message) {
+  switch (worker_status) {
   case UIOHOOK_ERROR_THREAD_CREATE:
-    NAPI_THROW(env, "UIOHOOK_ERROR_THREAD_CREATE", "Failed to create worker thread.", NULL);
+    *message = "Failed to create worker thread.";
+    return "UIOHOOK_ERROR_THREAD_CREATE";
   case UIOHOOK_ERROR_OUT_OF_MEMORY:
-    NAPI_THROW(env, "UIOHOOK_ERROR_OUT_OF_MEMORY", "Failed to allocate memory.", NULL);
+    *message = "Failed to allocate memory.";
+    return "UIOHOOK_ERROR_OUT_OF_MEMORY";
   case UIOHOOK_ERROR_X_OPEN_DISPLAY:
-    NAPI_THROW(env, "UIOHOOK_ERROR_X_OPEN_DISPLAY", "Failed to open X11 display.", NULL);
+    *message = "Failed to open X11 display.";
+    return "UIOHOOK_ERROR_X_OPEN_DISPLAY";
   case UIOHOOK_ERROR_X_RECORD_NOT_FOUND:
-    NAPI_THROW(env, "UIOHOOK_ERROR_X_RECORD_NOT_FOUND", "Unable to locate XRecord extension.", NULL);
+    *message = "Unable to locate XRecord extension.";
+    return "UIOHOOK_ERROR_X_RECORD_NOT_FOUND";
   case UIOHOOK_ERROR_X_RECORD_ALLOC_RANGE:
-    NAPI_THROW(env, "UIOHOOK_ERROR_X_RECORD_ALLOC_RANGE", "Unable to allocate XRecord range.", NULL);
+    *message = "Unable to allocate XRecord range.";
+    return "UIOHOOK_ERROR_X_RECORD_ALLOC_RANGE";
   case UIOHOOK_ERROR_X_RECORD_CREATE_CONTEXT:
-    NAPI_THROW(env, "UIOHOOK_ERROR_X_RECORD_CREATE_CONTEXT", "Unable to allocate XRecord context.", NULL);
+    *message = "Unable to allocate XRecord context.";
+    return "UIOHOOK_ERROR_X_RECORD_CREATE_CONTEXT";
   case UIOHOOK_ERROR_X_RECORD_ENABLE_CONTEXT:
-    NAPI_THROW(env, "UIOHOOK_ERROR_X_RECORD_ENABLE_CONTEXT", "Failed to enable XRecord context.", NULL);
+    *message = "Failed to enable XRecord context.";
+    return "UIOHOOK_ERROR_X_RECORD_ENABLE_CONTEXT";
+  case UIOHOOK_ERROR_X_RECORD_GET_CONTEXT:
+    *message = "Failed to get XRecord context.";
+    return "UIOHOOK_ERROR_X_RECORD_GET_CONTEXT";
   case UIOHOOK_ERROR_SET_WINDOWS_HOOK_EX:
-    NAPI_THROW(env, "UIOHOOK_ERROR_SET_WINDOWS_HOOK_EX", "Failed to register low level windows hook.", NULL);
+    *message = "Failed to register low level windows hook.";
+    return "UIOHOOK_ERROR_SET_WINDOWS_HOOK_EX";
   case UIOHOOK_ERROR_AXAPI_DISABLED:
-    NAPI_THROW(env, "UIOHOOK_ERROR_AXAPI_DISABLED", "Failed to enable access for assistive devices.", NULL);
+    *message = "Failed to enable access for assistive devices.";
+    return "UIOHOOK_ERROR_AXAPI_DISABLED";
   case UIOHOOK_ERROR_CREATE_EVENT_PORT:
-    NAPI_THROW(env, "UIOHOOK_ERROR_CREATE_EVENT_PORT", "Failed to create apple event port.", NULL);
+    *message = "Failed to create apple event port.";
+    return "UIOHOOK_ERROR_CREATE_EVENT_PORT";
   case UIOHOOK_ERROR_CREATE_RUN_LOOP_SOURCE:
-    NAPI_THROW(env, "UIOHOOK_ERROR_CREATE_RUN_LOOP_SOURCE", "Failed to create apple run loop source.", NULL);
+    *message = "Failed to create apple run loop source.";
+    return "UIOHOOK_ERROR_CREATE_RUN_LOOP_SOURCE";
   case UIOHOOK_ERROR_GET_RUNLOOP:
-    NAPI_THROW(env, "UIOHOOK_ERROR_GET_RUNLOOP", "Failed to acquire apple run loop.", NULL);
+    *message = "Failed to acquire apple run loop.";
+    return "UIOHOOK_ERROR_GET_RUNLOOP";
   case UIOHOOK_ERROR_CREATE_OBSERVER:
-    NAPI_THROW(env, "UIOHOOK_ERROR_CREATE_OBSERVER", "Failed to create apple run loop observer.", NULL);
+    *message = "Failed to create apple run loop observer.";
+    return "UIOHOOK_ERROR_CREATE_OBSERVER";
   case UIOHOOK_FAILURE:
   default:
-    NAPI_THROW(env, "UIOHOOK_FAILURE", "An unknown hook error occurred.", NULL);
+    *message = "An unknown hook error occurred.";
+    return "UIOHOOK_FAILURE";
   }
 }
 
-napi_value AddonStop(napi_env env, napi_callback_info info) {
-  if (is_worker_running == false)
+napi_value AddonStart(napi_env env, napi_callback_info info) {
+  subscriber* sub = subscriber_get(env);
+  if (sub->is_subscribed == true)
     return NULL;
+  if (sub->start_job != NULL)
+    NAPI_THROW(env, "ERR_INVALID_STATE", "The hook is already starting.", NULL);
 
-  int status = uiohook_worker_stop();
+  size_t info_argc = 2;
+  napi_value info_argv[2];
+  napi_status status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
 
-  switch (status) {
-  case UIOHOOK_SUCCESS: {
-    is_worker_running = false;
-    napi_release_threadsafe_function(threadsafe_fn, napi_tsfn_release);
-    threadsafe_fn = NULL;
+  int worker_status;
+  if (!start_prepare(env, sub, info_argc, info_argv, &worker_status))
     return NULL;
+  if (worker_status == UIOHOOK_SUCCESS) {
+    worker_status = subscriber_join(sub, NULL);
   }
-  case UIOHOOK_ERROR_OUT_OF_MEMORY:
-    NAPI_THROW(env, "UIOHOOK_ERROR_OUT_OF_MEMORY", "Failed to allocate memory.", NULL);
-  case UIOHOOK_ERROR_X_RECORD_GET_CONTEXT:
-    NAPI_THROW(env, "UIOHOOK_ERROR_X_RECORD_GET_CONTEXT", "Failed to get XRecord context.", NULL);
-  case UIOHOOK_FAILURE:
-  default:
-    NAPI_THROW(env, "UIOHOOK_FAILURE", "An unknown hook error occurred.", NULL);
+
+  if (worker_status == UIOHOOK_SUCCESS) {
+    sub->is_subscribed = true;
+    return NULL;
   }
+  addon_release(env, sub);
+
+  const char* message;
+  const char* code = hook_error_code(worker_status, &message);
+  NAPI_THROW(env, code, message, NULL);
 }
 
-void AddonCleanUp (void* arg) {
-  if (is_worker_running) {
-    uiohook_worker_stop();
+typedef struct start_job {
+  napi_async_work work;
+  napi_deferred deferred;
+  subscriber* sub;
+  int worker_status;
+  uv_sem_t joined; // posted when start_execute is done
+  bool cancelled; // stop() was called, JS thread only
+  bool abandoned; // the environment is being torn down, JS thread only
+  // uv_hrtime()
+  uint64_t called;
+  uint64_t prepared;
+  uint64_t executed;
+  worker_start_times worker;
+} start_job;
+
+napi_value AddonStop(napi_env env, napi_callback_info info) {
+  subscriber* sub = subscriber_get(env);
+  if (sub->start_job != NULL) {
+    // Can't interrupt the hook thread setup, start_complete leaves instead.
+    sub->start_job->cancelled = true;
+    return NULL;
+  }
+  if (sub->is_subscribed == false)
+    return NULL;
+
+  int status = subscriber_leave(sub);
+  if (status == UIOHOOK_SUCCESS) {
+    sub->is_subscribed = false;
+    addon_release(env, sub);
+    return NULL;
   }
+
+  const char* message;
+  const char* code = hook_error_code(status, &message);
+  NAPI_THROW(env, code, message, NULL);
 }
 
-typedef enum {
-  key_tap,
-  key_down,
-  key_up,
-  force_uint = 0xFFFFFFFF
-} key_tap_type;
+// Runs on a libuv pool thread, the JS thread is free while the hook starts.
+void start_execute(napi_env env, void* data) {
+  start_job* job = data;
+  job->executed = uv_hrtime();
+  job->worker_status = subscriber_join(job->sub, &job->worker);
+  uv_sem_post(&job->joined);
+}
 
-napi_value AddonKeyTap (napi_env env, napi_callback_info info) {
-  napi_status status;
+double hrtime_span_ms(uint64_t from, uint64_t to) {
+  return (from != 0 && to > from) ? (double)(to - from) / 1e6 : 0;
+}
 
-  size_t info_argc = 2;
-  napi_value info_argv[2];
-  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
-  NAPI_THROW_IF_FAILED(env, status, NULL);
+// Returns NULL if JS can't run anymore.
+napi_value start_timings_to_js(napi_env env, const start_job* job, uint64_t settled) {
+  const worker_start_times* worker = &job->worker;
 
-  // [0] KeyCode
-  uint32_t keycode;
-  status = napi_get_value_uint32(env, info_argv[0], &keycode);
-  NAPI_THROW_IF_FAILED(env, status, NULL);
+  napi_value result;
+  if (napi_create_object(env, &result) != napi_ok)
+    return NULL;
 
-  // [1] KeyTapType
-  key_tap_type tap_type;
-  status = napi_get_value_uint32(env, info_argv[1], (int32_t*)&tap_type);
-  NAPI_THROW_IF_FAILED(env, status, NULL);
+  napi_value e_hook_started;
+  if (napi_get_boolean(env, worker->thread_create != 0, &e_hook_started) != napi_ok ||
+      napi_set_named_property(env, result, "hookStarted", e_hook_started) != napi_ok)
+    return NULL;
 
-  uiohook_event event;
-  memset(&event, 0, sizeof(event));
-  event.data.keyboard.keycode = keycode;
+  // The hook setup phase ends early if the hook failed to install.
+  uint64_t hook_ready = worker->hook_enabled ? worker->hook_enabled : worker->returned;
 
-  if (tap_type != key_up) {
-    event.type = EVENT_KEY_PRESSED;
-    hook_post_event(&event);
+  struct {
+    const char* name;
+    double value;
+  } fields[] = {
+    { "prepare",      hrtime_span_ms(job->called, job->prepared) },
+    { "queued",       hrtime_span_ms(job->prepared, job->executed) },
+    { "threadCreate", hrtime_span_ms(worker->thread_create, worker->thread_started) },
+    { "threadSetup",  hrtime_span_ms(worker->thread_started, worker->hook_run) },
+    { "hookSetup",    hrtime_span_ms(worker->hook_run, hook_ready) },
+    { "total",        hrtime_span_ms(job->called, settled) },
+  };
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    napi_value value;
+    if (napi_create_double(env, fields[i].value, &value) != napi_ok ||
+        napi_set_named_property(env, result, fields[i].name, value) != napi_ok)
+      return NULL;
   }
-  if (tap_type != key_down) {
-    event.type = EVENT_KEY_RELEASED;
-    hook_post_event(&event);
+  return result;
+}
+
+void start_settle(napi_env env, start_job* job, int worker_status, uint64_t settled) {
+  napi_value timings = start_timings_to_js(env, job, settled);
+  if (timings == NULL) return;
+
+  if (worker_status == UIOHOOK_SUCCESS && !job->cancelled) {
+    napi_resolve_deferred(env, job->deferred, timings);
+    return;
   }
 
-  return NULL;
-}
+  const char* code;
+  const char* message;
+  if (worker_status == UIOHOOK_SUCCESS) {
+    code = "ABORT_ERR";
+    message = "The hook was stopped before it started.";
+  }
+  else {
+    code = hook_error_code(worker_status, &message);
+  }
 
-NAPI_MODULE_INIT() {
-  napi_status status;
-  napi_value export_fn;
+  napi_value e_code, e_message, error;
+  if (napi_create_string_utf8(env, code, NAPI_AUTO_LENGTH, &e_code) != napi_ok ||
+      napi_create_string_utf8(env, message, NAPI_AUTO_LENGTH, &e_message) != napi_ok ||
+      napi_create_error(env, e_code, e_message, &error) != napi_ok ||
+      napi_set_named_property(env, error, "timings", timings) != napi_ok)
+    return;
+  napi_reject_deferred(env, job->deferred, error);
+}
 
-  status = napi_create_function(env, NULL, 0, AddonStart, NULL, &export_fn);
-  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
-  status = napi_set_named_property(env, exports, "start", export_fn);
-  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+void start_complete(napi_env env, napi_status status, void* data) {
+  start_job* job = data;
+  subscriber* sub = job->sub;
+  uint64_t settled = uv_hrtime();
 
-  status = napi_create_function(env, NULL, 0, AddonStop, NULL, &export_fn);
-  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
-  status = napi_set_named_property(env, exports, "stop", export_fn);
-  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+  napi_delete_async_work(env, job->work);
+  uv_sem_destroy(&job->joined);
+  // AddonCleanUp already took care of the subscriber
+  if (job->abandoned) {
+    free(job);
+    return;
+  }
+  sub->start_job = NULL;
 
-  status = napi_create_function(env, NULL, 0, AddonKeyTap, NULL, &export_fn);
+  int worker_status = job->worker_status;
+  if (worker_status == UIOHOOK_SUCCESS && job->cancelled) {
+    worker_status = subscriber_leave(sub);
+    if (worker_status == UIOHOOK_SUCCESS) {
+      addon_release(env, sub);
+    }
+    else {
+      // Still joined, same as a failed stop()
+      sub->is_subscribed = true;
+    }
+  }
+  else if (worker_status == UIOHOOK_SUCCESS) {
+    sub->is_subscribed = true;
+    // Drains skipped while the start was pending would leave events queued.
+    if (sub->threadsafe_fn != NULL) {
+      atomic_store_u32(&sub->drain_state, drain_scheduled);
+      drain_call(sub);
+    }
+  }
+  else {
+    addon_release(env, sub);
+  }
+
+  // Also called while a worker_thread is terminating, JS can't run then
+  // and AddonCleanUp leaves afterwards.
+  start_settle(env, job, worker_status, settled);
+  free(job);
+}
+
+// Same as AddonStart, but the hook is started on a libuv pool thread and
+// the returned promise settles when it is enabled.
+napi_value AddonStartAsync(napi_env env, napi_callback_info info) {
+  uint64_t called = uv_hrtime();
+  subscriber* sub = subscriber_get(env);
+  if (sub->is_subscribed == true)
+    NAPI_THROW(env, "ERR_INVALID_STATE", "The hook is already started.", NULL);
+  if (sub->start_job != NULL)
+    NAPI_THROW(env, "ERR_INVALID_STATE", "The hook is already starting.", NULL);
+
+  size_t info_argc = 2;
+  napi_value info_argv[2];
+  napi_status status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  start_job* job = calloc(1, sizeof(start_job));
+  if (job == NULL || uv_sem_init(&job->joined, 0) != 0) {
+    free(job);
+    NAPI_THROW(env, "UIOHOOK_ERROR_OUT_OF_MEMORY", "Failed to allocate memory.", NULL);
+  }
+  job->sub = sub;
+  job->called = called;
+
+  int worker_status;
+  if (!start_prepare(env, sub, info_argc, info_argv, &worker_status)) {
+    uv_sem_destroy(&job->joined);
+    free(job);
+    return NULL;
+  }
+  if (worker_status != UIOHOOK_SUCCESS) {
+    addon_release(env, sub);
+    uv_sem_destroy(&job->joined);
+    free(job);
+
+    const char* message;
+    const char* code = hook_error_code(worker_status, &message);
+    NAPI_THROW(env, code, message, NULL);
+  }
+  job->prepared = uv_hrtime();
+
+  napi_value promise;
+  status = napi_create_promise(env, &job->deferred, &promise);
+  NAPI_FATAL_IF_FAILED(status, "AddonStartAsync", "napi_create_promise");
+
+  napi_value async_resource_name;
+  status = napi_create_string_utf8(env, "UIOHOOK_NAPI_START", NAPI_AUTO_LENGTH, &async_resource_name);
+  NAPI_FATAL_IF_FAILED(status, "AddonStartAsync", "napi_create_string_utf8");
+
+  status = napi_create_async_work(env, NULL, async_resource_name, start_execute, start_complete, job, &job->work);
+  NAPI_FATAL_IF_FAILED(status, "AddonStartAsync", "napi_create_async_work");
+  status = napi_queue_async_work(env, job->work);
+  NAPI_FATAL_IF_FAILED(status, "AddonStartAsync", "napi_queue_async_work");
+
+  sub->start_job = job;
+  return promise;
+}
+
+typedef struct {
+  bool idle;
+  uint32_t threshold;
+  uint64_t idle_time;
+} idle_transition;
+
+void idle_to_js_proxy(napi_env env, napi_value js_cb, void* context, void* data) {
+  idle_transition* transition = data;
+
+  // The environment is being torn down
+  if (env == NULL) {
+    free(transition);
+    return;
+  }
+
+  napi_value argv[3];
+  napi_status status = napi_get_boolean(env, transition->idle, &argv[0]);
+  NAPI_FATAL_IF_FAILED(status, "idle_to_js_proxy", "napi_get_boolean");
+  status = napi_create_uint32(env, transition->threshold, &argv[1]);
+  NAPI_FATAL_IF_FAILED(status, "idle_to_js_proxy", "napi_create_uint32");
+  status = napi_create_double(env, (double)transition->idle_time, &argv[2]);
+  NAPI_FATAL_IF_FAILED(status, "idle_to_js_proxy", "napi_create_double");
+  free(transition);
+
+  napi_value global;
+  status = napi_get_global(env, &global);
+  NAPI_FATAL_IF_FAILED(status, "idle_to_js_proxy", "napi_get_global");
+
+  status = napi_call_function(env, global, js_cb, 3, argv, NULL);
+  NAPI_FATAL_IF_FAILED(status, "idle_to_js_proxy", "napi_call_function");
+}
+
+// Called on the idle detector thread.
+void idle_transition_proc(void* data, bool idle, uint32_t threshold, uint64_t idle_time) {
+  subscriber* sub = data;
+
+  idle_transition* transition = malloc(sizeof(idle_transition));
+  if (transition == NULL) return;
+  transition->idle = idle;
+  transition->threshold = threshold;
+  transition->idle_time = idle_time;
+
+  if (napi_call_threadsafe_function(sub->idle_fn, transition, napi_tsfn_nonblocking) != napi_ok) {
+    free(transition);
+  }
+}
+
+// `release` is false when the environment is torn down, its threadsafe
+// functions are finalized anyway.
+void idle_stop(subscriber* sub, bool release) {
+  idle_detector* idle = atomic_exchange_ptr((void* volatile*)&sub->idle, NULL);
+  if (idle == NULL) return;
+
+  subscribers_sync();
+  idle_detector_stop(idle);
+  free(idle);
+
+  if (release) {
+    napi_release_threadsafe_function(sub->idle_fn, napi_tsfn_release);
+  }
+  sub->idle_fn = NULL;
+}
+
+// `release` is false when the environment is torn down, references are
+// deleted with it.
+void heatmap_stop(subscriber* sub, bool release) {
+  heatmap* map = atomic_exchange_ptr((void* volatile*)&sub->heatmap, NULL);
+  if (map == NULL) return;
+
+  subscribers_sync();
+  free(map);
+
+  if (release) {
+    napi_delete_reference(sub->env, sub->heatmap_ref);
+  }
+  sub->heatmap_ref = NULL;
+}
+
+// Returns the closed recorder, or NULL if `sub` isn't recording.
+recorder* recording_stop(subscriber* sub) {
+  uv_mutex_lock(&subscribers_mutex);
+  recorder* rec = NULL;
+  if (recorder_owner == sub) {
+    rec = atomic_exchange_ptr((void* volatile*)&active_recorder, NULL);
+    recorder_owner = NULL;
+    subscribers_sync();
+  }
+  uv_mutex_unlock(&subscribers_mutex);
+
+  if (rec != NULL && recorder_close(rec) != recorder_ok) {
+    rec->write_failed = true;
+  }
+  return rec;
+}
+
+typedef struct {
+  uint32_t level;
+  uint32_t length;
+  char text[];
+} log_message;
+
+void log_to_js_proxy(napi_env env, napi_value js_cb, void* context, void* data) {
+  log_message* message = data;
+
+  // The environment is being torn down
+  if (env == NULL) {
+    free(message);
+    return;
+  }
+
+  // libuiohook ends its messages with a newline
+  uint32_t length = message->length;
+  if (length > 0 && message->text[length - 1] == '\n') {
+    length--;
+  }
+
+  napi_value argv[2];
+  napi_status status = napi_create_uint32(env, message->level, &argv[0]);
+  NAPI_FATAL_IF_FAILED(status, "log_to_js_proxy", "napi_create_uint32");
+  status = napi_create_string_utf8(env, message->text, length, &argv[1]);
+  NAPI_FATAL_IF_FAILED(status, "log_to_js_proxy", "napi_create_string_utf8");
+  free(message);
+
+  napi_value global;
+  status = napi_get_global(env, &global);
+  NAPI_FATAL_IF_FAILED(status, "log_to_js_proxy", "napi_get_global");
+
+  status = napi_call_function(env, global, js_cb, 2, argv, NULL);
+  NAPI_FATAL_IF_FAILED(status, "log_to_js_proxy", "napi_call_function");
+}
+
+// Called on the log drain thread.
+bool log_sink_proc(void* data, uint32_t level, const char* text, uint32_t length) {
+  log_message* message = malloc(sizeof(log_message) + length);
+  if (message == NULL) return false;
+  message->level = level;
+  message->length = length;
+  memcpy(message->text, text, length);
+
+  if (napi_call_threadsafe_function(data, message, napi_tsfn_nonblocking) != napi_ok) {
+    free(message);
+    return false;
+  }
+  return true;
+}
+
+// Messages go back to stderr if `sub` set the handler. `release` is false
+// when the environment is torn down, its threadsafe functions are
+// finalized anyway.
+void log_handler_stop(subscriber* sub, bool release) {
+  uv_mutex_lock(&subscribers_mutex);
+  napi_threadsafe_function fn = NULL;
+  if (log_handler_owner == sub) {
+    log_ring_set_sink(NULL, NULL);
+    fn = log_handler_fn;
+    log_handler_fn = NULL;
+    log_handler_owner = NULL;
+  }
+  uv_mutex_unlock(&subscribers_mutex);
+
+  if (fn != NULL && release) {
+    napi_release_threadsafe_function(fn, napi_tsfn_release);
+  }
+}
+
+// The environment is being torn down (process exit or a worker_thread
+// terminating), other environments keep receiving events.
+void AddonCleanUp (void* arg) {
+  subscriber* sub = arg;
+  injector_cancel_owner(sub);
+  idle_stop(sub, false);
+  heatmap_stop(sub, false);
+  free(recording_stop(sub));
+  log_handler_stop(sub, false);
+  log_ring_flush();
+  if (sub->start_job != NULL) {
+    // Wait for the pending start to finish joining and leave below.
+    start_job* job = sub->start_job;
+    uv_sem_wait(&job->joined);
+    if (job->worker_status == UIOHOOK_SUCCESS) {
+      sub->is_subscribed = true;
+    }
+    else if (sub->stream_ref == NULL && !sub->activity_enabled) {
+      queue_stop(sub);
+    }
+    job->abandoned = true;
+    sub->start_job = NULL;
+  }
+  if (sub->is_subscribed) {
+    subscriber_leave(sub);
+    sub->is_subscribed = false;
+    if (sub->stream_ref == NULL && !sub->activity_enabled) {
+      queue_stop(sub);
+    }
+  }
+}
+
+void subscriber_finalize(napi_env env, void* data, void* hint) {
+  subscriber* sub = data;
+  hotkeys_destroy(&sub->hotkeys);
+  sequences_destroy(&sub->sequences);
+  regions_destroy(&sub->regions);
+  free(sub);
+}
+
+typedef enum {
+  key_tap,
+  key_down,
+  key_up,
+  force_uint = 0xFFFFFFFF
+} key_tap_type;
+
+napi_value AddonKeyTap (napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 2;
+  napi_value info_argv[2];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] KeyCode
+  uint32_t keycode;
+  status = napi_get_value_uint32(env, info_argv[0], &keycode);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [1] KeyTapType
+  key_tap_type tap_type;
+  status = napi_get_value_uint32(env, info_argv[1], (int32_t*)&tap_type);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  uiohook_event event;
+  memset(&event, 0, sizeof(event));
+  event.data.keyboard.keycode = keycode;
+
+  if (tap_type != key_up) {
+    event.type = EVENT_KEY_PRESSED;
+    injector_post(&event);
+  }
+  if (tap_type != key_down) {
+    event.type = EVENT_KEY_RELEASED;
+    injector_post(&event);
+  }
+
+  return NULL;
+}
+
+// Reads `count` int32 arguments into `args`.
+napi_status get_int32_args(napi_env env, napi_callback_info info, int32_t* args, size_t count) {
+  napi_status status;
+
+  size_t info_argc = 4;
+  napi_value info_argv[4];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  if (status != napi_ok) return status;
+
+  for (size_t i = 0; i < count; i++) {
+    status = napi_get_value_int32(env, info_argv[i], &args[i]);
+    if (status != napi_ok) return status;
+  }
+  return napi_ok;
+}
+
+napi_value AddonMouseTap (napi_env env, napi_callback_info info) {
+  // [0] X, [1] Y, [2] Button, [3] KeyTapType
+  int32_t args[4];
+  napi_status status = get_int32_args(env, info, args, 4);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  key_tap_type tap_type = (key_tap_type)args[3];
+
+  uiohook_event event;
+  memset(&event, 0, sizeof(event));
+  event.data.mouse.x = (int16_t)args[0];
+  event.data.mouse.y = (int16_t)args[1];
+  event.data.mouse.button = (uint16_t)args[2];
+
+  if (tap_type != key_up) {
+    event.type = EVENT_MOUSE_PRESSED;
+    injector_post(&event);
+  }
+  if (tap_type != key_down) {
+    event.type = EVENT_MOUSE_RELEASED;
+    injector_post(&event);
+  }
+
+  return NULL;
+}
+
+napi_value AddonMouseMove (napi_env env, napi_callback_info info) {
+  // [0] X, [1] Y
+  int32_t args[2];
+  napi_status status = get_int32_args(env, info, args, 2);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  uiohook_event event;
+  memset(&event, 0, sizeof(event));
+  event.type = EVENT_MOUSE_MOVED;
+  event.data.mouse.x = (int16_t)args[0];
+  event.data.mouse.y = (int16_t)args[1];
+  injector_post(&event);
+
+  return NULL;
+}
+
+napi_value AddonMouseWheel (napi_env env, napi_callback_info info) {
+  // [0] X, [1] Y, [2] Rotation, [3] WheelDirection
+  int32_t args[4];
+  napi_status status = get_int32_args(env, info, args, 4);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  uiohook_event event;
+  memset(&event, 0, sizeof(event));
+  event.type = EVENT_MOUSE_WHEEL;
+  event.data.wheel.x = (int16_t)args[0];
+  event.data.wheel.y = (int16_t)args[1];
+  event.data.wheel.type = WHEEL_UNIT_SCROLL;
+  event.data.wheel.amount = 1;
+  event.data.wheel.rotation = (int16_t)args[2];
+  event.data.wheel.direction = (uint8_t)args[3];
+  injector_post(&event);
+
+  return NULL;
+}
+
+typedef struct {
+  napi_threadsafe_function threadsafe_fn;
+  napi_deferred deferred;
+  bool completed;
+} inject_request;
+
+// Resolves the promise of a sequence on the JS thread.
+void inject_to_js_proxy(napi_env env, napi_value js_cb, void* context, void* data) {
+  inject_request* request = data;
+
+  // The environment is being torn down
+  if (env == NULL) {
+    free(request);
+    return;
+  }
+
+  napi_value result;
+  napi_status status = napi_get_boolean(env, request->completed, &result);
+  NAPI_FATAL_IF_FAILED(status, "inject_to_js_proxy", "napi_get_boolean");
+  status = napi_resolve_deferred(env, request->deferred, result);
+  NAPI_FATAL_IF_FAILED(status, "inject_to_js_proxy", "napi_resolve_deferred");
+  free(request);
+}
+
+void inject_done(void* data, bool completed) {
+  inject_request* request = data;
+  request->completed = completed;
+
+  napi_threadsafe_function threadsafe_fn = request->threadsafe_fn;
+  if (napi_call_threadsafe_function(threadsafe_fn, request, napi_tsfn_blocking) != napi_ok) {
+    free(request);
+  }
+  napi_release_threadsafe_function(threadsafe_fn, napi_tsfn_release);
+}
+
+// Queues injector steps and returns a promise that resolves with false
+// if the sequence was cancelled.
+napi_value inject_submit(napi_env env, injector_step* steps, uint32_t count, uint32_t id) {
+  napi_status status;
+
+  inject_request* request = calloc(1, sizeof(inject_request));
+  if (request == NULL) {
+    injector_steps_free(steps, count);
+    NAPI_THROW(env, "UIOHOOK_ERROR_OUT_OF_MEMORY", "Failed to allocate memory.", NULL);
+  }
+
+  napi_value promise;
+  status = napi_create_promise(env, &request->deferred, &promise);
+  NAPI_FATAL_IF_FAILED(status, "inject_submit", "napi_create_promise");
+
+  napi_value async_resource_name;
+  status = napi_create_string_utf8(env, "UIOHOOK_NAPI_INJECT", NAPI_AUTO_LENGTH, &async_resource_name);
+  NAPI_FATAL_IF_FAILED(status, "inject_submit", "napi_create_string_utf8");
+
+  // Keeps the event loop alive until the sequence is done.
+  status = napi_create_threadsafe_function(env, NULL, NULL, async_resource_name, 0, 1, NULL, NULL, NULL, inject_to_js_proxy, &request->threadsafe_fn);
+  NAPI_FATAL_IF_FAILED(status, "inject_submit", "napi_create_threadsafe_function");
+
+  int inject_status = injector_submit(steps, count, subscriber_get(env), id, inject_done, request);
+  if (inject_status != UIOHOOK_SUCCESS) {
+    napi_release_threadsafe_function(request->threadsafe_fn, napi_tsfn_abort);
+    injector_steps_free(steps, count);
+    free(request);
+  }
+
+  switch (inject_status) {
+  case UIOHOOK_SUCCESS:
+    return promise;
+  case UIOHOOK_ERROR_THREAD_CREATE:
+    NAPI_THROW(env, "UIOHOOK_ERROR_THREAD_CREATE", "Failed to create injector thread.", NULL);
+  case UIOHOOK_ERROR_OUT_OF_MEMORY:
+  default:
+    NAPI_THROW(env, "UIOHOOK_ERROR_OUT_OF_MEMORY", "Failed to allocate memory.", NULL);
+  }
+}
+
+napi_value AddonInjectKeys (napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 2;
+  napi_value info_argv[2];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Steps, Uint32Array of [keycode, KeyTapType, delay after in ms...]
+  napi_typedarray_type array_type;
+  size_t array_length;
+  void* array_data;
+  status = napi_get_typedarray_info(env, info_argv[0], &array_type, &array_length, &array_data, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [1] Id
+  uint32_t id;
+  status = napi_get_value_uint32(env, info_argv[1], &id);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  const uint32_t* data = array_data;
+  if (array_type != napi_uint32_array || array_length % 3 != 0) {
+    NAPI_THROW(env, "ERR_INVALID_ARG_VALUE", "Invalid key sequence.", NULL);
+  }
+  for (size_t i = 0; i < array_length; i += 3) {
+    if (data[i + 1] > key_up) {
+      NAPI_THROW(env, "ERR_INVALID_ARG_VALUE", "Invalid key sequence.", NULL);
+    }
+  }
+
+  // Every tap becomes two steps.
+  injector_step* steps = calloc(array_length / 3 * 2 + 1, sizeof(injector_step));
+  if (steps == NULL) {
+    NAPI_THROW(env, "UIOHOOK_ERROR_OUT_OF_MEMORY", "Failed to allocate memory.", NULL);
+  }
+
+  uint32_t count = 0;
+  for (size_t i = 0; i < array_length; i += 3) {
+    key_tap_type tap_type = data[i + 1];
+    if (tap_type != key_up) {
+      steps[count].event.type = EVENT_KEY_PRESSED;
+      steps[count].event.data.keyboard.keycode = (uint16_t)data[i];
+      count++;
+    }
+    if (tap_type != key_down) {
+      steps[count].event.type = EVENT_KEY_RELEASED;
+      steps[count].event.data.keyboard.keycode = (uint16_t)data[i];
+      count++;
+    }
+    steps[count - 1].delay = (data[i + 2] < UINT32_MAX / 1000) ? data[i + 2] * 1000 : UINT32_MAX;
+  }
+
+  return inject_submit(env, steps, count, id);
+}
+
+// Decodes the next codepoint, `text` is valid UTF-8 produced by N-API.
+uint32_t utf8_next(const unsigned char** text) {
+  const unsigned char* p = *text;
+  uint32_t codepoint;
+  if (p[0] < 0x80) {
+    codepoint = p[0];
+    *text += 1;
+  }
+  else if (p[0] < 0xE0) {
+    codepoint = ((p[0] & 0x1Fu) << 6) | (p[1] & 0x3Fu);
+    *text += 2;
+  }
+  else if (p[0] < 0xF0) {
+    codepoint = ((p[0] & 0x0Fu) << 12) | ((p[1] & 0x3Fu) << 6) | (p[2] & 0x3Fu);
+    *text += 3;
+  }
+  else {
+    codepoint = ((p[0] & 0x07u) << 18) | ((p[1] & 0x3Fu) << 12) | ((p[2] & 0x3Fu) << 6) | (p[3] & 0x3Fu);
+    *text += 4;
+  }
+  return codepoint;
+}
+
+void type_step(injector_step* step, uint16_t keycode, bool down) {
+  step->event.type = down ? EVENT_KEY_PRESSED : EVENT_KEY_RELEASED;
+  step->event.data.keyboard.keycode = keycode;
+}
+
+// Converts the text to keystrokes with the current keyboard layout. Modifiers
+// stay pressed between characters that need the same ones. Returns false
+// with the codepoint in `failed` if a character can't be typed.
+bool type_text_steps(const keymap* map, const unsigned char* text, const unsigned char* end,
+                     uint32_t period, injector_step* steps, uint32_t* steps_count, uint32_t* failed) {
+  static const uint8_t modifiers_order[] = { KEYMAP_SHIFT, KEYMAP_ALTGR };
+  uint8_t held = 0;
+  uint32_t count = 0;
+
+  while (text < end) {
+    uint32_t codepoint = utf8_next(&text);
+    if (codepoint == '\r') {
+      if (text < end && *text == '\n') continue;
+      codepoint = '\n';
+    }
+
+    uint16_t keycode;
+    uint8_t modifiers;
+    if (!keymap_lookup(map, codepoint, &keycode, &modifiers)) {
+      *failed = codepoint;
+      return false;
+    }
+
+    for (int i = 1; i >= 0; i--) {
+      if ((held & modifiers_order[i]) && !(modifiers & modifiers_order[i])) {
+        type_step(&steps[count++], keymap_modifier_keycode(modifiers_order[i]), false);
+      }
+    }
+    for (int i = 0; i < 2; i++) {
+      if (!(held & modifiers_order[i]) && (modifiers & modifiers_order[i])) {
+        type_step(&steps[count++], keymap_modifier_keycode(modifiers_order[i]), true);
+      }
+    }
+    held = modifiers;
+
+    type_step(&steps[count++], keycode, true);
+    type_step(&steps[count++], keycode, false);
+    steps[count - 1].delay = period;
+  }
+
+  for (int i = 1; i >= 0; i--) {
+    if (held & modifiers_order[i]) {
+      type_step(&steps[count++], keymap_modifier_keycode(modifiers_order[i]), false);
+    }
+  }
+  *steps_count = count;
+  return true;
+}
+
+napi_value AddonInjectText (napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 3;
+  napi_value info_argv[3];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [1] Characters per second, 0 - as fast as possible
+  uint32_t cps;
+  status = napi_get_value_uint32(env, info_argv[1], &cps);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [2] Id
+  uint32_t id;
+  status = napi_get_value_uint32(env, info_argv[2], &id);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Text
+  size_t length;
+  status = napi_get_value_string_utf8(env, info_argv[0], NULL, 0, &length);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // A character is at most two modifier changes and a tap, every
+  // character takes at least one byte.
+  unsigned char* text = malloc(length + 1);
+  injector_step* steps = calloc(length * 4 + 2, sizeof(injector_step));
+  if (text == NULL || steps == NULL) {
+    free(text);
+    free(steps);
+    NAPI_THROW(env, "UIOHOOK_ERROR_OUT_OF_MEMORY", "Failed to allocate memory.", NULL);
+  }
+
+  status = napi_get_value_string_utf8(env, info_argv[0], (char*)text, length + 1, &length);
+  if (status != napi_ok) {
+    free(text);
+    free(steps);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
+
+  uint32_t failed = 0;
+  uint32_t count = 0;
+  const keymap* map = keymap_lock();
+  bool typeable = (map != NULL) &&
+    type_text_steps(map, text, text + length, (cps != 0) ? 1000000 / cps : 0, steps, &count, &failed);
+  keymap_unlock();
+  free(text);
+
+  if (!typeable) {
+    free(steps);
+    if (map == NULL) {
+      NAPI_THROW(env, "ERR_KEYBOARD_LAYOUT", "Failed to read the keyboard layout.", NULL);
+    }
+    char message[96];
+    snprintf(message, sizeof(message), "Character U+%04X can't be typed with the current keyboard layout.", failed);
+    NAPI_THROW(env, "ERR_INVALID_ARG_VALUE", message, NULL);
+  }
+
+  return inject_submit(env, steps, count, id);
+}
+
+#define MOUSE_PATH_MAX_RATE 1000 // moves per second
+
+napi_value AddonInjectMousePath (napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 6;
+  napi_value info_argv[6];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Waypoints, Int32Array of [x, y...]
+  napi_typedarray_type array_type;
+  size_t array_length;
+  void* array_data;
+  status = napi_get_typedarray_info(env, info_argv[0], &array_type, &array_length, &array_data, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [1] Duration, [2] Easing, [3] Rate, [4] Button held along the path or 0, [5] Id
+  uint32_t args[5];
+  for (int i = 0; i < 5; i++) {
+    status = napi_get_value_uint32(env, info_argv[i + 1], &args[i]);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
+  uint32_t duration = args[0];
+  uint32_t easing = args[1];
+  uint32_t rate = args[2];
+  uint32_t button = args[3];
+  uint32_t id = args[4];
+
+  if (array_type != napi_int32_array || array_length < 2 || array_length % 2 != 0) {
+    NAPI_THROW(env, "ERR_INVALID_ARG_VALUE", "Invalid mouse path.", NULL);
+  }
+  if (easing > injector_easing_in_out) {
+    NAPI_THROW(env, "ERR_INVALID_ARG_VALUE", "Unknown easing.", NULL);
+  }
+  if (rate == 0 || rate > MOUSE_PATH_MAX_RATE) {
+    NAPI_THROW(env, "ERR_OUT_OF_RANGE", "Mouse path rate must be between 1 and 1000.", NULL);
+  }
+
+  uint32_t count = (uint32_t)(array_length / 2);
+  injector_path* path = malloc(sizeof(injector_path) + array_length * sizeof(int16_t));
+  // Press at the first waypoint, move, release at the last one.
+  injector_step* steps = calloc(3, sizeof(injector_step));
+  if (path == NULL || steps == NULL) {
+    free(path);
+    free(steps);
+    NAPI_THROW(env, "UIOHOOK_ERROR_OUT_OF_MEMORY", "Failed to allocate memory.", NULL);
+  }
+
+  const int32_t* points = array_data;
+  path->easing = easing;
+  path->duration = duration;
+  path->rate = rate;
+  path->count = count;
+  for (size_t i = 0; i < array_length; i++) {
+    path->points[i] = (int16_t)points[i];
+  }
+
+  if (button == 0) {
+    steps[0].path = path;
+    return inject_submit(env, steps, 1, id);
+  }
+
+  steps[0].event.type = EVENT_MOUSE_PRESSED;
+  steps[0].event.data.mouse.button = (uint16_t)button;
+  steps[0].event.data.mouse.x = path->points[0];
+  steps[0].event.data.mouse.y = path->points[1];
+  steps[1].path = path;
+  steps[2].event.type = EVENT_MOUSE_RELEASED;
+  steps[2].event.data.mouse.button = (uint16_t)button;
+  steps[2].event.data.mouse.x = path->points[count * 2 - 2];
+  steps[2].event.data.mouse.y = path->points[count * 2 - 1];
+  return inject_submit(env, steps, 3, id);
+}
+
+napi_value AddonCancelInjection (napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 1;
+  napi_value info_argv[1];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Id
+  uint32_t id;
+  status = napi_get_value_uint32(env, info_argv[0], &id);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value result;
+  status = napi_get_boolean(env, injector_cancel(subscriber_get(env), id), &result);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  return result;
+}
+
+// Returns a malloc'ed copy of a JS string.
+char* string_from_js(napi_env env, napi_value value) {
+  size_t length;
+  napi_status status = napi_get_value_string_utf8(env, value, NULL, 0, &length);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  char* string = malloc(length + 1);
+  if (string == NULL) {
+    NAPI_THROW(env, "UIOHOOK_ERROR_OUT_OF_MEMORY", "Failed to allocate memory.", NULL);
+  }
+  status = napi_get_value_string_utf8(env, value, string, length + 1, &length);
+  if (status != napi_ok) {
+    free(string);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
+  return string;
+}
+
+napi_value recorder_throw(napi_env env, recorder_status status, const char* path) {
+  char message[512];
+  switch (status) {
+  case recorder_error_open:
+    snprintf(message, sizeof(message), "Failed to open \"%s\".", path);
+    NAPI_THROW(env, "UIOHOOK_ERROR_RECORDING_OPEN", message, NULL);
+  case recorder_error_io:
+    snprintf(message, sizeof(message), "Failed to read or write \"%s\".", path);
+    NAPI_THROW(env, "UIOHOOK_ERROR_RECORDING_IO", message, NULL);
+  case recorder_error_format:
+    snprintf(message, sizeof(message), "\"%s\" is not a recording.", path);
+    NAPI_THROW(env, "UIOHOOK_ERROR_RECORDING_FORMAT", message, NULL);
+  case recorder_error_thread_create:
+    NAPI_THROW(env, "UIOHOOK_ERROR_THREAD_CREATE", "Failed to create recorder thread.", NULL);
+  case recorder_error_out_of_memory:
+  default:
+    NAPI_THROW(env, "UIOHOOK_ERROR_OUT_OF_MEMORY", "Failed to allocate memory.", NULL);
+  }
+}
+
+napi_value AddonStartRecording (napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 1;
+  napi_value info_argv[1];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Path
+  char* path = string_from_js(env, info_argv[0]);
+  if (path == NULL) return NULL;
+
+  recorder* rec = malloc(sizeof(recorder));
+  if (rec == NULL) {
+    free(path);
+    NAPI_THROW(env, "UIOHOOK_ERROR_OUT_OF_MEMORY", "Failed to allocate memory.", NULL);
+  }
+
+  uv_mutex_lock(&subscribers_mutex);
+  if (recorder_owner != NULL) {
+    uv_mutex_unlock(&subscribers_mutex);
+    free(rec);
+    free(path);
+    NAPI_THROW(env, "ERR_RECORDING_ACTIVE", "A recording is already in progress.", NULL);
+  }
+
+  recorder_status rec_status = recorder_open(rec, path);
+  if (rec_status == recorder_ok) {
+    recorder_owner = subscriber_get(env);
+    atomic_exchange_ptr((void* volatile*)&active_recorder, rec);
+  }
+  uv_mutex_unlock(&subscribers_mutex);
+
+  if (rec_status != recorder_ok) {
+    free(rec);
+    recorder_throw(env, rec_status, path);
+  }
+  free(path);
+  return NULL;
+}
+
+napi_value AddonStopRecording (napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  recorder* rec = recording_stop(subscriber_get(env));
+  if (rec == NULL) return NULL;
+
+  if (rec->write_failed) {
+    free(rec);
+    NAPI_THROW(env, "UIOHOOK_ERROR_RECORDING_IO", "Failed to write the recording.", NULL);
+  }
+
+  napi_value result;
+  status = napi_create_object(env, &result);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_events;
+  status = napi_create_double(env, (double)rec->events, &e_events);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_bytes;
+  status = napi_create_double(env, (double)rec->bytes, &e_bytes);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_dropped;
+  status = napi_create_double(env, (double)rec->dropped, &e_dropped);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  free(rec);
+
+  napi_property_descriptor descriptors[] = {
+    { "events",  NULL, NULL, NULL, NULL, e_events,  napi_enumerable, NULL },
+    { "bytes",   NULL, NULL, NULL, NULL, e_bytes,   napi_enumerable, NULL },
+    { "dropped", NULL, NULL, NULL, NULL, e_dropped, napi_enumerable, NULL },
+  };
+  status = napi_define_properties(env, result, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  return result;
+}
+
+napi_value AddonReplay (napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 3;
+  napi_value info_argv[3];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [1] Speed multiplier
+  double speed;
+  status = napi_get_value_double(env, info_argv[1], &speed);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (!(speed > 0)) {
+    NAPI_THROW(env, "ERR_INVALID_ARG_VALUE", "Replay speed must be positive.", NULL);
+  }
+
+  // [2] Id
+  uint32_t id;
+  status = napi_get_value_uint32(env, info_argv[2], &id);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Path
+  char* path = string_from_js(env, info_argv[0]);
+  if (path == NULL) return NULL;
+
+  injector_step* steps;
+  uint32_t count;
+  recorder_status rec_status = recorder_load(path, speed, &steps, &count);
+  if (rec_status != recorder_ok) {
+    recorder_throw(env, rec_status, path);
+    free(path);
+    return NULL;
+  }
+  free(path);
+
+  return inject_submit(env, steps, count, id);
+}
+
+napi_value AddonWatchIdle (napi_env env, napi_callback_info info) {
+  subscriber* sub = subscriber_get(env);
+  napi_status status;
+
+  size_t info_argc = 3;
+  napi_value info_argv[3];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [1] Thresholds, ms ascending
+  napi_typedarray_type array_type;
+  size_t count;
+  void* array_data;
+  status = napi_get_typedarray_info(env, info_argv[1], &array_type, &count, &array_data, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  if (array_type != napi_uint32_array || count == 0 || count > IDLE_MAX_THRESHOLDS) {
+    NAPI_THROW(env, "ERR_INVALID_ARG_VALUE", "Expected 1 to 8 idle thresholds.", NULL);
+  }
+  const uint32_t* thresholds = array_data;
+  for (size_t i = 0; i < count; i++) {
+    if (thresholds[i] == 0 || (i > 0 && thresholds[i] <= thresholds[i - 1])) {
+      NAPI_THROW(env, "ERR_INVALID_ARG_VALUE", "Idle thresholds must be positive and ascending.", NULL);
+    }
+  }
+
+  // [2] Jitter, px
+  uint32_t jitter;
+  status = napi_get_value_uint32(env, info_argv[2], &jitter);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  idle_stop(sub, true);
+
+  idle_detector* idle = malloc(sizeof(idle_detector));
+  if (idle == NULL) {
+    NAPI_THROW(env, "UIOHOOK_ERROR_OUT_OF_MEMORY", "Failed to allocate memory.", NULL);
+  }
+
+  // [0] Callback
+  napi_value async_resource_name;
+  status = napi_create_string_utf8(env, "UIOHOOK_NAPI_IDLE", NAPI_AUTO_LENGTH, &async_resource_name);
+  NAPI_FATAL_IF_FAILED(status, "AddonWatchIdle", "napi_create_string_utf8");
+
+  status = napi_create_threadsafe_function(env, info_argv[0], NULL, async_resource_name, 0, 1, NULL, NULL, NULL, idle_to_js_proxy, &sub->idle_fn);
+  if (status != napi_ok) {
+    free(idle);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
+
+  // Only the hook keeps the process alive.
+  status = napi_unref_threadsafe_function(env, sub->idle_fn);
+  NAPI_FATAL_IF_FAILED(status, "AddonWatchIdle", "napi_unref_threadsafe_function");
+
+  if (idle_detector_start(idle, thresholds, (uint32_t)count, jitter, idle_transition_proc, sub) != UIOHOOK_SUCCESS) {
+    napi_release_threadsafe_function(sub->idle_fn, napi_tsfn_abort);
+    sub->idle_fn = NULL;
+    free(idle);
+    NAPI_THROW(env, "UIOHOOK_ERROR_THREAD_CREATE", "Failed to create idle detector thread.", NULL);
+  }
+
+  atomic_exchange_ptr((void* volatile*)&sub->idle, idle);
+  return NULL;
+}
+
+napi_value AddonUnwatchIdle (napi_env env, napi_callback_info info) {
+  idle_stop(subscriber_get(env), true);
+  return NULL;
+}
+
+// Routes log messages of all environments to a JS function, or back to
+// stderr with null. Replaces a handler set by another environment.
+napi_value AddonSetLogHandler (napi_env env, napi_callback_info info) {
+  subscriber* sub = subscriber_get(env);
+  napi_status status;
+
+  size_t info_argc = 1;
+  napi_value info_argv[1];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Handler or null
+  napi_valuetype type;
+  status = napi_typeof(env, info_argv[0], &type);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  if (type == napi_null) {
+    log_handler_stop(sub, true);
+    return NULL;
+  }
+  if (type != napi_function) {
+    NAPI_THROW(env, "ERR_INVALID_ARG_TYPE", "Log handler must be a function or null.", NULL);
+  }
+
+  napi_value async_resource_name;
+  status = napi_create_string_utf8(env, "UIOHOOK_NAPI_LOG", NAPI_AUTO_LENGTH, &async_resource_name);
+  NAPI_FATAL_IF_FAILED(status, "AddonSetLogHandler", "napi_create_string_utf8");
+
+  // Bounded like the ring, a slow handler loses messages instead of
+  // queueing them without limit.
+  napi_threadsafe_function fn;
+  status = napi_create_threadsafe_function(env, info_argv[0], NULL, async_resource_name, LOG_RING_SLOTS, 1, NULL, NULL, NULL, log_to_js_proxy, &fn);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // Only the hook keeps the process alive.
+  status = napi_unref_threadsafe_function(env, fn);
+  NAPI_FATAL_IF_FAILED(status, "AddonSetLogHandler", "napi_unref_threadsafe_function");
+
+  uv_mutex_lock(&subscribers_mutex);
+  napi_threadsafe_function previous_fn = log_handler_fn;
+  log_ring_set_sink(log_sink_proc, fn);
+  log_handler_fn = fn;
+  log_handler_owner = sub;
+  uv_mutex_unlock(&subscribers_mutex);
+
+  if (previous_fn != NULL) {
+    napi_release_threadsafe_function(previous_fn, napi_tsfn_release);
+  }
+  return NULL;
+}
+
+napi_value AddonSetLogLevel (napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 1;
+  napi_value info_argv[1];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Level, LOG_LEVEL_OFF disables logging
+  uint32_t level;
+  status = napi_get_value_uint32(env, info_argv[0], &level);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  if (level < LOG_LEVEL_DEBUG || level > LOG_LEVEL_OFF) {
+    NAPI_THROW(env, "ERR_INVALID_ARG_VALUE", "Unknown log level.", NULL);
+  }
+  log_ring_set_level(level);
+  return NULL;
+}
+
+napi_value AddonGetLogCounters (napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  uint64_t messages, dropped;
+  log_ring_counters(&messages, &dropped);
+
+  napi_value result;
+  status = napi_create_object(env, &result);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_messages;
+  status = napi_create_double(env, (double)messages, &e_messages);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_dropped;
+  status = napi_create_double(env, (double)dropped, &e_dropped);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_property_descriptor descriptors[] = {
+    { "messages", NULL, NULL, NULL, NULL, e_messages, napi_enumerable, NULL },
+    { "dropped",  NULL, NULL, NULL, NULL, e_dropped,  napi_enumerable, NULL },
+  };
+  status = napi_define_properties(env, result, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  return result;
+}
+
+napi_value AddonStartHeatmap (napi_env env, napi_callback_info info) {
+  subscriber* sub = subscriber_get(env);
+  napi_status status;
+
+  size_t info_argc = 6;
+  napi_value info_argv[6];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [1..5] Left, top, cell size, columns, rows
+  int32_t left, top;
+  status = napi_get_value_int32(env, info_argv[1], &left);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  status = napi_get_value_int32(env, info_argv[2], &top);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  uint32_t cell_size, columns, rows;
+  status = napi_get_value_uint32(env, info_argv[3], &cell_size);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  status = napi_get_value_uint32(env, info_argv[4], &columns);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  status = napi_get_value_uint32(env, info_argv[5], &rows);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Counters, Uint32Array of two halves
+  napi_typedarray_type array_type;
+  size_t array_length;
+  void* array_data;
+  status = napi_get_typedarray_info(env, info_argv[0], &array_type, &array_length, &array_data, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  if (array_type != napi_uint32_array) {
+    NAPI_THROW(env, "ERR_INVALID_ARG_VALUE", "Invalid heatmap buffer.", NULL);
+  }
+
+  heatmap* map = malloc(sizeof(heatmap));
+  if (map == NULL) {
+    NAPI_THROW(env, "UIOHOOK_ERROR_OUT_OF_MEMORY", "Failed to allocate memory.", NULL);
+  }
+  if (heatmap_init(map, array_data, array_length, left, top, cell_size, columns, rows) != 0) {
+    free(map);
+    NAPI_THROW(env, "ERR_INVALID_ARG_VALUE", "Invalid heatmap grid.", NULL);
+  }
+
+  // Keep the buffer alive while the hook thread writes into it.
+  napi_ref heatmap_ref;
+  status = napi_create_reference(env, info_argv[0], 1, &heatmap_ref);
+  if (status != napi_ok) {
+    free(map);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
+
+  // The new grid is valid, only now replace the running one.
+  heatmap_stop(sub, true);
+  sub->heatmap_ref = heatmap_ref;
+  atomic_exchange_ptr((void* volatile*)&sub->heatmap, map);
+  return NULL;
+}
+
+// Returns the half of the counters buffer JS can read now, or null.
+napi_value AddonTakeHeatmap (napi_env env, napi_callback_info info) {
+  subscriber* sub = subscriber_get(env);
+  napi_status status;
+
+  napi_value result;
+  heatmap* map = sub->heatmap;
+  if (map == NULL) {
+    status = napi_get_null(env, &result);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    return result;
+  }
+
+  status = napi_create_uint32(env, heatmap_swap(map), &result);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  return result;
+}
+
+napi_value AddonStopHeatmap (napi_env env, napi_callback_info info) {
+  heatmap_stop(subscriber_get(env), true);
+  return NULL;
+}
+
+// Gates dispatch to this environment without stopping the hook.
+napi_value AddonSetPaused (napi_env env, napi_callback_info info) {
+  subscriber* sub = subscriber_get(env);
+  napi_status status;
+
+  size_t info_argc = 1;
+  napi_value info_argv[1];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Paused
+  bool paused;
+  status = napi_get_value_bool(env, info_argv[0], &paused);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  if (sub->is_subscribed) {
+    atomic_store_u32(&sub->paused, paused);
+  }
+  return NULL;
+}
+
+napi_value AddonSetEventMask (napi_env env, napi_callback_info info) {
+  subscriber* sub = subscriber_get(env);
+  napi_status status;
+
+  size_t info_argc = 1;
+  napi_value info_argv[1];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Mask
+  uint32_t mask;
+  status = napi_get_value_uint32(env, info_argv[0], &mask);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  atomic_store_u32(&sub->event_mask, mask);
+  return NULL;
+}
+
+napi_value AddonSetHotkeys (napi_env env, napi_callback_info info) {
+  subscriber* sub = subscriber_get(env);
+  napi_status status;
+
+  size_t info_argc = 1;
+  napi_value info_argv[1];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Hotkeys, Uint32Array of [id, stroke count, strokes...]
+  napi_typedarray_type array_type;
+  size_t array_length;
+  void* array_data;
+  status = napi_get_typedarray_info(env, info_argv[0], &array_type, &array_length, &array_data, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  if (array_type != napi_uint32_array || hotkeys_set(&sub->hotkeys, array_data, array_length) != 0) {
+    NAPI_THROW(env, "ERR_INVALID_ARG_VALUE", "Invalid hotkeys.", NULL);
+  }
+
+  return NULL;
+}
+
+napi_value AddonSetSequences (napi_env env, napi_callback_info info) {
+  subscriber* sub = subscriber_get(env);
+  napi_status status;
+
+  size_t info_argc = 3;
+  napi_value info_argv[3];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [1] Backspace handling
+  uint32_t backspace;
+  status = napi_get_value_uint32(env, info_argv[1], &backspace);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  if (backspace > sequence_backspace_stroke) {
+    NAPI_THROW(env, "ERR_INVALID_ARG_VALUE", "Unknown backspace handling.", NULL);
+  }
+
+  // [2] Reset on mouse button press
+  bool reset_on_click;
+  status = napi_get_value_bool(env, info_argv[2], &reset_on_click);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Sequences, Uint32Array of [id, stroke count, strokes...]
+  napi_typedarray_type array_type;
+  size_t array_length;
+  void* array_data;
+  status = napi_get_typedarray_info(env, info_argv[0], &array_type, &array_length, &array_data, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  if (array_type != napi_uint32_array ||
+      sequences_set(&sub->sequences, array_data, array_length, backspace, reset_on_click) != 0) {
+    NAPI_THROW(env, "ERR_INVALID_ARG_VALUE", "Invalid sequences.", NULL);
+  }
+
+  return NULL;
+}
+
+napi_value AddonSetRegions (napi_env env, napi_callback_info info) {
+  subscriber* sub = subscriber_get(env);
+  napi_status status;
+
+  size_t info_argc = 1;
+  napi_value info_argv[1];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Regions, Int32Array of [id, x, y, width, height, event types]
+  napi_typedarray_type array_type;
+  size_t array_length;
+  void* array_data;
+  status = napi_get_typedarray_info(env, info_argv[0], &array_type, &array_length, &array_data, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  if (array_type != napi_int32_array || regions_set(&sub->regions, array_data, array_length) != 0) {
+    NAPI_THROW(env, "ERR_INVALID_ARG_VALUE", "Invalid regions.", NULL);
+  }
+
+  return NULL;
+}
+
+napi_value AddonSetEventClasses (napi_env env, napi_callback_info info) {
+  subscriber* sub = subscriber_get(env);
+  napi_status status;
+
+  size_t info_argc = event_class_count;
+  napi_value info_argv[event_class_count];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0..4] Keyboard, mouse, wheel, hotkey and sequence event constructors
+  for (int i = 0; i < event_class_count; i++) {
+    napi_valuetype type = napi_undefined;
+    if ((size_t)i < info_argc) {
+      status = napi_typeof(env, info_argv[i], &type);
+      NAPI_THROW_IF_FAILED(env, status, NULL);
+    }
+    if (type != napi_function) {
+      NAPI_THROW(env, "ERR_INVALID_ARG_TYPE", "Event class must be a function.", NULL);
+    }
+  }
+
+  for (int i = 0; i < event_class_count; i++) {
+    if (sub->event_class_refs[i] != NULL) {
+      napi_delete_reference(env, sub->event_class_refs[i]);
+    }
+    status = napi_create_reference(env, info_argv[i], 1, &sub->event_class_refs[i]);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
+
+  return NULL;
+}
+
+napi_value AddonGetDropCounters (napi_env env, napi_callback_info info) {
+  subscriber* sub = subscriber_get(env);
+  napi_status status;
+
+  napi_value result;
+  status = napi_create_object(env, &result);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_mouseMove;
+  status = napi_create_double(env, (double)atomic_load_u64(&sub->queue.dropped_mouse_move), &e_mouseMove);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_other;
+  status = napi_create_double(env, (double)atomic_load_u64(&sub->queue.dropped_other), &e_other);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_property_descriptor descriptors[] = {
+    { "mouseMove", NULL, NULL, NULL, NULL, e_mouseMove, napi_enumerable, NULL },
+    { "other",     NULL, NULL, NULL, NULL, e_other,     napi_enumerable, NULL },
+  };
+  status = napi_define_properties(env, result, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  return result;
+}
+
+napi_value AddonGetMergeCounters (napi_env env, napi_callback_info info) {
+  subscriber* sub = subscriber_get(env);
+  napi_status status;
+
+  napi_value result;
+  status = napi_create_object(env, &result);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_mouseMove;
+  status = napi_create_double(env, (double)atomic_load_u64(&sub->queue.merged_mouse_move), &e_mouseMove);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_wheel;
+  status = napi_create_double(env, (double)atomic_load_u64(&sub->queue.merged_wheel), &e_wheel);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_property_descriptor descriptors[] = {
+    { "mouseMove", NULL, NULL, NULL, NULL, e_mouseMove, napi_enumerable, NULL },
+    { "wheel",     NULL, NULL, NULL, NULL, e_wheel,     napi_enumerable, NULL },
+  };
+  status = napi_define_properties(env, result, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  return result;
+}
+
+// Totals since the previous call, null unless started in aggregation mode.
+napi_value AddonTakeActivity (napi_env env, napi_callback_info info) {
+  subscriber* sub = subscriber_get(env);
+  napi_status status;
+
+  napi_value result;
+  if (!sub->is_subscribed || !sub->activity_enabled) {
+    status = napi_get_null(env, &result);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    return result;
+  }
+
+  activity_summary summary;
+  activity_take(&sub->activity, &summary);
+  uint64_t now = uv_hrtime();
+  double duration = (double)(now - sub->activity_taken) / 1e6;
+  sub->activity_taken = now;
+
+  status = napi_create_object(env, &result);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_keys;
+  status = napi_create_double(env, (double)summary.keys, &e_keys);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_clicks;
+  status = napi_create_double(env, (double)summary.clicks, &e_clicks);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_scroll;
+  status = napi_create_double(env, (double)summary.scroll, &e_scroll);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_distance;
+  status = napi_create_double(env, summary.distance, &e_distance);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_duration;
+  status = napi_create_double(env, duration, &e_duration);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_property_descriptor descriptors[] = {
+    { "keys",     NULL, NULL, NULL, NULL, e_keys,     napi_enumerable, NULL },
+    { "clicks",   NULL, NULL, NULL, NULL, e_clicks,   napi_enumerable, NULL },
+    { "scroll",   NULL, NULL, NULL, NULL, e_scroll,   napi_enumerable, NULL },
+    { "distance", NULL, NULL, NULL, NULL, e_distance, napi_enumerable, NULL },
+    { "duration", NULL, NULL, NULL, NULL, e_duration, napi_enumerable, NULL },
+  };
+  status = napi_define_properties(env, result, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  return result;
+}
+
+napi_value AddonIsKeyDown (napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 1;
+  napi_value info_argv[1];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Keycode
+  uint32_t keycode;
+  status = napi_get_value_uint32(env, info_argv[0], &keycode);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value result;
+  status = napi_get_boolean(env, keycode <= 0xFFFF && uiohook_worker_key_down((uint16_t)keycode), &result);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  return result;
+}
+
+napi_value AddonIsMouseButtonDown (napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 1;
+  napi_value info_argv[1];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Button
+  uint32_t button;
+  status = napi_get_value_uint32(env, info_argv[0], &button);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value result;
+  status = napi_get_boolean(env, button <= 0xFFFF && uiohook_worker_button_down((uint16_t)button), &result);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  return result;
+}
+
+#define PRESSED_KEYS_MAX 256
+
+napi_value AddonGetPressedKeys (napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  uint16_t keycodes[PRESSED_KEYS_MAX];
+  uint32_t count = uiohook_worker_pressed_keys(keycodes, PRESSED_KEYS_MAX);
+
+  napi_value result;
+  status = napi_create_array_with_length(env, count, &result);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  for (uint32_t i = 0; i < count; i++) {
+    napi_value keycode;
+    status = napi_create_uint32(env, keycodes[i], &keycode);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    status = napi_set_element(env, result, i, keycode);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
+
+  return result;
+}
+
+napi_value AddonGetCursor (napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  int16_t x, y;
+  if (!uiohook_worker_cursor(&x, &y)) {
+    napi_value result;
+    status = napi_get_null(env, &result);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    return result;
+  }
+
+  napi_value result;
+  status = napi_create_object(env, &result);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_x;
+  status = napi_create_int32(env, x, &e_x);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_y;
+  status = napi_create_int32(env, y, &e_y);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_property_descriptor descriptors[] = {
+    { "x", NULL, NULL, NULL, NULL, e_x, napi_enumerable, NULL },
+    { "y", NULL, NULL, NULL, NULL, e_y, napi_enumerable, NULL },
+  };
+  status = napi_define_properties(env, result, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  return result;
+}
+
+// Monitors as libuiohook reports them, in desktop coordinates.
+napi_value AddonGetScreens (napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  unsigned char count = 0;
+  screen_data* screens = hook_create_screen_info(&count);
+  if (screens == NULL) {
+    count = 0;
+  }
+
+  napi_value result;
+  status = napi_create_array_with_length(env, count, &result);
+  if (status != napi_ok) {
+    free(screens);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    napi_value screen;
+    status = napi_create_object(env, &screen);
+    NAPI_FATAL_IF_FAILED(status, "AddonGetScreens", "napi_create_object");
+
+    napi_value e_number, e_x, e_y, e_width, e_height;
+    status = napi_create_uint32(env, screens[i].number, &e_number);
+    NAPI_FATAL_IF_FAILED(status, "AddonGetScreens", "napi_create_uint32");
+    status = napi_create_int32(env, screens[i].x, &e_x);
+    NAPI_FATAL_IF_FAILED(status, "AddonGetScreens", "napi_create_int32");
+    status = napi_create_int32(env, screens[i].y, &e_y);
+    NAPI_FATAL_IF_FAILED(status, "AddonGetScreens", "napi_create_int32");
+    status = napi_create_uint32(env, screens[i].width, &e_width);
+    NAPI_FATAL_IF_FAILED(status, "AddonGetScreens", "napi_create_uint32");
+    status = napi_create_uint32(env, screens[i].height, &e_height);
+    NAPI_FATAL_IF_FAILED(status, "AddonGetScreens", "napi_create_uint32");
+
+    napi_property_descriptor descriptors[] = {
+      { "number", NULL, NULL, NULL, NULL, e_number, napi_enumerable, NULL },
+      { "x",      NULL, NULL, NULL, NULL, e_x,      napi_enumerable, NULL },
+      { "y",      NULL, NULL, NULL, NULL, e_y,      napi_enumerable, NULL },
+      { "width",  NULL, NULL, NULL, NULL, e_width,  napi_enumerable, NULL },
+      { "height", NULL, NULL, NULL, NULL, e_height, napi_enumerable, NULL },
+    };
+    status = napi_define_properties(env, screen, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+    NAPI_FATAL_IF_FAILED(status, "AddonGetScreens", "napi_define_properties");
+
+    status = napi_set_element(env, result, i, screen);
+    NAPI_FATAL_IF_FAILED(status, "AddonGetScreens", "napi_set_element");
+  }
+
+  free(screens);
+  return result;
+}
+
+napi_value stats_histogram_to_js(napi_env env, const stats_histogram* histogram) {
+  napi_status status;
+
+  napi_value result;
+  status = napi_create_object(env, &result);
+  NAPI_FATAL_IF_FAILED(status, "stats_histogram_to_js", "napi_create_object");
+
+  struct {
+    const char* name;
+    double value;
+  } fields[] = {
+    { "count", (double)histogram->count },
+    { "min",   (double)histogram->min },
+    { "max",   (double)histogram->max },
+    { "mean",  histogram->count ? histogram->sum / (double)histogram->count : 0 },
+    { "p50",   (double)stats_histogram_percentile(histogram, 0.5) },
+    { "p90",   (double)stats_histogram_percentile(histogram, 0.9) },
+    { "p99",   (double)stats_histogram_percentile(histogram, 0.99) },
+    { "p999",  (double)stats_histogram_percentile(histogram, 0.999) },
+  };
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    napi_value value;
+    status = napi_create_double(env, fields[i].value, &value);
+    NAPI_FATAL_IF_FAILED(status, "stats_histogram_to_js", "napi_create_double");
+    status = napi_set_named_property(env, result, fields[i].name, value);
+    NAPI_FATAL_IF_FAILED(status, "stats_histogram_to_js", "napi_set_named_property");
+  }
+
+  // Non-empty buckets as [upper bound, count]
+  napi_value buckets;
+  status = napi_create_array(env, &buckets);
+  NAPI_FATAL_IF_FAILED(status, "stats_histogram_to_js", "napi_create_array");
+
+  uint32_t length = 0;
+  for (uint32_t i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+    if (histogram->counts[i] == 0) continue;
+
+    napi_value bucket, upper, count;
+    status = napi_create_array_with_length(env, 2, &bucket);
+    NAPI_FATAL_IF_FAILED(status, "stats_histogram_to_js", "napi_create_array_with_length");
+    status = napi_create_double(env, (double)stats_bucket_upper(i), &upper);
+    NAPI_FATAL_IF_FAILED(status, "stats_histogram_to_js", "napi_create_double");
+    status = napi_create_double(env, (double)histogram->counts[i], &count);
+    NAPI_FATAL_IF_FAILED(status, "stats_histogram_to_js", "napi_create_double");
+    status = napi_set_element(env, bucket, 0, upper);
+    NAPI_FATAL_IF_FAILED(status, "stats_histogram_to_js", "napi_set_element");
+    status = napi_set_element(env, bucket, 1, count);
+    NAPI_FATAL_IF_FAILED(status, "stats_histogram_to_js", "napi_set_element");
+    status = napi_set_element(env, buckets, length++, bucket);
+    NAPI_FATAL_IF_FAILED(status, "stats_histogram_to_js", "napi_set_element");
+  }
+
+  status = napi_set_named_property(env, result, "buckets", buckets);
+  NAPI_FATAL_IF_FAILED(status, "stats_histogram_to_js", "napi_set_named_property");
+  return result;
+}
+
+napi_value AddonGetStats (napi_env env, napi_callback_info info) {
+  subscriber* sub = subscriber_get(env);
+  napi_status status;
+
+  if (!sub->stats_enabled) {
+    napi_value null_value;
+    status = napi_get_null(env, &null_value);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    return null_value;
+  }
+
+  napi_value result;
+  status = napi_create_object(env, &result);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // Latency histograms in ns
+  static const char* stage_names[stats_stage_count] = { "hook", "queue", "js", "total" };
+  napi_value stages;
+  status = napi_create_object(env, &stages);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  for (int i = 0; i < stats_stage_count; i++) {
+    status = napi_set_named_property(env, stages, stage_names[i], stats_histogram_to_js(env, &sub->stats_stages[i]));
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
+  status = napi_set_named_property(env, result, "stages", stages);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // Rate of events by type since the previous call
+  uint64_t now = uv_hrtime();
+  double seconds = (double)(now - sub->stats_last_time) / 1e9;
+  sub->stats_last_time = now;
+
+  napi_value rates;
+  status = napi_create_array_with_length(env, STATS_EVENT_TYPES, &rates);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  for (uint32_t i = 0; i < STATS_EVENT_TYPES; i++) {
+    uint64_t events = atomic_load_u64(&stats_events[i]);
+    napi_value rate;
+    status = napi_create_double(env, seconds > 0 ? (double)(events - sub->stats_last_events[i]) / seconds : 0, &rate);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    status = napi_set_element(env, rates, i, rate);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    sub->stats_last_events[i] = events;
+  }
+  status = napi_set_named_property(env, result, "eventsPerSecond", rates);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value queue_depth;
+  status = napi_create_uint32(env, (sub->is_subscribed && sub->stream_ref == NULL) ? event_ring_size(&sub->queue) : 0, &queue_depth);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  status = napi_set_named_property(env, result, "queueDepth", queue_depth);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value dropped = AddonGetDropCounters(env, info);
+  if (dropped == NULL) return NULL;
+  status = napi_set_named_property(env, result, "dropped", dropped);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  return result;
+}
+
+napi_value AddonSetHookThreadOptions (napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 1;
+  napi_value info_argv[1];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Options
+  worker_thread_options options;
+  memset(&options, 0, sizeof(options));
+  uint32_t policy = worker_sched_default;
+  status = object_get_uint32(env, info_argv[0], "policy", &policy);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  status = object_get_uint32(env, info_argv[0], "priority", (uint32_t*)&options.priority);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  uint32_t lock_memory = 0;
+  status = object_get_uint32(env, info_argv[0], "lockMemory", &lock_memory);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  uint32_t measure_jitter = 0;
+  status = object_get_uint32(env, info_argv[0], "measureJitter", &measure_jitter);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  if (policy > worker_sched_fifo) {
+    NAPI_THROW(env, "ERR_OUT_OF_RANGE", "Unknown scheduling policy.", NULL);
+  }
+  options.policy = policy;
+  options.lock_memory = lock_memory != 0;
+  options.measure_jitter = measure_jitter != 0;
+
+  napi_value cpus;
+  status = napi_get_named_property(env, info_argv[0], "cpus", &cpus);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  napi_valuetype cpus_type;
+  status = napi_typeof(env, cpus, &cpus_type);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (cpus_type != napi_undefined) {
+    uint32_t count;
+    status = napi_get_array_length(env, cpus, &count);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    for (uint32_t i = 0; i < count; i++) {
+      napi_value element;
+      status = napi_get_element(env, cpus, i, &element);
+      NAPI_THROW_IF_FAILED(env, status, NULL);
+      uint32_t cpu;
+      status = napi_get_value_uint32(env, element, &cpu);
+      NAPI_THROW_IF_FAILED(env, status, NULL);
+      if (cpu >= WORKER_MAX_CPUS) {
+        NAPI_THROW(env, "ERR_OUT_OF_RANGE", "CPU index must be below 256.", NULL);
+      }
+      options.cpus[cpu / 64] |= (uint64_t)1 << (cpu % 64);
+    }
+  }
+
+  uv_mutex_lock(&subscribers_mutex);
+  uiohook_worker_thread_options(&options);
+  uv_mutex_unlock(&subscribers_mutex);
+  return NULL;
+}
+
+// errno or GetLastError() value as a name like "EPERM", null for 0.
+napi_value sys_error_to_js(napi_env env, int error) {
+  napi_value result;
+  napi_status status = (error == 0)
+    ? napi_get_null(env, &result)
+    : napi_create_string_utf8(env, uv_err_name(uv_translate_sys_error(error)), NAPI_AUTO_LENGTH, &result);
+  NAPI_FATAL_IF_FAILED(status, "sys_error_to_js", "napi_create_string_utf8");
+  return result;
+}
+
+napi_value AddonGetHookThreadReport (napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  worker_thread_report report;
+  stats_histogram* jitter = malloc(sizeof(stats_histogram));
+  if (jitter == NULL) {
+    NAPI_THROW(env, "UIOHOOK_ERROR_OUT_OF_MEMORY", "Failed to allocate memory.", NULL);
+  }
+  uv_mutex_lock(&subscribers_mutex);
+  uiohook_worker_thread_report(&report, jitter);
+  uv_mutex_unlock(&subscribers_mutex);
+
+  napi_value result;
+  status = napi_create_object(env, &result);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_started;
+  status = napi_get_boolean(env, report.started, &e_started);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_policy;
+  status = napi_create_uint32(env, report.policy, &e_policy);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_priority;
+  status = napi_create_int32(env, report.priority, &e_priority);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_sched_error = sys_error_to_js(env, report.sched_error);
+
+  napi_value e_cpus;
+  status = napi_create_array(env, &e_cpus);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  for (uint32_t cpu = 0, length = 0; cpu < WORKER_MAX_CPUS; cpu++) {
+    if ((report.cpus[cpu / 64] >> (cpu % 64)) & 1) {
+      napi_value element;
+      status = napi_create_uint32(env, cpu, &element);
+      NAPI_THROW_IF_FAILED(env, status, NULL);
+      status = napi_set_element(env, e_cpus, length++, element);
+      NAPI_THROW_IF_FAILED(env, status, NULL);
+    }
+  }
+
+  napi_value e_affinity_error = sys_error_to_js(env, report.affinity_error);
+
+  napi_value e_locked_bytes;
+  status = napi_create_double(env, (double)report.locked_bytes, &e_locked_bytes);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value e_memory_error = sys_error_to_js(env, report.memory_error);
+
+  napi_value e_jitter = stats_histogram_to_js(env, jitter);
+  free(jitter);
+
+  napi_property_descriptor descriptors[] = {
+    { "started",       NULL, NULL, NULL, NULL, e_started,        napi_enumerable, NULL },
+    { "policy",        NULL, NULL, NULL, NULL, e_policy,         napi_enumerable, NULL },
+    { "priority",      NULL, NULL, NULL, NULL, e_priority,       napi_enumerable, NULL },
+    { "schedError",    NULL, NULL, NULL, NULL, e_sched_error,    napi_enumerable, NULL },
+    { "cpus",          NULL, NULL, NULL, NULL, e_cpus,           napi_enumerable, NULL },
+    { "affinityError", NULL, NULL, NULL, NULL, e_affinity_error, napi_enumerable, NULL },
+    { "lockedBytes",   NULL, NULL, NULL, NULL, e_locked_bytes,   napi_enumerable, NULL },
+    { "memoryError",   NULL, NULL, NULL, NULL, e_memory_error,   napi_enumerable, NULL },
+    { "jitter",        NULL, NULL, NULL, NULL, e_jitter,         napi_enumerable, NULL },
+  };
+  status = napi_define_properties(env, result, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  return result;
+}
+
+NAPI_MODULE_INIT() {
+  napi_status status;
+  napi_value export_fn;
+
+  // Every environment (the main thread and each worker_thread loading
+  // the addon) gets its own subscriber, they share a single hook thread.
+  uv_once(&subscribers_once, subscribers_init);
+  log_ring_init();
+
+  subscriber* sub = calloc(1, sizeof(subscriber));
+  if (sub == NULL) {
+    napi_fatal_error("NAPI_MODULE_INIT", NAPI_AUTO_LENGTH, "Failed to allocate memory.", NAPI_AUTO_LENGTH);
+  }
+  sub->env = env;
+  sub->event_mask = 0xFFFFFFFF;
+  hotkeys_init(&sub->hotkeys);
+  sequences_init(&sub->sequences);
+  regions_init(&sub->regions);
+
+  status = napi_set_instance_data(env, sub, subscriber_finalize, NULL);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_instance_data");
+
+  status = napi_create_function(env, NULL, 0, AddonStart, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "start", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonStartAsync, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "startAsync", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonStop, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "stop", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonKeyTap, NULL, &export_fn);
   NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
   status = napi_set_named_property(env, exports, "keyTap", export_fn);
   NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
 
-  status = napi_add_env_cleanup_hook(env, AddonCleanUp, NULL);
+  status = napi_create_function(env, NULL, 0, AddonMouseTap, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "mouseTap", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonMouseMove, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "mouseMove", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonMouseWheel, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "mouseWheel", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonInjectKeys, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "injectKeys", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonInjectMousePath, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "injectMousePath", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonInjectText, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "injectText", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonCancelInjection, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "cancelInjection", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonStartRecording, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "startRecording", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonStopRecording, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "stopRecording", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonReplay, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "replay", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonWatchIdle, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "watchIdle", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonUnwatchIdle, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "unwatchIdle", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonSetLogHandler, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "setLogHandler", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonSetLogLevel, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "setLogLevel", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonGetLogCounters, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "getLogCounters", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonStartHeatmap, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "startHeatmap", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonTakeHeatmap, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "takeHeatmap", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonStopHeatmap, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "stopHeatmap", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonGetScreens, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "getScreens", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonSetPaused, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "setPaused", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonSetEventMask, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "setEventMask", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonSetHotkeys, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "setHotkeys", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonSetSequences, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "setSequences", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonSetRegions, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "setRegions", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonGetDropCounters, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "getDropCounters", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonGetMergeCounters, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "getMergeCounters", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonTakeActivity, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "takeActivity", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonSetHookThreadOptions, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "setHookThreadOptions", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonGetHookThreadReport, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "getHookThreadReport", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonIsKeyDown, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "isKeyDown", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonIsMouseButtonDown, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "isMouseButtonDown", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonGetPressedKeys, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "getPressedKeys", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonGetCursor, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "getCursor", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonGetStats, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "getStats", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonSetEventClasses, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "setEventClasses", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_add_env_cleanup_hook(env, AddonCleanUp, sub);
   NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_add_env_cleanup_hook");
 
   return exports;
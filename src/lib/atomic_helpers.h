@@ -0,0 +1,124 @@
+#ifndef ADDON_SRC_ATOMIC_HELPERS_H_
+#define ADDON_SRC_ATOMIC_HELPERS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Minimal set of atomic operations shared between the hook thread and
+// the JS thread. Loads have acquire and stores have release semantics,
+// read-modify-write operations are sequentially consistent. A store
+// followed by a load of another variable needs atomic_fence() between
+// them to not be reordered.
+
+#ifdef _MSC_VER
+#include <windows.h>
+
+static inline uint32_t atomic_load_u32(volatile uint32_t* ptr) {
+  return (uint32_t)InterlockedOr((volatile LONG*)ptr, 0);
+}
+
+static inline void atomic_store_u32(volatile uint32_t* ptr, uint32_t value) {
+  InterlockedExchange((volatile LONG*)ptr, (LONG)value);
+}
+
+static inline bool atomic_cas_u32(volatile uint32_t* ptr, uint32_t expected, uint32_t desired) {
+  return (uint32_t)InterlockedCompareExchange((volatile LONG*)ptr, (LONG)desired, (LONG)expected) == expected;
+}
+
+static inline uint32_t atomic_add_u32(volatile uint32_t* ptr, uint32_t value) {
+  return (uint32_t)InterlockedExchangeAdd((volatile LONG*)ptr, (LONG)value) + value;
+}
+
+static inline void atomic_or_u32(volatile uint32_t* ptr, uint32_t value) {
+  InterlockedOr((volatile LONG*)ptr, (LONG)value);
+}
+
+static inline void atomic_and_u32(volatile uint32_t* ptr, uint32_t value) {
+  InterlockedAnd((volatile LONG*)ptr, (LONG)value);
+}
+
+static inline uint64_t atomic_load_u64(volatile uint64_t* ptr) {
+  return (uint64_t)InterlockedOr64((volatile LONG64*)ptr, 0);
+}
+
+static inline void atomic_store_u64(volatile uint64_t* ptr, uint64_t value) {
+  InterlockedExchange64((volatile LONG64*)ptr, (LONG64)value);
+}
+
+static inline uint64_t atomic_add_u64(volatile uint64_t* ptr, uint64_t value) {
+  return (uint64_t)InterlockedExchangeAdd64((volatile LONG64*)ptr, (LONG64)value) + value;
+}
+
+static inline uint64_t atomic_exchange_u64(volatile uint64_t* ptr, uint64_t value) {
+  return (uint64_t)InterlockedExchange64((volatile LONG64*)ptr, (LONG64)value);
+}
+
+static inline void* atomic_load_ptr(void* volatile* ptr) {
+  return InterlockedCompareExchangePointer(ptr, NULL, NULL);
+}
+
+static inline void* atomic_exchange_ptr(void* volatile* ptr, void* value) {
+  return InterlockedExchangePointer(ptr, value);
+}
+
+static inline void atomic_fence() {
+  MemoryBarrier();
+}
+
+#else
+
+static inline uint32_t atomic_load_u32(volatile uint32_t* ptr) {
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void atomic_store_u32(volatile uint32_t* ptr, uint32_t value) {
+  __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+static inline bool atomic_cas_u32(volatile uint32_t* ptr, uint32_t expected, uint32_t desired) {
+  return __atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t atomic_add_u32(volatile uint32_t* ptr, uint32_t value) {
+  return __atomic_add_fetch(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline void atomic_or_u32(volatile uint32_t* ptr, uint32_t value) {
+  __atomic_or_fetch(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline void atomic_and_u32(volatile uint32_t* ptr, uint32_t value) {
+  __atomic_and_fetch(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline uint64_t atomic_load_u64(volatile uint64_t* ptr) {
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void atomic_store_u64(volatile uint64_t* ptr, uint64_t value) {
+  __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+static inline uint64_t atomic_add_u64(volatile uint64_t* ptr, uint64_t value) {
+  return __atomic_add_fetch(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline uint64_t atomic_exchange_u64(volatile uint64_t* ptr, uint64_t value) {
+  return __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline void* atomic_load_ptr(void* volatile* ptr) {
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void* atomic_exchange_ptr(void* volatile* ptr, void* value) {
+  return __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline void atomic_fence() {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+#endif
+
+#endif // !ADDON_SRC_ATOMIC_HELPERS_H_
@@ -0,0 +1,90 @@
+#include "event_objects.h"
+#include "hotkeys.h"
+#include "napi_helpers.h"
+#include "regions.h"
+#include "sequences.h"
+#include "uiohook_worker.h"
+
+napi_value uiohook_to_js_event(napi_env env, napi_value* classes, uiohook_event* event) {
+  napi_status status;
+
+  napi_value argv[7];
+  size_t argc;
+  event_class kind;
+
+  status = napi_create_uint32(env, event->type, &argv[0]);
+  NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_uint32");
+
+  status = napi_create_double(env, (double)event->time, &argv[1]);
+  NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_double");
+
+  if (event->type == EVENT_HOTKEY) {
+    status = napi_create_uint32(env, HOTKEY_EVENT_ID(event), &argv[2]);
+    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_uint32");
+
+    kind = event_class_hotkey;
+    argc = 3;
+  }
+  else if (event->type == EVENT_SEQUENCE) {
+    status = napi_create_uint32(env, SEQUENCE_EVENT_ID(event), &argv[2]);
+    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_uint32");
+
+    status = napi_create_uint32(env, event->reserved, &argv[3]);
+    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_uint32");
+
+    kind = event_class_sequence;
+    argc = 4;
+  }
+  else {
+    // mask | region id or key repeat << 16
+    status = napi_create_uint32(env, event->mask | ((uint32_t)REGION_EVENT_ID(event) << 16), &argv[2]);
+    NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_uint32");
+
+    if (event->type == EVENT_KEY_PRESSED || event->type == EVENT_KEY_RELEASED) {
+      status = napi_create_uint32(env, event->data.keyboard.keycode, &argv[3]);
+      NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_uint32");
+
+      kind = event_class_keyboard;
+      argc = 4;
+    }
+    else if (event->type == EVENT_MOUSE_WHEEL) {
+      status = napi_create_int32(env, event->data.wheel.x, &argv[3]);
+      NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_int32");
+
+      status = napi_create_int32(env, event->data.wheel.y, &argv[4]);
+      NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_int32");
+
+      status = napi_create_uint32(env, event->data.wheel.direction, &argv[5]);
+      NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_uint32");
+
+      // clicks | amount << 16 | (rotation + 0x8000) << 32, exact in a double
+      double packed = (double)event->data.wheel.clicks +
+        (double)event->data.wheel.amount * 65536.0 +
+        (double)(event->data.wheel.rotation + 0x8000) * 4294967296.0;
+      status = napi_create_double(env, packed, &argv[6]);
+      NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_double");
+
+      kind = event_class_wheel;
+      argc = 7;
+    }
+    else {
+      status = napi_create_int32(env, event->data.mouse.x, &argv[3]);
+      NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_int32");
+
+      status = napi_create_int32(env, event->data.mouse.y, &argv[4]);
+      NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_int32");
+
+      // button | clicks << 16
+      status = napi_create_uint32(env, event->data.mouse.button | ((uint32_t)event->data.mouse.clicks << 16), &argv[5]);
+      NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_create_uint32");
+
+      kind = event_class_mouse;
+      argc = 6;
+    }
+  }
+
+  napi_value event_obj;
+  status = napi_new_instance(env, classes[kind], argc, argv, &event_obj);
+  NAPI_FATAL_IF_FAILED(status, "uiohook_to_js_event", "napi_new_instance");
+  return event_obj;
+}
@@ -0,0 +1,23 @@
+#ifndef ADDON_SRC_EVENT_OBJECTS_H_
+#define ADDON_SRC_EVENT_OBJECTS_H_
+
+#include <node_api.h>
+#include <uiohook.h>
+
+// Event objects are created by JS constructors registered with setEventClasses,
+// so every object of a kind gets the same shape and property names are
+// never looked up from C strings. Rarely read fields are packed into a
+// single value and decoded by getters on the JS side.
+typedef enum {
+  event_class_keyboard,
+  event_class_mouse,
+  event_class_wheel,
+  event_class_hotkey,
+  event_class_sequence,
+  event_class_count
+} event_class;
+
+// `classes` holds a constructor for every event_class.
+napi_value uiohook_to_js_event(napi_env env, napi_value* classes, uiohook_event* event);
+
+#endif // !ADDON_SRC_EVENT_OBJECTS_H_
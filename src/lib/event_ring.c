@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <string.h>
+#include <uv.h>
+
+#include "atomic_helpers.h"
+#include "event_ring.h"
+
+// Slot flags, stored in the low bits of the slot state next to the
+// ring position, so a stale position can never claim a reused slot.
+#define SLOT_READY   1
+#define SLOT_CLAIMED 2
+#define SLOT_WRITING 3 // the producer merges an event into this slot
+
+#define SLOT_STATE(position, flag) (((position) << 2) | (flag))
+
+static bool is_mouse_move(const uiohook_event* event) {
+  return event->type == EVENT_MOUSE_MOVED || event->type == EVENT_MOUSE_DRAGGED;
+}
+
+int event_ring_init(event_ring* ring, uint32_t capacity, event_ring_overflow overflow, uint32_t block_timeout) {
+  uint32_t size = 2;
+  while (size < capacity && size < (1u << 24)) {
+    size <<= 1;
+  }
+
+  memset(ring, 0, sizeof(event_ring));
+  ring->slots = calloc(size, sizeof(event_ring_slot));
+  if (ring->slots == NULL) return -1;
+
+  ring->mask = size - 1;
+  ring->overflow = overflow;
+  ring->block_timeout = block_timeout;
+  return 0;
+}
+
+void event_ring_destroy(event_ring* ring) {
+  free(ring->slots);
+  ring->slots = NULL;
+}
+
+void event_ring_coalesce(event_ring* ring, uint32_t window, bool wheel) {
+  ring->coalesce_window = window;
+  ring->coalesce_wheel = wheel;
+}
+
+static bool can_merge(event_ring* ring, const uiohook_event* last, const uiohook_event* event) {
+  if (last->type != event->type || last->reserved != event->reserved) return false;
+
+  if (ring->coalesce_window != EVENT_RING_COALESCE_UNTIL_DRAIN &&
+      event->time - ring->coalesce_since > ring->coalesce_window) return false;
+
+  if (is_mouse_move(event)) return true;
+
+  return event->type == EVENT_MOUSE_WHEEL && ring->coalesce_wheel &&
+    last->data.wheel.direction == event->data.wheel.direction &&
+    last->data.wheel.type == event->data.wheel.type &&
+    (last->data.wheel.rotation < 0) == (event->data.wheel.rotation < 0);
+}
+
+// Tries to merge the event into the last queued one, which must not be
+// taken by the consumer yet.
+static bool event_ring_merge(event_ring* ring, const uiohook_event* event, uint32_t head) {
+  uint32_t last = head - 1;
+  event_ring_slot* slot = &ring->slots[last & ring->mask];
+
+  if (!atomic_cas_u32(&slot->state, SLOT_STATE(last, SLOT_READY), SLOT_STATE(last, SLOT_WRITING)))
+    return false;
+
+  bool merged = can_merge(ring, &slot->event, event);
+  if (merged) {
+    uiohook_event* queued = &slot->event;
+    queued->time = event->time;
+    queued->mask = event->mask;
+    if (event->type == EVENT_MOUSE_WHEEL) {
+      queued->data.wheel.x = event->data.wheel.x;
+      queued->data.wheel.y = event->data.wheel.y;
+      queued->data.wheel.rotation += event->data.wheel.rotation;
+      atomic_add_u64(&ring->merged_wheel, 1);
+    }
+    else {
+      queued->data.mouse = event->data.mouse;
+      atomic_add_u64(&ring->merged_mouse_move, 1);
+    }
+  }
+
+  atomic_store_u32(&slot->state, SLOT_STATE(last, SLOT_READY));
+  return merged;
+}
+
+// Called by the producer when the ring is full, returns true if
+// there is a free slot at `head` afterwards.
+static bool event_ring_make_room(event_ring* ring, const uiohook_event* event, uint32_t head) {
+  switch (ring->overflow) {
+  case EVENT_RING_DROP_MOUSE_MOVE: {
+    // Find the oldest queued mouse move, the event being merged into is
+    // the last one and the producer is the only one to merge.
+    uint32_t tail = atomic_load_u32(&ring->tail);
+    uint32_t evicted = tail;
+    while (evicted != head && !is_mouse_move(&ring->slots[evicted & ring->mask].event)) {
+      evicted++;
+    }
+    if (evicted == head) return false;
+
+    // Claim the oldest slot the same way the consumer does, it then waits
+    // for the tail to move and doesn't read the slots after it. If the
+    // consumer got it first, don't wait for it to move the tail: the hook
+    // thread must never spin on the JS thread.
+    event_ring_slot* slot = &ring->slots[tail & ring->mask];
+    if (!atomic_cas_u32(&slot->state, SLOT_STATE(tail, SLOT_READY), SLOT_STATE(tail, SLOT_CLAIMED)))
+      return head - atomic_load_u32(&ring->tail) <= ring->mask;
+
+    // Move the events queued before the evicted one up by a slot, so the
+    // order is kept and the slot at the tail becomes free.
+    for (uint32_t position = evicted; position != tail; position--) {
+      event_ring_slot* to = &ring->slots[position & ring->mask];
+      const event_ring_slot* from = &ring->slots[(position - 1) & ring->mask];
+      to->event = from->event;
+      to->times = from->times;
+    }
+    atomic_store_u32(&ring->tail, tail + 1);
+    atomic_add_u64(&ring->dropped_mouse_move, 1);
+    return true;
+  }
+  case EVENT_RING_BLOCK: {
+    // Sleep instead of spinning, the hook thread may run with a realtime
+    // priority and would starve the consumer on a single core.
+    uint64_t deadline = uv_hrtime() + (uint64_t)ring->block_timeout * 1000000;
+    while (uv_hrtime() < deadline) {
+      uv_sleep(1);
+      if (head - atomic_load_u32(&ring->tail) <= ring->mask) return true;
+    }
+    return false;
+  }
+  case EVENT_RING_DROP_NEWEST:
+  default:
+    return false;
+  }
+}
+
+bool event_ring_push(event_ring* ring, const uiohook_event* event, uint64_t captured) {
+  uint32_t head = ring->head;
+
+  if (ring->coalesce_window != 0 &&
+      (is_mouse_move(event) || (event->type == EVENT_MOUSE_WHEEL && ring->coalesce_wheel)) &&
+      event_ring_merge(ring, event, head)) {
+    return true;
+  }
+
+  if (head - atomic_load_u32(&ring->tail) > ring->mask) {
+    if (!event_ring_make_room(ring, event, head)) {
+      atomic_add_u64(is_mouse_move(event) ? &ring->dropped_mouse_move : &ring->dropped_other, 1);
+      return false;
+    }
+  }
+
+  event_ring_slot* slot = &ring->slots[head & ring->mask];
+  slot->event = *event;
+  slot->times.captured = captured;
+  slot->times.enqueued = captured ? uv_hrtime() : 0;
+  ring->coalesce_since = event->time;
+  atomic_store_u32(&slot->state, SLOT_STATE(head, SLOT_READY));
+  atomic_store_u32(&ring->head, head + 1);
+  return true;
+}
+
+bool event_ring_pop(event_ring* ring, uiohook_event* event, event_ring_times* times) {
+  for (;;) {
+    uint32_t tail = atomic_load_u32(&ring->tail);
+    if (tail == atomic_load_u32(&ring->head)) return false;
+
+    event_ring_slot* slot = &ring->slots[tail & ring->mask];
+    if (atomic_cas_u32(&slot->state, SLOT_STATE(tail, SLOT_READY), SLOT_STATE(tail, SLOT_CLAIMED))) {
+      *event = slot->event;
+      if (times != NULL) *times = slot->times;
+      atomic_store_u32(&ring->tail, tail + 1);
+      return true;
+    }
+
+    // The producer has just evicted this slot and is about to move
+    // the tail, or is merging a new event into it.
+  }
+}
+
+uint32_t event_ring_size(event_ring* ring) {
+  return atomic_load_u32(&ring->head) - atomic_load_u32(&ring->tail);
+}
@@ -0,0 +1,74 @@
+#ifndef ADDON_SRC_EVENT_RING_H_
+#define ADDON_SRC_EVENT_RING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <uiohook.h>
+
+#define EVENT_RING_DEFAULT_CAPACITY 4096
+
+// Merge into the last queued event for as long as it hasn't been taken by the consumer.
+#define EVENT_RING_COALESCE_UNTIL_DRAIN 0xFFFFFFFF
+
+typedef enum {
+  // Drop the event that doesn't fit.
+  EVENT_RING_DROP_NEWEST = 0,
+  // Evict the oldest queued mouse move, the events queued before it
+  // keep their order. Drop the new event if there is no mouse move.
+  EVENT_RING_DROP_MOUSE_MOVE = 1,
+  // Wait up to `block_timeout` ms for the consumer, then drop the new event.
+  EVENT_RING_BLOCK = 2
+} event_ring_overflow;
+
+// uv_hrtime() when the event reached the hook thread and the ring,
+// both are 0 when the producer doesn't measure latency.
+typedef struct {
+  uint64_t captured;
+  uint64_t enqueued;
+} event_ring_times;
+
+typedef struct {
+  volatile uint32_t state; // (position << 2) | slot flag
+  uiohook_event event;
+  event_ring_times times;
+} event_ring_slot;
+
+// Fixed-capacity queue with one producer (the hook thread) and one
+// consumer (the JS thread). Slots are allocated once in event_ring_init().
+typedef struct {
+  event_ring_slot* slots;
+  uint32_t mask;
+  event_ring_overflow overflow;
+  uint32_t block_timeout;
+  volatile uint32_t head;
+  char _pad[64];
+  volatile uint32_t tail;
+  volatile uint64_t dropped_mouse_move;
+  volatile uint64_t dropped_other;
+  uint32_t coalesce_window; // ms, 0 - disabled
+  bool coalesce_wheel;
+  uint64_t coalesce_since; // time of the first event merged into the last slot
+  volatile uint64_t merged_mouse_move;
+  volatile uint64_t merged_wheel;
+} event_ring;
+
+int event_ring_init(event_ring* ring, uint32_t capacity, event_ring_overflow overflow, uint32_t block_timeout);
+
+void event_ring_destroy(event_ring* ring);
+
+// Consecutive mouse moves (and wheel events in the same direction) that
+// are no more than `window` ms apart from the first one are merged
+// into a single queued event.
+void event_ring_coalesce(event_ring* ring, uint32_t window, bool wheel);
+
+// Producer side. Returns false if the event was dropped.
+// Never reorders events, only the last queued event can be merged into,
+// a merged event keeps the times of the first one.
+bool event_ring_push(event_ring* ring, const uiohook_event* event, uint64_t captured);
+
+// Consumer side. Returns false if the ring is empty, `times` may be NULL.
+bool event_ring_pop(event_ring* ring, uiohook_event* event, event_ring_times* times);
+
+uint32_t event_ring_size(event_ring* ring);
+
+#endif // !ADDON_SRC_EVENT_RING_H_
@@ -0,0 +1,74 @@
+#include <string.h>
+#include "atomic_helpers.h"
+#include "event_stream.h"
+#include "hotkeys.h"
+#include "regions.h"
+#include "sequences.h"
+#include "uiohook_worker.h"
+
+int event_stream_init(event_stream* stream, void* data, size_t length) {
+  if (length <= EVENT_STREAM_HEADER_WORDS) return -1;
+
+  size_t capacity = (length - EVENT_STREAM_HEADER_WORDS) / EVENT_STREAM_RECORD_WORDS;
+  if (capacity == 0 || capacity > (1u << 24) || (capacity & (capacity - 1)) != 0) return -1;
+
+  stream->data = data;
+  stream->mask = (uint32_t)capacity - 1;
+
+  memset(data, 0, EVENT_STREAM_HEADER_WORDS * sizeof(uint32_t));
+  stream->data[EVENT_STREAM_CAPACITY] = (uint32_t)capacity;
+  return 0;
+}
+
+bool event_stream_push(event_stream* stream, const uiohook_event* event) {
+  volatile uint32_t* data = stream->data;
+
+  uint32_t head = data[EVENT_STREAM_HEAD];
+  if (head - atomic_load_u32(&data[EVENT_STREAM_TAIL]) > stream->mask) {
+    atomic_add_u32(&data[EVENT_STREAM_DROPPED], 1);
+    return false;
+  }
+
+  volatile uint32_t* record = &data[EVENT_STREAM_HEADER_WORDS + (head & stream->mask) * EVENT_STREAM_RECORD_WORDS];
+  record[0] = event->type;
+  record[1] = event->mask | ((uint32_t)REGION_EVENT_ID(event) << 16);
+  record[2] = (uint32_t)(event->time & 0xFFFFFFFF);
+  record[3] = (uint32_t)(event->time >> 32);
+
+  switch ((unsigned int)event->type) {
+  case EVENT_KEY_PRESSED:
+  case EVENT_KEY_RELEASED:
+    record[4] = event->data.keyboard.keycode;
+    break;
+  case EVENT_MOUSE_CLICKED:
+  case EVENT_MOUSE_PRESSED:
+  case EVENT_MOUSE_RELEASED:
+  case EVENT_MOUSE_MOVED:
+  case EVENT_REGION_ENTER:
+  case EVENT_REGION_LEAVE:
+    record[4] = (uint32_t)(int32_t)event->data.mouse.x;
+    record[5] = (uint32_t)(int32_t)event->data.mouse.y;
+    record[6] = event->data.mouse.button;
+    record[7] = event->data.mouse.clicks;
+    break;
+  case EVENT_MOUSE_WHEEL:
+    record[4] = (uint32_t)(int32_t)event->data.wheel.x;
+    record[5] = (uint32_t)(int32_t)event->data.wheel.y;
+    record[6] = event->data.wheel.clicks;
+    record[7] = event->data.wheel.amount;
+    record[8] = event->data.wheel.direction;
+    record[9] = (uint32_t)(int32_t)event->data.wheel.rotation;
+    break;
+  case EVENT_HOTKEY:
+    record[4] = HOTKEY_EVENT_ID(event);
+    break;
+  case EVENT_SEQUENCE:
+    record[4] = SEQUENCE_EVENT_ID(event);
+    break;
+  default:
+    break;
+  }
+
+  atomic_store_u32(&data[EVENT_STREAM_HEAD], head + 1);
+  return true;
+}
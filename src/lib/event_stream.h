@@ -0,0 +1,37 @@
+#ifndef ADDON_SRC_EVENT_STREAM_H_
+#define ADDON_SRC_EVENT_STREAM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <uiohook.h>
+
+// Layout of the shared Int32Array, in 32-bit words. Must be kept
+// in sync with UiohookEventStream in index.ts.
+#define EVENT_STREAM_HEAD         0 // next record to write, owned by the hook thread
+#define EVENT_STREAM_TAIL         1 // next record to read, owned by JS
+#define EVENT_STREAM_CAPACITY     2
+#define EVENT_STREAM_DROPPED      3
+#define EVENT_STREAM_HEADER_WORDS 4
+
+// Record: type, mask | region id, key repeat or sequence length << 16, time (low, high)
+// and up to 6 payload words
+// keyboard: keycode
+// mouse:    x, y, button, clicks (region enter and leave: x, y)
+// wheel:    x, y, clicks, amount, direction, rotation
+// hotkey:   id
+// sequence: id
+#define EVENT_STREAM_RECORD_WORDS 10
+
+typedef struct {
+  volatile uint32_t* data;
+  uint32_t mask;
+} event_stream;
+
+// `data` must hold the header and a power of two number of records.
+int event_stream_init(event_stream* stream, void* data, size_t length);
+
+// Hook thread side. Returns false if the event was dropped.
+bool event_stream_push(event_stream* stream, const uiohook_event* event);
+
+#endif // !ADDON_SRC_EVENT_STREAM_H_
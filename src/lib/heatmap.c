@@ -0,0 +1,67 @@
+#include <string.h>
+#include "atomic_helpers.h"
+#include "heatmap.h"
+
+int heatmap_init(heatmap* map, uint32_t* cells, size_t length, int32_t left, int32_t top,
+                 uint32_t cell_size, uint32_t columns, uint32_t rows) {
+  if (cell_size == 0 || columns == 0 || rows == 0) return -1;
+  if ((uint64_t)columns * rows > HEATMAP_MAX_CELLS || length != 4 * (size_t)columns * rows) return -1;
+
+  memset(map, 0, sizeof(heatmap));
+  map->cells = cells;
+  map->left = left;
+  map->top = top;
+  map->cell_size = cell_size;
+  map->columns = columns;
+  map->rows = rows;
+
+  memset(cells, 0, length * sizeof(uint32_t));
+  return 0;
+}
+
+void heatmap_push(heatmap* map, const uiohook_event* event) {
+  bool is_press;
+  switch (event->type) {
+  case EVENT_MOUSE_MOVED:
+  case EVENT_MOUSE_DRAGGED:
+    is_press = false;
+    break;
+  case EVENT_MOUSE_PRESSED:
+    is_press = true;
+    break;
+  default:
+    return;
+  }
+
+  int32_t x = (int32_t)event->data.mouse.x - map->left;
+  int32_t y = (int32_t)event->data.mouse.y - map->top;
+  if (x < 0 || y < 0) return;
+  uint32_t column = (uint32_t)x / map->cell_size;
+  uint32_t row = (uint32_t)y / map->cell_size;
+  if (column >= map->columns || row >= map->rows) return;
+
+  size_t plane = (size_t)map->columns * map->rows;
+
+  atomic_add_u32(&map->writer_seq, 1);
+  uint32_t half = atomic_load_u32(&map->active);
+  map->cells[plane * (2 * half + (is_press ? 1 : 0)) + row * map->columns + column]++;
+  atomic_add_u32(&map->writer_seq, 1);
+}
+
+uint32_t heatmap_swap(heatmap* map) {
+  size_t plane = (size_t)map->columns * map->rows;
+  uint32_t taken = atomic_load_u32(&map->active);
+  uint32_t next = taken ^ 1;
+
+  memset((uint32_t*)&map->cells[plane * 2 * next], 0, plane * 2 * sizeof(uint32_t));
+  // Sequentially consistent, the hook thread either sees the new half or
+  // is seen counting below.
+  atomic_cas_u32(&map->active, taken, next);
+
+  // Wait for the hook thread to finish a count into the taken half.
+  uint32_t seq = atomic_load_u32(&map->writer_seq);
+  if (seq & 1) {
+    while (atomic_load_u32(&map->writer_seq) == seq) {}
+  }
+  return taken;
+}
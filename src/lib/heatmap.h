@@ -0,0 +1,39 @@
+#ifndef ADDON_SRC_HEATMAP_H_
+#define ADDON_SRC_HEATMAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <uiohook.h>
+
+// Mouse positions and button presses counted per grid cell by the hook
+// thread, directly in a buffer shared with JS. The buffer holds two
+// halves, the hook thread counts into one while JS reads the other, and
+// swapping them is the only synchronization. Each half is the move
+// counters followed by the press counters, row by row.
+
+#define HEATMAP_MAX_CELLS (1 << 22)
+
+typedef struct {
+  volatile uint32_t* cells;
+  int32_t left;
+  int32_t top;
+  uint32_t cell_size; // px
+  uint32_t columns;
+  uint32_t rows;
+  volatile uint32_t active; // half the hook thread counts into
+  volatile uint32_t writer_seq; // odd while the hook thread counts
+} heatmap;
+
+// `length` must be 4 * columns * rows, counting starts in half 0.
+int heatmap_init(heatmap* map, uint32_t* cells, size_t length, int32_t left, int32_t top,
+                 uint32_t cell_size, uint32_t columns, uint32_t rows);
+
+// Hook thread side.
+void heatmap_push(heatmap* map, const uiohook_event* event);
+
+// Clears the inactive half and switches counting to it. Returns the half
+// counted into so far, it is not written until the next swap.
+uint32_t heatmap_swap(heatmap* map);
+
+#endif // !ADDON_SRC_HEATMAP_H_
@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <string.h>
+#include "atomic_helpers.h"
+#include "hotkeys.h"
+
+// Chords are stored as a trie, each transition (state, stroke) -> state
+// is an entry in an open addressing hash table, so matching a key press
+// is a single lookup.
+
+typedef struct {
+  uint64_t key; // (state << 32) | stroke, 0 - empty
+  uint32_t next; // state after this stroke, 0 if no chord continues with it
+  uint32_t id;
+  bool is_hotkey;
+} hotkey_entry;
+
+struct hotkey_table {
+  uint32_t generation;
+  uint32_t mask;
+  hotkey_entry entries[1];
+};
+
+static uint32_t hash_key(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xFF51AFD7ED558CCDull;
+  key ^= key >> 33;
+  return (uint32_t)key;
+}
+
+static hotkey_entry* table_find(hotkey_table* table, uint64_t key, bool insert) {
+  for (uint32_t i = hash_key(key) & table->mask;; i = (i + 1) & table->mask) {
+    hotkey_entry* entry = &table->entries[i];
+    if (entry->key == key) return entry;
+    if (entry->key == 0) {
+      if (!insert) return NULL;
+      entry->key = key;
+      return entry;
+    }
+  }
+}
+
+static uint64_t make_key(uint32_t state, uint32_t stroke) {
+  // +1 so the root state never produces an empty key
+  return ((uint64_t)(state + 1) << 32) | stroke;
+}
+
+void hotkeys_init(hotkey_matcher* matcher) {
+  memset(matcher, 0, sizeof(hotkey_matcher));
+}
+
+void hotkeys_destroy(hotkey_matcher* matcher) {
+  free(matcher->active_table);
+  matcher->active_table = NULL;
+}
+
+int hotkeys_set(hotkey_matcher* matcher, const uint32_t* data, size_t length) {
+  hotkey_table* table = NULL;
+
+  if (length != 0) {
+    // Validate and count strokes to size the table.
+    size_t strokes = 0;
+    for (size_t i = 0; i < length;) {
+      if (i + 2 > length) return -1;
+      uint32_t count = data[i + 1];
+      if (count == 0 || count > HOTKEY_MAX_STROKES || i + 2 + count > length) return -1;
+      strokes += count;
+      i += 2 + count;
+    }
+
+    uint32_t size = 16;
+    while (size < strokes * 2) {
+      size <<= 1;
+    }
+
+    table = calloc(1, sizeof(hotkey_table) + (size - 1) * sizeof(hotkey_entry));
+    if (table == NULL) return -1;
+    table->generation = ++matcher->table_generation;
+    table->mask = size - 1;
+
+    uint32_t state_count = 0;
+    for (size_t i = 0; i < length;) {
+      uint32_t id = data[i];
+      uint32_t count = data[i + 1];
+      const uint32_t* chord = &data[i + 2];
+      i += 2 + count;
+
+      uint32_t state = 0;
+      for (uint32_t s = 0; s < count; s++) {
+        hotkey_entry* entry = table_find(table, make_key(state, chord[s]), true);
+        if (s + 1 == count) {
+          entry->is_hotkey = true;
+          entry->id = id;
+        }
+        else {
+          if (entry->next == 0) {
+            entry->next = ++state_count;
+          }
+          state = entry->next;
+        }
+      }
+    }
+  }
+
+  // Tables are immutable once published, the JS thread builds a new one
+  // and swaps the pointer. The hook thread keeps reader_seq odd while it
+  // reads a table, so once it changes the old table can be freed.
+  hotkey_table* old_table = atomic_exchange_ptr((void* volatile*)&matcher->active_table, table);
+
+  // Wait for the hook thread to leave the old table.
+  uint32_t seq = atomic_load_u32(&matcher->reader_seq);
+  if (seq & 1) {
+    while (atomic_load_u32(&matcher->reader_seq) == seq) {}
+  }
+  free(old_table);
+  return 0;
+}
+
+bool hotkey_is_modifier_key(uint16_t keycode) {
+  switch (keycode) {
+  case VC_SHIFT_L:
+  case VC_SHIFT_R:
+  case VC_CONTROL_L:
+  case VC_CONTROL_R:
+  case VC_ALT_L:
+  case VC_ALT_R:
+  case VC_META_L:
+  case VC_META_R:
+    return true;
+  default:
+    return false;
+  }
+}
+
+uint32_t hotkey_event_stroke(const uiohook_event* event) {
+  uint32_t modifiers = 0;
+  if (event->mask & MASK_CTRL) modifiers |= HOTKEY_CTRL;
+  if (event->mask & MASK_SHIFT) modifiers |= HOTKEY_SHIFT;
+  if (event->mask & MASK_ALT) modifiers |= HOTKEY_ALT;
+  if (event->mask & MASK_META) modifiers |= HOTKEY_META;
+  return HOTKEY_STROKE(event->data.keyboard.keycode, modifiers);
+}
+
+bool hotkeys_match(hotkey_matcher* matcher, const uiohook_event* event, uint32_t* id) {
+  if (hotkey_is_modifier_key(event->data.keyboard.keycode)) return false;
+
+  atomic_add_u32(&matcher->reader_seq, 1);
+
+  hotkey_table* table = atomic_load_ptr((void* volatile*)&matcher->active_table);
+  hotkey_entry* entry = NULL;
+  if (table != NULL) {
+    if (table->generation != matcher->chord_generation || event->time - matcher->chord_time > HOTKEY_CHORD_TIMEOUT) {
+      matcher->chord_generation = table->generation;
+      matcher->chord_state = 0;
+    }
+
+    uint32_t stroke = hotkey_event_stroke(event);
+    entry = table_find(table, make_key(matcher->chord_state, stroke), false);
+    if (entry == NULL && matcher->chord_state != 0) {
+      // The chord is broken, the key may start another one.
+      entry = table_find(table, make_key(0, stroke), false);
+    }
+  }
+
+  bool matched = false;
+  if (entry == NULL) {
+    matcher->chord_state = 0;
+  }
+  else if (entry->is_hotkey) {
+    // A complete hotkey wins over longer chords starting with it.
+    *id = entry->id;
+    matched = true;
+    matcher->chord_state = 0;
+  }
+  else {
+    matcher->chord_state = entry->next;
+    matcher->chord_time = event->time;
+  }
+
+  atomic_add_u32(&matcher->reader_seq, 1);
+  return matched;
+}
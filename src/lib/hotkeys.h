@@ -0,0 +1,61 @@
+#ifndef ADDON_SRC_HOTKEYS_H_
+#define ADDON_SRC_HOTKEYS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <uiohook.h>
+
+// Side-insensitive modifiers of a hotkey stroke.
+#define HOTKEY_CTRL  (1 << 0)
+#define HOTKEY_SHIFT (1 << 1)
+#define HOTKEY_ALT   (1 << 2)
+#define HOTKEY_META  (1 << 3)
+
+#define HOTKEY_STROKE(keycode, modifiers) ((uint32_t)(keycode) | ((uint32_t)(modifiers) << 16))
+
+// EVENT_HOTKEY carries the id in the keyboard data.
+#define HOTKEY_EVENT_SET_ID(event, id) \
+  do { \
+    (event)->data.keyboard.keycode = (uint16_t)((id) & 0xFFFF); \
+    (event)->data.keyboard.rawcode = (uint16_t)((id) >> 16); \
+  } while (0)
+#define HOTKEY_EVENT_ID(event) \
+  ((uint32_t)(event)->data.keyboard.keycode | ((uint32_t)(event)->data.keyboard.rawcode << 16))
+
+#define HOTKEY_MAX_STROKES 8
+#define HOTKEY_CHORD_TIMEOUT 2000 // ms between strokes of a chord
+
+typedef struct hotkey_table hotkey_table;
+
+typedef struct {
+  hotkey_table* volatile active_table;
+  uint32_t table_generation;
+  volatile uint32_t reader_seq; // odd while the hook thread reads the active table
+  // Hook thread state
+  uint32_t chord_generation;
+  uint32_t chord_state;
+  uint64_t chord_time;
+} hotkey_matcher;
+
+void hotkeys_init(hotkey_matcher* matcher);
+
+// The hook thread must not use the matcher anymore.
+void hotkeys_destroy(hotkey_matcher* matcher);
+
+// Replaces all registered hotkeys. `data` is a sequence of
+// [id, stroke count, strokes...], see HOTKEY_STROKE().
+// Called from the JS thread, safe while the hook is running.
+int hotkeys_set(hotkey_matcher* matcher, const uint32_t* data, size_t length);
+
+// Modifier keys are part of strokes, never strokes themselves.
+bool hotkey_is_modifier_key(uint16_t keycode);
+
+// The stroke of a key press, see HOTKEY_STROKE().
+uint32_t hotkey_event_stroke(const uiohook_event* event);
+
+// Matches a key press against registered hotkeys, called from the hook
+// thread. Returns true and the id when the last stroke of a hotkey matches.
+bool hotkeys_match(hotkey_matcher* matcher, const uiohook_event* event, uint32_t* id);
+
+#endif // !ADDON_SRC_HOTKEYS_H_
@@ -0,0 +1,116 @@
+#include <string.h>
+
+#include "atomic_helpers.h"
+#include "idle.h"
+#include "uiohook_worker.h"
+
+#define NS_PER_MS 1000000
+
+static void idle_proc(void* arg) {
+  idle_detector* detector = arg;
+
+  uv_mutex_lock(&detector->mutex);
+  while (detector->running) {
+    uint64_t last_input = atomic_load_u64(&detector->last_input);
+    uint32_t level = detector->level;
+
+    if (level != 0 && last_input != detector->idle_since) {
+      atomic_store_u32(&detector->level, 0);
+      detector->callback(detector->data, false, 0, (last_input - detector->idle_since) / NS_PER_MS);
+      continue;
+    }
+
+    uint64_t now = uv_hrtime();
+    uint64_t idle_time = (now > last_input) ? now - last_input : 0;
+    if (level == detector->threshold_count) {
+      uv_cond_wait(&detector->cond, &detector->mutex);
+      continue;
+    }
+
+    uint64_t threshold = (uint64_t)detector->thresholds[level] * NS_PER_MS;
+    if (idle_time < threshold) {
+      uv_cond_timedwait(&detector->cond, &detector->mutex, threshold - idle_time);
+      continue;
+    }
+
+    if (level == 0) {
+      detector->idle_since = last_input;
+    }
+    // Input stored before this is seen by the next iteration, input
+    // stored after sees a non-zero level and wakes the thread.
+    atomic_add_u32(&detector->level, 1);
+    detector->callback(detector->data, true, detector->thresholds[level], idle_time / NS_PER_MS);
+  }
+  uv_mutex_unlock(&detector->mutex);
+}
+
+int idle_detector_start(idle_detector* detector, const uint32_t* thresholds, uint32_t count,
+                        uint32_t jitter, idle_transition_cb callback, void* data) {
+  memset(detector, 0, sizeof(idle_detector));
+  memcpy(detector->thresholds, thresholds, count * sizeof(uint32_t));
+  detector->threshold_count = count;
+  detector->jitter = jitter;
+  detector->callback = callback;
+  detector->data = data;
+  detector->last_input = uv_hrtime();
+  detector->running = true;
+
+  uv_mutex_init(&detector->mutex);
+  uv_cond_init(&detector->cond);
+  if (uv_thread_create(&detector->thread, idle_proc, detector) != 0) {
+    uv_mutex_destroy(&detector->mutex);
+    uv_cond_destroy(&detector->cond);
+    return UIOHOOK_ERROR_THREAD_CREATE;
+  }
+  return UIOHOOK_SUCCESS;
+}
+
+// Mouse moves within `jitter` px of the last counted position are ignored.
+static bool is_input(idle_detector* detector, const uiohook_event* event) {
+  switch (event->type) {
+  case EVENT_KEY_PRESSED:
+  case EVENT_KEY_RELEASED:
+  case EVENT_MOUSE_WHEEL:
+    return true;
+  case EVENT_MOUSE_PRESSED:
+  case EVENT_MOUSE_RELEASED:
+    break;
+  case EVENT_MOUSE_MOVED:
+  case EVENT_MOUSE_DRAGGED: {
+    if (!detector->has_anchor) break;
+    int64_t dx = (int64_t)event->data.mouse.x - detector->anchor_x;
+    int64_t dy = (int64_t)event->data.mouse.y - detector->anchor_y;
+    if (dx * dx + dy * dy <= (int64_t)detector->jitter * detector->jitter) return false;
+    break;
+  }
+  default:
+    return false;
+  }
+
+  detector->has_anchor = true;
+  detector->anchor_x = event->data.mouse.x;
+  detector->anchor_y = event->data.mouse.y;
+  return true;
+}
+
+void idle_detector_push(idle_detector* detector, const uiohook_event* event) {
+  if (!is_input(detector, event)) return;
+
+  atomic_exchange_u64(&detector->last_input, uv_hrtime());
+  if (atomic_load_u32(&detector->level) != 0) {
+    uv_mutex_lock(&detector->mutex);
+    uv_cond_signal(&detector->cond);
+    uv_mutex_unlock(&detector->mutex);
+  }
+}
+
+void idle_detector_stop(idle_detector* detector) {
+  uv_mutex_lock(&detector->mutex);
+  detector->running = false;
+  uv_cond_signal(&detector->cond);
+  uv_mutex_unlock(&detector->mutex);
+
+  uv_thread_join(&detector->thread);
+  uv_mutex_destroy(&detector->mutex);
+  uv_cond_destroy(&detector->cond);
+}
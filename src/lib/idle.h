@@ -0,0 +1,49 @@
+#ifndef ADDON_SRC_IDLE_H_
+#define ADDON_SRC_IDLE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <uiohook.h>
+#include <uv.h>
+
+// Idle detection on native threads. The hook thread only stores the time
+// of the last input, a timer thread sleeps until the next threshold and
+// reports transitions. Going back to active wakes the timer thread once.
+
+#define IDLE_MAX_THRESHOLDS 8
+
+// Called on the timer thread. `idle_time` is ms without input: so far for
+// `idle`, in total for `active`. `threshold` is the one crossed, 0 for `active`.
+typedef void (*idle_transition_cb)(void* data, bool idle, uint32_t threshold, uint64_t idle_time);
+
+typedef struct {
+  uint32_t thresholds[IDLE_MAX_THRESHOLDS]; // ms, ascending
+  uint32_t threshold_count;
+  uint32_t jitter; // px, smaller mouse moves are not input
+  volatile uint64_t last_input; // uv_hrtime()
+  volatile uint32_t level; // thresholds crossed
+  // Hook thread
+  bool has_anchor;
+  int16_t anchor_x;
+  int16_t anchor_y;
+  // Timer thread
+  uv_thread_t thread;
+  uv_mutex_t mutex;
+  uv_cond_t cond;
+  bool running;
+  uint64_t idle_since; // last_input when the first threshold was crossed
+  idle_transition_cb callback;
+  void* data;
+} idle_detector;
+
+// `thresholds` must be ascending, at most IDLE_MAX_THRESHOLDS.
+int idle_detector_start(idle_detector* detector, const uint32_t* thresholds, uint32_t count,
+                        uint32_t jitter, idle_transition_cb callback, void* data);
+
+// Hook thread side.
+void idle_detector_push(idle_detector* detector, const uiohook_event* event);
+
+// No callbacks are made after it returns.
+void idle_detector_stop(idle_detector* detector);
+
+#endif // !ADDON_SRC_IDLE_H_
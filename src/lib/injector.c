@@ -0,0 +1,318 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uv.h>
+
+#include "injector.h"
+#include "uiohook_worker.h"
+
+typedef struct injector_job {
+  struct injector_job* next;
+  injector_step* steps;
+  uint32_t count;
+  void* owner;
+  uint32_t id;
+  bool cancelled;
+  injector_done_cb done;
+  void* data;
+} injector_job;
+
+static uv_once_t injector_once = UV_ONCE_INIT;
+static uv_mutex_t post_mutex;
+// Guards the queue, the running job and `cancelled` of every job.
+static uv_mutex_t injector_mutex;
+static uv_cond_t injector_cond;
+static uv_thread_t injector_thread;
+static bool injector_running = false;
+static injector_job* queue_head = NULL;
+static injector_job* queue_tail = NULL;
+static injector_job* running_job = NULL;
+
+static void injector_init(void) {
+  uv_mutex_init(&post_mutex);
+  uv_mutex_init(&injector_mutex);
+  uv_cond_init(&injector_cond);
+}
+
+void injector_post(uiohook_event* event) {
+  uv_once(&injector_once, injector_init);
+
+  // hook_post_event shares a display connection on X11, which must not
+  // be used from two threads at once.
+  uv_mutex_lock(&post_mutex);
+  hook_post_event(event);
+  uv_mutex_unlock(&post_mutex);
+}
+
+// Keeps track of keys and buttons pressed by the sequence.
+static void held_update(uiohook_event* held, uint32_t* held_count, const uiohook_event* event) {
+  switch (event->type) {
+  case EVENT_KEY_PRESSED:
+  case EVENT_MOUSE_PRESSED:
+    if (*held_count < INJECTOR_MAX_HELD) {
+      held[(*held_count)++] = *event;
+    }
+    break;
+  case EVENT_MOUSE_MOVED:
+    // Buttons are released where the pointer is.
+    for (uint32_t i = 0; i < *held_count; i++) {
+      if (held[i].type == EVENT_MOUSE_PRESSED) {
+        held[i].data.mouse.x = event->data.mouse.x;
+        held[i].data.mouse.y = event->data.mouse.y;
+      }
+    }
+    break;
+  case EVENT_KEY_RELEASED:
+  case EVENT_MOUSE_RELEASED:
+    for (uint32_t i = *held_count; i-- > 0;) {
+      bool same = (event->type == EVENT_KEY_RELEASED)
+        ? (held[i].type == EVENT_KEY_PRESSED && held[i].data.keyboard.keycode == event->data.keyboard.keycode)
+        : (held[i].type == EVENT_MOUSE_PRESSED && held[i].data.mouse.button == event->data.mouse.button);
+      if (same) {
+        memmove(&held[i], &held[i + 1], (*held_count - i - 1) * sizeof(uiohook_event));
+        (*held_count)--;
+        break;
+      }
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+static void held_release(uiohook_event* held, uint32_t held_count) {
+  while (held_count--) {
+    uiohook_event* event = &held[held_count];
+    event->type = (event->type == EVENT_KEY_PRESSED) ? EVENT_KEY_RELEASED : EVENT_MOUSE_RELEASED;
+    injector_post(event);
+  }
+}
+
+void injector_steps_free(injector_step* steps, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    free(steps[i].path);
+  }
+  free(steps);
+}
+
+// Waits on the condition, so cancelling doesn't have to wait for the deadline.
+// Must be called with the mutex held, returns false if the job was cancelled.
+static bool job_wait(injector_job* job, uint64_t deadline) {
+  for (uint64_t now = uv_hrtime(); !job->cancelled && now < deadline; now = uv_hrtime()) {
+    uv_cond_timedwait(&injector_cond, &injector_mutex, deadline - now);
+  }
+  return !job->cancelled;
+}
+
+static void job_post(uiohook_event* event, uiohook_event* held, uint32_t* held_count) {
+  uv_mutex_unlock(&injector_mutex);
+  injector_post(event);
+  held_update(held, held_count, event);
+  uv_mutex_lock(&injector_mutex);
+}
+
+static double path_ease(injector_easing easing, double t) {
+  switch (easing) {
+  case injector_easing_in:
+    return t * t * t;
+  case injector_easing_out:
+    return 1 - (1 - t) * (1 - t) * (1 - t);
+  case injector_easing_in_out:
+    return (t < 0.5) ? 4 * t * t * t : 1 - pow(2 - 2 * t, 3) / 2;
+  case injector_easing_linear:
+  default:
+    return t;
+  }
+}
+
+static double path_segment_length(const injector_path* path, uint32_t segment) {
+  const int16_t* p = &path->points[segment * 2];
+  return hypot((double)p[2] - p[0], (double)p[3] - p[1]);
+}
+
+// Posts moves at a fixed rate, the distance travelled along the path
+// follows the easing curve. Must be called with the mutex held.
+static bool path_run(injector_job* job, const injector_path* path, uiohook_event* held, uint32_t* held_count) {
+  double total = 0;
+  for (uint32_t i = 0; i + 1 < path->count; i++) {
+    total += path_segment_length(path, i);
+  }
+
+  uint32_t moves = (uint32_t)((uint64_t)path->duration * path->rate / 1000);
+  if (moves == 0) moves = 1;
+  uint64_t period = (uint64_t)path->duration * 1000000 / moves;
+  uint64_t start = uv_hrtime();
+
+  uiohook_event event;
+  memset(&event, 0, sizeof(event));
+  event.type = EVENT_MOUSE_MOVED;
+
+  uint32_t segment = 0;
+  double segment_start = 0;
+  double segment_length = (path->count > 1) ? path_segment_length(path, 0) : 0;
+  for (uint32_t i = 0; i <= moves; i++) {
+    // Deadlines are absolute, so the rate doesn't drift with the time spent posting.
+    if (i > 0 && !job_wait(job, start + period * i)) return false;
+
+    double distance = path_ease(path->easing, (double)i / moves) * total;
+    while (segment + 2 < path->count && segment_start + segment_length < distance) {
+      segment_start += segment_length;
+      segment++;
+      segment_length = path_segment_length(path, segment);
+    }
+
+    const int16_t* p = &path->points[segment * 2];
+    double x = p[0], y = p[1];
+    if (segment_length > 0) {
+      double f = fmin(fmax((distance - segment_start) / segment_length, 0), 1);
+      x += (p[2] - p[0]) * f;
+      y += (p[3] - p[1]) * f;
+    }
+
+    int16_t next_x = (int16_t)lround(x);
+    int16_t next_y = (int16_t)lround(y);
+    if (i > 0 && next_x == event.data.mouse.x && next_y == event.data.mouse.y) continue;
+    event.data.mouse.x = next_x;
+    event.data.mouse.y = next_y;
+    job_post(&event, held, held_count);
+  }
+  return true;
+}
+
+static void injector_proc(void* arg) {
+  uiohook_event held[INJECTOR_MAX_HELD];
+
+  uv_mutex_lock(&injector_mutex);
+  for (;;) {
+    while (queue_head == NULL) {
+      uv_cond_wait(&injector_cond, &injector_mutex);
+    }
+
+    injector_job* job = queue_head;
+    queue_head = job->next;
+    if (queue_head == NULL) queue_tail = NULL;
+    running_job = job;
+
+    uint32_t held_count = 0;
+    uint32_t i = 0;
+    // Delays add up to absolute deadlines, so the time spent posting
+    // doesn't slow down long sequences.
+    uint64_t deadline = uv_hrtime();
+    for (; i < job->count && !job->cancelled; i++) {
+      injector_step* step = &job->steps[i];
+      if (step->event.type != 0) {
+        job_post(&step->event, held, &held_count);
+      }
+      if (step->path != NULL) {
+        if (!path_run(job, step->path, held, &held_count)) break;
+        deadline = uv_hrtime();
+      }
+      deadline += (uint64_t)step->delay * 1000;
+      if (!job_wait(job, deadline)) break;
+    }
+    running_job = NULL;
+    uv_mutex_unlock(&injector_mutex);
+
+    bool completed = (i == job->count);
+    if (!completed) {
+      held_release(held, held_count);
+    }
+    job->done(job->data, completed);
+    injector_steps_free(job->steps, job->count);
+    free(job);
+
+    uv_mutex_lock(&injector_mutex);
+  }
+}
+
+int injector_submit(injector_step* steps, uint32_t count, void* owner, uint32_t id,
+                    injector_done_cb done, void* data) {
+  uv_once(&injector_once, injector_init);
+
+  injector_job* job = calloc(1, sizeof(injector_job));
+  if (job == NULL) return UIOHOOK_ERROR_OUT_OF_MEMORY;
+  job->steps = steps;
+  job->count = count;
+  job->owner = owner;
+  job->id = id;
+  job->done = done;
+  job->data = data;
+
+  uv_mutex_lock(&injector_mutex);
+  // The thread is started with the first sequence and then waits for more.
+  if (!injector_running) {
+    if (uv_thread_create(&injector_thread, injector_proc, NULL) != 0) {
+      uv_mutex_unlock(&injector_mutex);
+      free(job);
+      return UIOHOOK_ERROR_THREAD_CREATE;
+    }
+    injector_running = true;
+  }
+
+  if (queue_tail != NULL) {
+    queue_tail->next = job;
+  }
+  else {
+    queue_head = job;
+  }
+  queue_tail = job;
+  uv_cond_signal(&injector_cond);
+  uv_mutex_unlock(&injector_mutex);
+  return UIOHOOK_SUCCESS;
+}
+
+// Must be called with the mutex held. Jobs that haven't started are
+// unlinked and returned through `unlinked`, the caller completes them.
+static bool cancel_matching(void* owner, bool any_id, uint32_t id, injector_job** unlinked) {
+  bool found = false;
+
+  if (running_job != NULL && running_job->owner == owner && (any_id || running_job->id == id)) {
+    running_job->cancelled = true;
+    uv_cond_signal(&injector_cond);
+    found = true;
+  }
+
+  injector_job** link = &queue_head;
+  queue_tail = NULL;
+  while (*link != NULL) {
+    injector_job* job = *link;
+    if (job->owner == owner && (any_id || job->id == id)) {
+      *link = job->next;
+      job->next = *unlinked;
+      *unlinked = job;
+      found = true;
+    }
+    else {
+      queue_tail = job;
+      link = &job->next;
+    }
+  }
+
+  return found;
+}
+
+static bool injector_cancel_matching(void* owner, bool any_id, uint32_t id) {
+  uv_once(&injector_once, injector_init);
+
+  injector_job* unlinked = NULL;
+  uv_mutex_lock(&injector_mutex);
+  bool found = cancel_matching(owner, any_id, id, &unlinked);
+  uv_mutex_unlock(&injector_mutex);
+
+  while (unlinked != NULL) {
+    injector_job* job = unlinked;
+    unlinked = job->next;
+    job->done(job->data, false);
+    injector_steps_free(job->steps, job->count);
+    free(job);
+  }
+  return found;
+}
+
+bool injector_cancel(void* owner, uint32_t id) {
+  return injector_cancel_matching(owner, false, id);
+}
+
+void injector_cancel_owner(void* owner) {
+  injector_cancel_matching(owner, true, 0);
+}
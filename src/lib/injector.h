@@ -0,0 +1,56 @@
+#ifndef ADDON_SRC_INJECTOR_H_
+#define ADDON_SRC_INJECTOR_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <uiohook.h>
+
+// Sequences of synthetic events are posted with hook_post_event() on a
+// dedicated thread, so delays between steps never block the JS thread.
+
+#define INJECTOR_MAX_HELD 16 // keys and buttons released when a sequence is cancelled
+
+typedef enum {
+  injector_easing_linear,
+  injector_easing_in,     // cubic
+  injector_easing_out,
+  injector_easing_in_out
+} injector_easing;
+
+// Pointer moves along a polyline, generated on the injector thread.
+typedef struct {
+  injector_easing easing;
+  uint32_t duration;   // ms
+  uint32_t rate;       // moves per second
+  uint32_t count;      // number of waypoints
+  int16_t points[];    // x, y of every waypoint
+} injector_path;
+
+typedef struct {
+  uiohook_event event; // type 0 - only wait
+  injector_path* path; // moves along it after posting the event, freed with the step
+  uint32_t delay;      // µs to wait afterwards
+} injector_step;
+
+// Called once the sequence has finished or was cancelled, on the injector
+// thread or, if it was cancelled before it started, by injector_cancel.
+typedef void (*injector_done_cb)(void* data, bool completed);
+
+// Frees steps allocated with malloc together with their paths.
+void injector_steps_free(injector_step* steps, uint32_t count);
+
+// Takes ownership of `steps` on success.
+// `owner` and `id` identify the sequence for injector_cancel.
+int injector_submit(injector_step* steps, uint32_t count, void* owner, uint32_t id,
+                    injector_done_cb done, void* data);
+
+// Skips the remaining steps and releases keys and buttons the sequence
+// is still holding, buttons at the last position it moved to. Returns false if there is no such sequence.
+bool injector_cancel(void* owner, uint32_t id);
+
+void injector_cancel_owner(void* owner);
+
+// Posts a single event from any thread, serialized with the injector thread.
+void injector_post(uiohook_event* event);
+
+#endif // !ADDON_SRC_INJECTOR_H_
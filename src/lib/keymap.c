@@ -0,0 +1,311 @@
+#include <stdlib.h>
+#include <string.h>
+#include <uiohook.h>
+#include <uv.h>
+
+#include "keymap.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <Carbon/Carbon.h>
+#else
+#include <X11/Xlib.h>
+#include <X11/XKBlib.h>
+#endif
+
+#define KEYMAP_MAX_ENTRIES 256
+
+typedef struct {
+  uint32_t codepoint;
+  uint16_t keycode;
+  uint8_t modifiers;
+} keymap_entry;
+
+struct keymap {
+  bool valid;
+  uintptr_t layout;
+  keymap_entry ascii[128]; // keycode 0 - not typeable
+  keymap_entry entries[KEYMAP_MAX_ENTRIES]; // the rest, sorted by codepoint
+  uint32_t count;
+};
+
+// uiohook keycodes are PC set 1 scancodes, these ranges are the keys
+// of the main block that type characters.
+static const uint16_t typing_keys[][2] = {
+  { 0x0002, 0x000D }, // 1 .. =
+  { 0x0010, 0x001B }, // Q .. ]
+  { 0x001E, 0x0029 }, // A .. `
+  { 0x002B, 0x0035 }, // \ .. /
+  { 0x0039, 0x0039 }  // Space
+};
+
+static uv_once_t keymap_once = UV_ONCE_INIT;
+static uv_mutex_t keymap_mutex;
+static keymap current;
+
+#if defined(_WIN32)
+
+static HKL layout_handle;
+
+static bool layout_current(uintptr_t* layout) {
+  // Text goes to the foreground window, which can use another layout than this thread.
+  HWND window = GetForegroundWindow();
+  DWORD thread_id = (window != NULL) ? GetWindowThreadProcessId(window, NULL) : 0;
+  layout_handle = GetKeyboardLayout(thread_id);
+  *layout = (uintptr_t)layout_handle;
+  return true;
+}
+
+static uint32_t layout_translate(uint16_t scancode, uint8_t modifiers) {
+  UINT vk_code = MapVirtualKeyExW(scancode, MAPVK_VSC_TO_VK_EX, layout_handle);
+  if (vk_code == 0) return 0;
+
+  BYTE state[256];
+  memset(state, 0, sizeof(state));
+  if (modifiers & KEYMAP_SHIFT) {
+    state[VK_SHIFT] = 0x80;
+  }
+  if (modifiers & KEYMAP_ALTGR) {
+    state[VK_CONTROL] = 0x80;
+    state[VK_MENU] = 0x80;
+  }
+
+  // 0x4 - keep the dead key state of this thread intact (Windows 10 1607+).
+  WCHAR chars[4];
+  int length = ToUnicodeEx(vk_code, scancode, state, chars, 4, 0x4, layout_handle);
+  return (length == 1) ? chars[0] : 0;
+}
+
+#elif defined(__APPLE__)
+
+// Set 1 scancode -> macOS virtual keycode (kVK_ANSI_*), 0xFF - none.
+static const uint8_t mac_keycodes[0x3A] = {
+  0xFF, 0xFF, 0x12, 0x13, 0x14, 0x15, 0x17, 0x16, 0x1A, 0x1C, 0x19, 0x1D, 0x1B, 0x18, 0xFF, 0xFF,
+  0x0C, 0x0D, 0x0E, 0x0F, 0x11, 0x10, 0x20, 0x22, 0x1F, 0x23, 0x21, 0x1E, 0xFF, 0xFF, 0x00, 0x01,
+  0x02, 0x03, 0x05, 0x04, 0x26, 0x28, 0x25, 0x29, 0x27, 0x32, 0xFF, 0x2A, 0x06, 0x07, 0x08, 0x09,
+  0x0B, 0x2D, 0x2E, 0x2B, 0x2F, 0x2C, 0xFF, 0xFF, 0xFF, 0x31
+};
+
+static TISInputSourceRef layout_source = NULL;
+static const UCKeyboardLayout* layout_data = NULL;
+
+static bool layout_current(uintptr_t* layout) {
+  TISInputSourceRef source = TISCopyCurrentKeyboardLayoutInputSource();
+  if (source == NULL) return false;
+
+  CFDataRef data = TISGetInputSourceProperty(source, kTISPropertyUnicodeKeyLayoutData);
+  CFStringRef source_id = TISGetInputSourceProperty(source, kTISPropertyInputSourceID);
+  if (data == NULL || source_id == NULL) {
+    CFRelease(source);
+    return false;
+  }
+
+  // The source owns the layout data.
+  if (layout_source != NULL) {
+    CFRelease(layout_source);
+  }
+  layout_source = source;
+  layout_data = (const UCKeyboardLayout*)CFDataGetBytePtr(data);
+  *layout = (uintptr_t)CFHash(source_id);
+  return true;
+}
+
+static uint32_t layout_translate(uint16_t scancode, uint8_t modifiers) {
+  if (scancode >= sizeof(mac_keycodes) || mac_keycodes[scancode] == 0xFF) return 0;
+
+  UInt32 modifier_state = 0;
+  if (modifiers & KEYMAP_SHIFT) {
+    modifier_state |= (shiftKey >> 8) & 0xFF;
+  }
+  if (modifiers & KEYMAP_ALTGR) {
+    modifier_state |= (optionKey >> 8) & 0xFF;
+  }
+
+  UInt32 dead_key_state = 0;
+  UniChar chars[4];
+  UniCharCount length = 0;
+  OSStatus status = UCKeyTranslate(layout_data, mac_keycodes[scancode], kUCKeyActionDown, modifier_state,
+    LMGetKbdType(), kUCKeyTranslateNoDeadKeysMask, &dead_key_state, 4, &length, chars);
+  return (status == noErr && length == 1) ? chars[0] : 0;
+}
+
+#else
+
+static Display* display = NULL;
+static int xkb_event_base;
+static uint32_t keymap_generation = 0;
+static unsigned int layout_group;
+
+// Lowercase letters of Cyrillic keysyms 0x6c0..0x6df, uppercase ones follow at 0x6e0.
+static const uint16_t cyrillic_codepoints[32] = {
+  0x044E, 0x0430, 0x0431, 0x0446, 0x0434, 0x0435, 0x0444, 0x0433,
+  0x0445, 0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E,
+  0x043F, 0x044F, 0x0440, 0x0441, 0x0442, 0x0443, 0x0436, 0x0432,
+  0x044C, 0x044B, 0x0437, 0x0448, 0x044D, 0x0449, 0x0447, 0x044A
+};
+
+static uint32_t keysym_to_codepoint(KeySym keysym) {
+  if ((keysym >= 0x20 && keysym <= 0x7E) || (keysym >= 0xA0 && keysym <= 0xFF)) return (uint32_t)keysym;
+  if ((keysym & 0xFF000000) == 0x01000000) return (uint32_t)(keysym & 0x00FFFFFF);
+  if (keysym >= 0x6C0 && keysym <= 0x6DF) return cyrillic_codepoints[keysym - 0x6C0];
+  if (keysym >= 0x6E0 && keysym <= 0x6FF) return cyrillic_codepoints[keysym - 0x6E0] - 0x20;
+
+  switch (keysym) {
+  case 0x6A3: return 0x0451; // ё
+  case 0x6B3: return 0x0401; // Ё
+  case 0x6A4: return 0x0454; // є
+  case 0x6B4: return 0x0404; // Є
+  case 0x6A6: return 0x0456; // і
+  case 0x6B6: return 0x0406; // І
+  case 0x6A7: return 0x0457; // ї
+  case 0x6B7: return 0x0407; // Ї
+  case 0x6AD: return 0x0491; // ґ
+  case 0x6BD: return 0x0490; // Ґ
+  default:    return 0;
+  }
+}
+
+static bool layout_current(uintptr_t* layout) {
+  if (display == NULL) {
+    display = XOpenDisplay(NULL);
+    if (display == NULL) return false;
+
+    int opcode, error_base, major = XkbMajorVersion, minor = XkbMinorVersion;
+    if (!XkbQueryExtension(display, &opcode, &xkb_event_base, &error_base, &major, &minor)) {
+      XCloseDisplay(display);
+      display = NULL;
+      return false;
+    }
+    unsigned int events = XkbNewKeyboardNotifyMask | XkbMapNotifyMask;
+    XkbSelectEvents(display, XkbUseCoreKbd, events, events);
+  }
+
+  // Replacing the keymap (setxkbmap) doesn't change the group, so keymap
+  // notifications are counted as well. Reading them refreshes the keymap
+  // cached by Xlib.
+  while (XPending(display) > 0) {
+    XEvent event;
+    XNextEvent(display, &event);
+    if (event.type == xkb_event_base) {
+      XkbEvent* xkb_event = (XkbEvent*)&event;
+      if (xkb_event->any.xkb_type == XkbMapNotify) {
+        XkbRefreshKeyboardMapping(&xkb_event->map);
+      }
+      keymap_generation++;
+    }
+  }
+
+  XkbStateRec state;
+  if (XkbGetState(display, XkbUseCoreKbd, &state) != Success) return false;
+  layout_group = state.group;
+  *layout = ((uintptr_t)keymap_generation << 8) | layout_group;
+  return true;
+}
+
+static uint32_t layout_translate(uint16_t scancode, uint8_t modifiers) {
+  // X keycodes are evdev codes + 8, evdev codes of the main block are set 1 scancodes.
+  KeyCode keycode = (KeyCode)(scancode + 8);
+  unsigned int level = ((modifiers & KEYMAP_SHIFT) ? 1 : 0) + ((modifiers & KEYMAP_ALTGR) ? 2 : 0);
+  return keysym_to_codepoint(XkbKeycodeToKeysym(display, keycode, layout_group, level));
+}
+
+#endif
+
+static void keymap_init(void) {
+  uv_mutex_init(&keymap_mutex);
+}
+
+static keymap_entry* keymap_find(keymap* map, uint32_t codepoint) {
+  if (codepoint < 128) return &map->ascii[codepoint];
+
+  uint32_t low = 0, high = map->count;
+  while (low < high) {
+    uint32_t middle = (low + high) / 2;
+    if (map->entries[middle].codepoint < codepoint) {
+      low = middle + 1;
+    }
+    else {
+      high = middle;
+    }
+  }
+  return (low < map->count && map->entries[low].codepoint == codepoint) ? &map->entries[low] : NULL;
+}
+
+// Keeps the first keystroke found for a character, so the ones with fewer modifiers win.
+static void keymap_add(keymap* map, uint32_t codepoint, uint16_t keycode, uint8_t modifiers) {
+  if ((codepoint < 0x20 && codepoint != '\n' && codepoint != '\t') || codepoint == 0x7F) return;
+
+  if (codepoint < 128) {
+    if (map->ascii[codepoint].keycode == 0) {
+      map->ascii[codepoint].codepoint = codepoint;
+      map->ascii[codepoint].keycode = keycode;
+      map->ascii[codepoint].modifiers = modifiers;
+    }
+    return;
+  }
+
+  if (keymap_find(map, codepoint) != NULL || map->count == KEYMAP_MAX_ENTRIES) return;
+
+  uint32_t i = map->count++;
+  for (; i > 0 && map->entries[i - 1].codepoint > codepoint; i--) {
+    map->entries[i] = map->entries[i - 1];
+  }
+  map->entries[i].codepoint = codepoint;
+  map->entries[i].keycode = keycode;
+  map->entries[i].modifiers = modifiers;
+}
+
+static void keymap_build(keymap* map, uintptr_t layout) {
+  memset(map, 0, sizeof(keymap));
+  map->layout = layout;
+
+  keymap_add(map, '\n', VC_ENTER, 0);
+  keymap_add(map, '\t', VC_TAB, 0);
+
+  static const uint8_t levels[] = { 0, KEYMAP_SHIFT, KEYMAP_ALTGR, KEYMAP_SHIFT | KEYMAP_ALTGR };
+  for (size_t level = 0; level < sizeof(levels); level++) {
+    for (size_t range = 0; range < sizeof(typing_keys) / sizeof(typing_keys[0]); range++) {
+      for (uint16_t keycode = typing_keys[range][0]; keycode <= typing_keys[range][1]; keycode++) {
+        keymap_add(map, layout_translate(keycode, levels[level]), keycode, levels[level]);
+      }
+    }
+  }
+
+  map->valid = true;
+}
+
+const keymap* keymap_lock(void) {
+  uv_once(&keymap_once, keymap_init);
+  uv_mutex_lock(&keymap_mutex);
+
+  uintptr_t layout;
+  if (!layout_current(&layout)) return NULL;
+
+  if (!current.valid || current.layout != layout) {
+    keymap_build(&current, layout);
+  }
+  return &current;
+}
+
+void keymap_unlock(void) {
+  uv_mutex_unlock(&keymap_mutex);
+}
+
+bool keymap_lookup(const keymap* map, uint32_t codepoint, uint16_t* keycode, uint8_t* modifiers) {
+  const keymap_entry* entry = keymap_find((keymap*)map, codepoint);
+  if (entry == NULL || entry->keycode == 0) return false;
+
+  *keycode = entry->keycode;
+  *modifiers = entry->modifiers;
+  return true;
+}
+
+uint16_t keymap_modifier_keycode(uint8_t modifier) {
+  if (modifier == KEYMAP_SHIFT) return VC_SHIFT_L;
+#ifdef __APPLE__
+  return VC_ALT_L;
+#else
+  return VC_ALT_R;
+#endif
+}
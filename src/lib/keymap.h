@@ -0,0 +1,28 @@
+#ifndef ADDON_SRC_KEYMAP_H_
+#define ADDON_SRC_KEYMAP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Maps characters to the keystrokes that type them with the current
+// keyboard layout. The table is built from the layout once and rebuilt
+// only when the active layout changes.
+
+#define KEYMAP_SHIFT (1 << 0)
+#define KEYMAP_ALTGR (1 << 1)
+
+typedef struct keymap keymap;
+
+// Returns the table of the current layout, or NULL if the layout can't
+// be read. keymap_unlock must be called either way.
+const keymap* keymap_lock(void);
+
+void keymap_unlock(void);
+
+// Returns false if the layout has no key for `codepoint`.
+bool keymap_lookup(const keymap* map, uint32_t codepoint, uint16_t* keycode, uint8_t* modifiers);
+
+// uiohook keycode of the modifier, AltGr is Option on macOS.
+uint16_t keymap_modifier_keycode(uint8_t modifier);
+
+#endif // !ADDON_SRC_KEYMAP_H_
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <string.h>
+#include <uiohook.h>
+#include <uv.h>
+
+#include "atomic_helpers.h"
+#include "log_ring.h"
+
+// Bounded multi-producer queue: a producer claims a position by moving
+// `head`, formats into the slot and publishes it by setting the slot
+// sequence to position + 1. The drain side owns `tail`, it frees a slot
+// by setting its sequence to position + LOG_RING_SLOTS.
+
+typedef struct {
+  volatile uint32_t seq;
+  uint32_t level;
+  uint32_t length;
+  char text[LOG_MESSAGE_SIZE];
+} log_slot;
+
+static log_slot slots[LOG_RING_SLOTS];
+static volatile uint32_t head = 0;
+static uint32_t tail = 0; // under drain_mutex
+
+static volatile uint32_t min_level = LOG_LEVEL_WARN;
+static volatile uint64_t message_count = 0;
+static volatile uint64_t drop_count = 0;
+
+static uv_once_t log_once = UV_ONCE_INIT;
+static uv_mutex_t drain_mutex; // one consumer at a time, guards the sink
+static uv_sem_t drain_sem;
+static volatile uint32_t drain_wanted = 0; // the drain thread was posted
+static uv_thread_t drain_thread;
+static log_sink_cb active_sink = NULL;
+static void* active_sink_data = NULL;
+
+static bool stderr_sink(void* data, uint32_t level, const char* text, uint32_t length) {
+  return fwrite(text, 1, length, stderr) == length;
+}
+
+// Under drain_mutex
+static void drain() {
+  for (;;) {
+    log_slot* slot = &slots[tail & (LOG_RING_SLOTS - 1)];
+    if (atomic_load_u32(&slot->seq) != tail + 1) break;
+
+    log_sink_cb sink = (active_sink != NULL) ? active_sink : stderr_sink;
+    if (!sink(active_sink_data, slot->level, slot->text, slot->length)) {
+      atomic_add_u64(&drop_count, 1);
+    }
+
+    atomic_store_u32(&slot->seq, tail + LOG_RING_SLOTS);
+    tail++;
+  }
+  if (active_sink == NULL) {
+    fflush(stderr);
+  }
+}
+
+static void drain_proc(void* arg) {
+  for (;;) {
+    uv_sem_wait(&drain_sem);
+    // Messages published after this post again.
+    atomic_store_u32(&drain_wanted, 0);
+
+    uv_mutex_lock(&drain_mutex);
+    drain();
+    uv_mutex_unlock(&drain_mutex);
+  }
+}
+
+static void log_ring_once() {
+  for (uint32_t i = 0; i < LOG_RING_SLOTS; i++) {
+    slots[i].seq = i;
+  }
+  uv_mutex_init(&drain_mutex);
+  uv_sem_init(&drain_sem, 0);
+  // Lives as long as the process, it only ever waits for messages.
+  if (uv_thread_create(&drain_thread, drain_proc, NULL) != 0) {
+    atomic_store_u32(&min_level, LOG_LEVEL_OFF);
+  }
+}
+
+void log_ring_init() {
+  uv_once(&log_once, log_ring_once);
+}
+
+void log_ring_set_level(uint32_t level) {
+  atomic_store_u32(&min_level, level);
+}
+
+uint32_t log_ring_level() {
+  return atomic_load_u32(&min_level);
+}
+
+bool log_ring_push(uint32_t level, const char* format, va_list args) {
+  if (level < atomic_load_u32(&min_level)) return false;
+
+  log_slot* slot;
+  uint32_t pos = atomic_load_u32(&head);
+  for (;;) {
+    slot = &slots[pos & (LOG_RING_SLOTS - 1)];
+    int32_t diff = (int32_t)(atomic_load_u32(&slot->seq) - pos);
+    if (diff == 0) {
+      if (atomic_cas_u32(&head, pos, pos + 1)) break;
+      pos = atomic_load_u32(&head);
+    }
+    else if (diff < 0) {
+      // Not drained yet
+      atomic_add_u64(&drop_count, 1);
+      return false;
+    }
+    else {
+      pos = atomic_load_u32(&head);
+    }
+  }
+
+  int length = vsnprintf(slot->text, LOG_MESSAGE_SIZE, format, args);
+  if (length < 0) {
+    length = 0;
+    slot->text[0] = '\0';
+  }
+  else if (length >= LOG_MESSAGE_SIZE) {
+    length = LOG_MESSAGE_SIZE - 1;
+  }
+  slot->level = level;
+  slot->length = (uint32_t)length;
+  atomic_store_u32(&slot->seq, pos + 1);
+  atomic_add_u64(&message_count, 1);
+
+  if (atomic_cas_u32(&drain_wanted, 0, 1)) {
+    uv_sem_post(&drain_sem);
+  }
+  return true;
+}
+
+void log_ring_set_sink(log_sink_cb sink, void* data) {
+  uv_mutex_lock(&drain_mutex);
+  active_sink = sink;
+  active_sink_data = data;
+  uv_mutex_unlock(&drain_mutex);
+}
+
+void log_ring_flush() {
+  uv_mutex_lock(&drain_mutex);
+  drain();
+  uv_mutex_unlock(&drain_mutex);
+}
+
+void log_ring_counters(uint64_t* messages, uint64_t* dropped) {
+  *messages = atomic_load_u64(&message_count);
+  *dropped = atomic_load_u64(&drop_count);
+}
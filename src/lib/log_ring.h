@@ -0,0 +1,44 @@
+#ifndef ADDON_SRC_LOG_RING_H_
+#define ADDON_SRC_LOG_RING_H_
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <uiohook.h>
+
+// Log messages of libuiohook and the worker are formatted into a
+// preallocated ring by whichever thread logs, usually the hook thread,
+// and written out by a drain thread. Logging never waits for stderr or
+// JS, messages are dropped and counted when the ring is full.
+
+#define LOG_RING_SLOTS 128 // power of 2
+#define LOG_MESSAGE_SIZE 256 // bytes including the terminator, longer messages are cut
+#define LOG_LEVEL_OFF (LOG_LEVEL_ERROR + 1)
+
+// Called on the drain thread, or on the thread calling log_ring_flush().
+// Returns false if the message was dropped.
+typedef bool (*log_sink_cb)(void* data, uint32_t level, const char* text, uint32_t length);
+
+// Starts the drain thread once per process, safe to call repeatedly.
+void log_ring_init();
+
+// Messages below `level` are discarded before they are formatted.
+// LOG_LEVEL_WARN by default, LOG_LEVEL_OFF disables logging.
+void log_ring_set_level(uint32_t level);
+
+uint32_t log_ring_level();
+
+// Any thread, never blocks.
+bool log_ring_push(uint32_t level, const char* format, va_list args);
+
+// Replaces where messages go, stderr if `sink` is NULL. Once it returns
+// the previous sink is not called anymore.
+void log_ring_set_sink(log_sink_cb sink, void* data);
+
+// Writes out the queued messages on the calling thread.
+void log_ring_flush();
+
+// Messages queued so far, and the ones lost because the ring or the sink was full.
+void log_ring_counters(uint64_t* messages, uint64_t* dropped);
+
+#endif // !ADDON_SRC_LOG_RING_H_
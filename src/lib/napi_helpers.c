@@ -49,3 +49,21 @@ napi_value error_create(napi_env env) {
 
   return error;
 }
+
+napi_status object_get_uint32(napi_env env, napi_value object, const char* name, uint32_t* result) {
+  napi_status status;
+
+  bool has_property;
+  status = napi_has_named_property(env, object, name, &has_property);
+  if (status != napi_ok || !has_property) return status;
+
+  napi_value value;
+  status = napi_get_named_property(env, object, name, &value);
+  if (status != napi_ok) return status;
+
+  napi_valuetype type;
+  status = napi_typeof(env, value, &type);
+  if (status != napi_ok || type == napi_undefined) return status;
+
+  return napi_get_value_uint32(env, value, result);
+}
@@ -50,4 +50,8 @@
 
 napi_value error_create(napi_env env);
 
+// Reads an optional numeric property, `result` is left untouched
+// when the property is missing or undefined.
+napi_status object_get_uint32(napi_env env, napi_value object, const char* name, uint32_t* result);
+
 #endif // !ADDON_SRC_HELPERS_H_
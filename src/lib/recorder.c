@@ -0,0 +1,357 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "atomic_helpers.h"
+#include "recorder.h"
+
+#define RECORD_MAX_SIZE 48
+
+static uint8_t* varint_write(uint8_t* p, uint64_t value) {
+  while (value >= 0x80) {
+    *p++ = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  *p++ = (uint8_t)value;
+  return p;
+}
+
+static uint8_t* zigzag_write(uint8_t* p, int64_t value) {
+  return varint_write(p, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+static bool is_key_event(uint8_t type) {
+  return type == EVENT_KEY_PRESSED || type == EVENT_KEY_RELEASED || type == EVENT_KEY_TYPED;
+}
+
+static bool is_mouse_event(uint8_t type) {
+  return type >= EVENT_MOUSE_CLICKED && type <= EVENT_MOUSE_DRAGGED;
+}
+
+static void writer_drain(recorder* rec) {
+  uint32_t head = atomic_load_u32(&rec->head);
+  uint32_t tail = rec->tail;
+
+  while (tail != head) {
+    uint32_t offset = tail & rec->mask;
+    uint32_t length = head - tail;
+    if (length > rec->mask + 1 - offset) {
+      length = rec->mask + 1 - offset;
+    }
+    if (!rec->write_failed && fwrite(rec->buffer + offset, 1, length, rec->file) != length) {
+      rec->write_failed = true;
+    }
+    rec->bytes += length;
+    tail += length;
+  }
+
+  atomic_store_u32(&rec->tail, tail);
+}
+
+static void writer_proc(void* arg) {
+  recorder* rec = arg;
+
+  // The hook thread must never wait for the disk, so it only fills the
+  // buffer and the writer catches up periodically.
+  while (rec->writer_running) {
+    uv_sleep(RECORDER_FLUSH_INTERVAL);
+    writer_drain(rec);
+    fflush(rec->file);
+  }
+  writer_drain(rec);
+}
+
+recorder_status recorder_open(recorder* rec, const char* path) {
+  memset(rec, 0, sizeof(recorder));
+
+  rec->buffer = malloc(RECORDER_BUFFER_SIZE);
+  if (rec->buffer == NULL) return recorder_error_out_of_memory;
+  rec->mask = RECORDER_BUFFER_SIZE - 1;
+
+  rec->file = fopen(path, "wb");
+  if (rec->file == NULL) {
+    free(rec->buffer);
+    return recorder_error_open;
+  }
+
+  uv_timeval64_t now;
+  uv_gettimeofday(&now);
+  uint8_t header[24];
+  memcpy(header, RECORDER_MAGIC, 7);
+  header[7] = RECORDER_VERSION;
+  uint8_t* end = varint_write(header + 8, (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_usec / 1000);
+  size_t header_length = (size_t)(end - header);
+  if (fwrite(header, 1, header_length, rec->file) != header_length) {
+    fclose(rec->file);
+    free(rec->buffer);
+    return recorder_error_io;
+  }
+  rec->bytes = header_length;
+
+  rec->writer_running = true;
+  if (uv_thread_create(&rec->writer_thread, writer_proc, rec) != 0) {
+    fclose(rec->file);
+    free(rec->buffer);
+    return recorder_error_thread_create;
+  }
+  return recorder_ok;
+}
+
+void recorder_push(recorder* rec, const uiohook_event* event) {
+  uint8_t record[RECORD_MAX_SIZE];
+  uint8_t* p = record;
+
+  uint64_t time_delta = (rec->started && event->time > rec->last_time) ? event->time - rec->last_time : 0;
+  bool mask_changed = !rec->started || event->mask != rec->last_mask;
+
+  *p++ = (uint8_t)event->type | (mask_changed ? RECORDER_MASK_CHANGED : 0);
+  p = varint_write(p, time_delta);
+  if (mask_changed) {
+    p = varint_write(p, event->mask);
+  }
+
+  int16_t x = rec->last_x, y = rec->last_y;
+  if (is_key_event(event->type)) {
+    p = varint_write(p, event->data.keyboard.keycode);
+    p = varint_write(p, event->data.keyboard.rawcode);
+  }
+  else if (is_mouse_event(event->type)) {
+    x = event->data.mouse.x;
+    y = event->data.mouse.y;
+    p = zigzag_write(p, (int64_t)x - rec->last_x);
+    p = zigzag_write(p, (int64_t)y - rec->last_y);
+    if (event->type != EVENT_MOUSE_MOVED && event->type != EVENT_MOUSE_DRAGGED) {
+      p = varint_write(p, event->data.mouse.button);
+      p = varint_write(p, event->data.mouse.clicks);
+    }
+  }
+  else if (event->type == EVENT_MOUSE_WHEEL) {
+    x = event->data.wheel.x;
+    y = event->data.wheel.y;
+    p = zigzag_write(p, (int64_t)x - rec->last_x);
+    p = zigzag_write(p, (int64_t)y - rec->last_y);
+    p = varint_write(p, event->data.wheel.clicks);
+    *p++ = event->data.wheel.type;
+    p = varint_write(p, event->data.wheel.amount);
+    p = zigzag_write(p, event->data.wheel.rotation);
+    *p++ = event->data.wheel.direction;
+  }
+  else {
+    return;
+  }
+
+  uint32_t length = (uint32_t)(p - record);
+  uint32_t head = rec->head;
+  if (rec->mask + 1 - (head - atomic_load_u32(&rec->tail)) < length) {
+    // The next record is encoded relative to the last written one.
+    atomic_add_u64(&rec->dropped, 1);
+    return;
+  }
+
+  for (uint32_t i = 0; i < length; i++) {
+    rec->buffer[(head + i) & rec->mask] = record[i];
+  }
+  atomic_store_u32(&rec->head, head + length);
+
+  rec->started = true;
+  rec->last_time = event->time;
+  rec->last_mask = event->mask;
+  rec->last_x = x;
+  rec->last_y = y;
+  atomic_add_u64(&rec->events, 1);
+}
+
+recorder_status recorder_close(recorder* rec) {
+  rec->writer_running = false;
+  uv_thread_join(&rec->writer_thread);
+
+  bool failed = rec->write_failed;
+  if (fclose(rec->file) != 0) {
+    failed = true;
+  }
+  free(rec->buffer);
+  rec->buffer = NULL;
+  return failed ? recorder_error_io : recorder_ok;
+}
+
+// Reads the file in chunks, a log is never held in memory as a whole.
+typedef struct {
+  FILE* file;
+  uint8_t buffer[RECORDER_READ_CHUNK];
+  const uint8_t* p;
+  const uint8_t* end;
+  bool truncated;
+} record_reader;
+
+static void reader_start(record_reader* reader, FILE* file) {
+  reader->file = file;
+  reader->p = reader->buffer;
+  reader->end = reader->buffer;
+  reader->truncated = false;
+}
+
+// Returns false at the end of the file.
+static bool reader_fill(record_reader* reader) {
+  if (reader->p != reader->end) return true;
+  size_t length = fread(reader->buffer, 1, sizeof(reader->buffer), reader->file);
+  reader->p = reader->buffer;
+  reader->end = reader->buffer + length;
+  return length != 0;
+}
+
+static uint8_t byte_read(record_reader* reader) {
+  if (!reader_fill(reader)) {
+    reader->truncated = true;
+    return 0;
+  }
+  return *reader->p++;
+}
+
+static uint64_t varint_read(record_reader* reader) {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    uint8_t byte = byte_read(reader);
+    if (reader->truncated) return 0;
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) break;
+  }
+  return value;
+}
+
+static int64_t zigzag_read(record_reader* reader) {
+  uint64_t value = varint_read(reader);
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static uint32_t delay_scale(uint64_t delay_ms, double speed) {
+  double delay = (double)delay_ms * 1000 / speed;
+  return (delay < UINT32_MAX) ? (uint32_t)delay : UINT32_MAX;
+}
+
+// Clicks and typed characters are generated by the OS from presses and releases.
+static bool is_replayed(uint8_t type) {
+  return type != EVENT_MOUSE_CLICKED && type != EVENT_KEY_TYPED;
+}
+
+// Decodes the log from the start of `file`, up to `capacity` steps. Without
+// `steps` only counts the events to replay, so they can be allocated exactly.
+static recorder_status records_parse(FILE* file, double speed, injector_step* steps, uint32_t capacity, uint32_t* count) {
+  record_reader* reader = malloc(sizeof(record_reader));
+  if (reader == NULL) return recorder_error_out_of_memory;
+  reader_start(reader, file);
+
+  uint8_t header[8];
+  for (int i = 0; i < 8; i++) {
+    header[i] = byte_read(reader);
+  }
+  if (reader->truncated || memcmp(header, RECORDER_MAGIC, 7) != 0 || header[7] != RECORDER_VERSION) {
+    free(reader);
+    return recorder_error_format;
+  }
+  varint_read(reader); // start time
+
+  recorder_status status = recorder_ok;
+  uint16_t mask = 0;
+  int16_t x = 0, y = 0;
+  uint64_t pending_delay = 0;
+  *count = 0;
+
+  while (!reader->truncated && reader_fill(reader)) {
+    uint8_t tag = byte_read(reader);
+    uint8_t type = tag & ~RECORDER_MASK_CHANGED;
+    uint64_t time_delta = varint_read(reader);
+    if (tag & RECORDER_MASK_CHANGED) {
+      mask = (uint16_t)varint_read(reader);
+    }
+
+    uiohook_event event;
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.mask = mask;
+    if (is_key_event(type)) {
+      event.data.keyboard.keycode = (uint16_t)varint_read(reader);
+      event.data.keyboard.rawcode = (uint16_t)varint_read(reader);
+    }
+    else if (is_mouse_event(type)) {
+      event.data.mouse.x = (int16_t)(x + zigzag_read(reader));
+      event.data.mouse.y = (int16_t)(y + zigzag_read(reader));
+      if (type != EVENT_MOUSE_MOVED && type != EVENT_MOUSE_DRAGGED) {
+        event.data.mouse.button = (uint16_t)varint_read(reader);
+        event.data.mouse.clicks = (uint16_t)varint_read(reader);
+      }
+      else {
+        event.type = EVENT_MOUSE_MOVED;
+      }
+    }
+    else if (type == EVENT_MOUSE_WHEEL) {
+      event.data.wheel.x = (int16_t)(x + zigzag_read(reader));
+      event.data.wheel.y = (int16_t)(y + zigzag_read(reader));
+      event.data.wheel.clicks = (uint16_t)varint_read(reader);
+      event.data.wheel.type = byte_read(reader);
+      event.data.wheel.amount = (uint16_t)varint_read(reader);
+      event.data.wheel.rotation = (int16_t)zigzag_read(reader);
+      event.data.wheel.direction = byte_read(reader);
+    }
+    else {
+      status = recorder_error_format;
+      break;
+    }
+
+    if (reader->truncated) break;
+
+    if (is_mouse_event(type)) {
+      x = event.data.mouse.x;
+      y = event.data.mouse.y;
+    }
+    else if (type == EVENT_MOUSE_WHEEL) {
+      x = event.data.wheel.x;
+      y = event.data.wheel.y;
+    }
+
+    // The delay before an event is the wait after the previous step.
+    pending_delay += time_delta;
+    if (!is_replayed(type)) continue;
+    if (*count == capacity) break;
+    if (steps != NULL) {
+      if (*count > 0) {
+        steps[*count - 1].delay = delay_scale(pending_delay, speed);
+      }
+      steps[*count].event = event;
+    }
+    pending_delay = 0;
+    (*count)++;
+  }
+
+  if (status == recorder_ok && ferror(file)) {
+    status = recorder_error_io;
+  }
+  free(reader);
+  return status;
+}
+
+recorder_status recorder_load(const char* path, double speed, injector_step** steps, uint32_t* count) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) return recorder_error_open;
+
+  // Counted first, a step takes many times the size of its record.
+  uint32_t total;
+  recorder_status status = records_parse(file, speed, NULL, UINT32_MAX - 1, &total);
+  if (status == recorder_ok) {
+    *steps = calloc((size_t)total + 1, sizeof(injector_step));
+    if (*steps == NULL) {
+      status = recorder_error_out_of_memory;
+    }
+    else if (fseek(file, 0, SEEK_SET) != 0) {
+      status = recorder_error_io;
+    }
+    else {
+      // Bounded by the count, the file may still be recorded into.
+      status = records_parse(file, speed, *steps, total, count);
+    }
+    if (status != recorder_ok) {
+      free(*steps);
+      *steps = NULL;
+    }
+  }
+  fclose(file);
+  return status;
+}
@@ -0,0 +1,73 @@
+#ifndef ADDON_SRC_RECORDER_H_
+#define ADDON_SRC_RECORDER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <uiohook.h>
+#include <uv.h>
+
+#include "injector.h"
+
+// Binary session log. Header: "UIOHREC", version byte, varint unix time
+// in ms when the recording started. Then one record per event:
+//   u8     type | RECORDER_MASK_CHANGED
+//   varint ms since the previous record
+//   varint modifier mask, only if it changed
+//   key:   varint keycode, varint rawcode
+//   mouse: zigzag varint x, y relative to the previous position,
+//          varint button, clicks (not for moves)
+//   wheel: zigzag varint x, y, varint clicks, u8 type, varint amount,
+//          zigzag varint rotation, u8 direction
+// A truncated last record is ignored when loading.
+#define RECORDER_MAGIC "UIOHREC"
+#define RECORDER_VERSION 1
+#define RECORDER_MASK_CHANGED 0x80
+
+#define RECORDER_BUFFER_SIZE (1 << 20) // bytes between the hook and the writer thread
+#define RECORDER_FLUSH_INTERVAL 50 // ms
+#define RECORDER_READ_CHUNK (1 << 16) // bytes read from a log at a time
+
+typedef enum {
+  recorder_ok,
+  recorder_error_open,
+  recorder_error_io,
+  recorder_error_format,
+  recorder_error_out_of_memory,
+  recorder_error_thread_create
+} recorder_status;
+
+typedef struct {
+  FILE* file;
+  uint8_t* buffer;
+  uint32_t mask;
+  volatile uint32_t head; // written by the hook thread
+  volatile uint32_t tail; // written by the writer thread
+  // Hook thread encoder state
+  bool started;
+  uint64_t last_time;
+  uint16_t last_mask;
+  int16_t last_x;
+  int16_t last_y;
+  volatile uint64_t events;
+  volatile uint64_t dropped; // the writer couldn't keep up
+  // Writer thread
+  uv_thread_t writer_thread;
+  volatile bool writer_running;
+  uint64_t bytes;
+  bool write_failed;
+} recorder;
+
+recorder_status recorder_open(recorder* rec, const char* path);
+
+// Hook thread side, never blocks.
+void recorder_push(recorder* rec, const uiohook_event* event);
+
+// Writes what is left and closes the file.
+recorder_status recorder_close(recorder* rec);
+
+// Converts a log to injector steps, delays are divided by `speed`. The file
+// is read twice in chunks, to count the steps and to decode them.
+recorder_status recorder_load(const char* path, double speed, injector_step** steps, uint32_t* count);
+
+#endif // !ADDON_SRC_RECORDER_H_
@@ -0,0 +1,240 @@
+#include <stdlib.h>
+#include <string.h>
+#include "atomic_helpers.h"
+#include "regions.h"
+
+// Regions are bucketed into a uniform grid over their bounding box, each
+// cell lists the regions overlapping it topmost first, so a hit test is
+// one cell lookup and a scan of a few rectangles. Tables are immutable
+// once published, the JS thread builds a new one and swaps the pointer.
+
+typedef struct {
+  int32_t left;
+  int32_t top;
+  int32_t right; // exclusive
+  int32_t bottom; // exclusive
+  uint32_t types;
+  uint16_t id;
+} region_rect;
+
+struct region_table {
+  int32_t left;
+  int32_t top;
+  int32_t right;
+  int32_t bottom;
+  int32_t cell_width;
+  int32_t cell_height;
+  uint32_t columns;
+  uint32_t rows;
+  uint32_t* cell_start; // columns * rows + 1 offsets into cell_items
+  uint32_t* cell_items; // region indices, topmost first
+  region_rect* regions;
+};
+
+static void table_free(region_table* table) {
+  if (table == NULL) return;
+  free(table->cell_start);
+  free(table->cell_items);
+  free(table->regions);
+  free(table);
+}
+
+// Event coordinates are 16 bit, so are the rectangles.
+static int32_t clamp_coordinate(int64_t value) {
+  if (value < INT16_MIN) return INT16_MIN;
+  if (value > INT16_MAX + 1) return INT16_MAX + 1;
+  return (int32_t)value;
+}
+
+// Entirely outside of the coordinate range
+static bool rect_empty(const region_rect* region) {
+  return region->right <= region->left || region->bottom <= region->top;
+}
+
+static uint32_t cell_column(const region_table* table, int32_t x) {
+  return (uint32_t)((x - table->left) / table->cell_width);
+}
+
+static uint32_t cell_row(const region_table* table, int32_t y) {
+  return (uint32_t)((y - table->top) / table->cell_height);
+}
+
+static region_table* table_build(const int32_t* data, uint32_t count) {
+  region_table* table = calloc(1, sizeof(region_table));
+  if (table == NULL) return NULL;
+
+  table->regions = malloc(count * sizeof(region_rect));
+  if (table->regions == NULL) {
+    table_free(table);
+    return NULL;
+  }
+
+  bool bounded = false;
+  for (uint32_t i = 0; i < count; i++) {
+    const int32_t* item = &data[i * 6];
+    region_rect* region = &table->regions[i];
+    region->id = (uint16_t)item[0];
+    region->left = clamp_coordinate(item[1]);
+    region->top = clamp_coordinate(item[2]);
+    region->right = clamp_coordinate((int64_t)item[1] + item[3]);
+    region->bottom = clamp_coordinate((int64_t)item[2] + item[4]);
+    region->types = (uint32_t)item[5];
+    if (rect_empty(region)) continue;
+
+    if (!bounded || region->left < table->left) table->left = region->left;
+    if (!bounded || region->top < table->top) table->top = region->top;
+    if (!bounded || region->right > table->right) table->right = region->right;
+    if (!bounded || region->bottom > table->bottom) table->bottom = region->bottom;
+    bounded = true;
+  }
+  if (!bounded) {
+    // Nothing can be hit, keep a single empty cell
+    table->right = table->left + 1;
+    table->bottom = table->top + 1;
+  }
+
+  // About four regions per cell when they are spread evenly
+  uint32_t side = 1;
+  while (side < REGION_GRID_MAX && side * side * 4 < count) {
+    side <<= 1;
+  }
+  int32_t width = table->right - table->left;
+  int32_t height = table->bottom - table->top;
+  table->columns = ((int32_t)side < width) ? side : (uint32_t)width;
+  table->rows = ((int32_t)side < height) ? side : (uint32_t)height;
+  table->cell_width = (width + (int32_t)table->columns - 1) / (int32_t)table->columns;
+  table->cell_height = (height + (int32_t)table->rows - 1) / (int32_t)table->rows;
+
+  uint32_t cells = table->columns * table->rows;
+  table->cell_start = calloc(cells + 1, sizeof(uint32_t));
+  if (table->cell_start == NULL) {
+    table_free(table);
+    return NULL;
+  }
+
+  // Count regions per cell, then fill the cells from the top region down.
+  size_t items = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    const region_rect* region = &table->regions[i];
+    if (rect_empty(region)) continue;
+    uint32_t column_end = cell_column(table, region->right - 1);
+    uint32_t row_end = cell_row(table, region->bottom - 1);
+    for (uint32_t row = cell_row(table, region->top); row <= row_end; row++) {
+      for (uint32_t column = cell_column(table, region->left); column <= column_end; column++) {
+        table->cell_start[row * table->columns + column + 1]++;
+        items++;
+      }
+    }
+  }
+  for (uint32_t cell = 0; cell < cells; cell++) {
+    table->cell_start[cell + 1] += table->cell_start[cell];
+  }
+
+  table->cell_items = malloc((items + 1) * sizeof(uint32_t));
+  uint32_t* cell_fill = calloc(cells, sizeof(uint32_t));
+  if (table->cell_items == NULL || cell_fill == NULL) {
+    free(cell_fill);
+    table_free(table);
+    return NULL;
+  }
+
+  for (uint32_t i = count; i-- > 0;) {
+    const region_rect* region = &table->regions[i];
+    if (rect_empty(region)) continue;
+    uint32_t column_end = cell_column(table, region->right - 1);
+    uint32_t row_end = cell_row(table, region->bottom - 1);
+    for (uint32_t row = cell_row(table, region->top); row <= row_end; row++) {
+      for (uint32_t column = cell_column(table, region->left); column <= column_end; column++) {
+        uint32_t cell = row * table->columns + column;
+        table->cell_items[table->cell_start[cell] + cell_fill[cell]++] = i;
+      }
+    }
+  }
+  free(cell_fill);
+  return table;
+}
+
+static const region_rect* table_hit(const region_table* table, int32_t x, int32_t y) {
+  if (x < table->left || x >= table->right || y < table->top || y >= table->bottom)
+    return NULL;
+
+  uint32_t cell = cell_row(table, y) * table->columns + cell_column(table, x);
+  for (uint32_t i = table->cell_start[cell]; i < table->cell_start[cell + 1]; i++) {
+    const region_rect* region = &table->regions[table->cell_items[i]];
+    if (x >= region->left && x < region->right && y >= region->top && y < region->bottom)
+      return region;
+  }
+  return NULL;
+}
+
+void regions_init(region_index* index) {
+  memset(index, 0, sizeof(region_index));
+}
+
+void regions_destroy(region_index* index) {
+  table_free(index->active_table);
+  index->active_table = NULL;
+}
+
+int regions_set(region_index* index, const int32_t* data, size_t length) {
+  region_table* table = NULL;
+
+  if (length != 0) {
+    if (length % 6 != 0 || length / 6 > REGION_MAX_COUNT) return -1;
+    for (size_t i = 0; i < length; i += 6) {
+      if (data[i] <= 0 || data[i] > REGION_MAX_ID || data[i + 3] <= 0 || data[i + 4] <= 0) return -1;
+    }
+
+    table = table_build(data, (uint32_t)(length / 6));
+    if (table == NULL) return -1;
+  }
+
+  region_table* old_table = atomic_exchange_ptr((void* volatile*)&index->active_table, table);
+
+  // Wait for the hook thread to leave the old table.
+  uint32_t seq = atomic_load_u32(&index->reader_seq);
+  if (seq & 1) {
+    while (atomic_load_u32(&index->reader_seq) == seq) {}
+  }
+  table_free(old_table);
+  return 0;
+}
+
+bool regions_match(region_index* index, const uiohook_event* event, region_hit* hit) {
+  int32_t x, y;
+  if (event->type == EVENT_MOUSE_WHEEL) {
+    x = event->data.wheel.x;
+    y = event->data.wheel.y;
+  }
+  else {
+    x = event->data.mouse.x;
+    y = event->data.mouse.y;
+  }
+
+  // Nothing registered and nothing to leave, the common case
+  if (index->hover_id == 0 && atomic_load_ptr((void* volatile*)&index->active_table) == NULL) {
+    hit->id = 0;
+    hit->types = 0;
+    hit->left = 0;
+    hit->entered = false;
+    return false;
+  }
+
+  atomic_add_u32(&index->reader_seq, 1);
+
+  region_table* table = atomic_load_ptr((void* volatile*)&index->active_table);
+  const region_rect* region = (table != NULL) ? table_hit(table, x, y) : NULL;
+  hit->id = (region != NULL) ? region->id : 0;
+  hit->types = (region != NULL) ? region->types : 0;
+
+  atomic_add_u32(&index->reader_seq, 1);
+
+  hit->left = 0;
+  hit->entered = false;
+  if (hit->id != index->hover_id) {
+    hit->left = index->hover_id;
+    hit->entered = hit->id != 0;
+    index->hover_id = hit->id;
+  }
+  return table != NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef ADDON_SRC_REGIONS_H_
+#define ADDON_SRC_REGIONS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <uiohook.h>
+
+#define REGION_MAX_ID 0xFFFF
+#define REGION_MAX_COUNT 4096
+#define REGION_GRID_MAX 64 // cells per side of the spatial index
+
+// Mouse events inside a region carry its id in the otherwise unused
+// reserved field, 0 - not in a region. EVENT_REGION_ENTER and
+// EVENT_REGION_LEAVE use the mouse data for the pointer position.
+#define REGION_EVENT_SET_ID(event, id) ((event)->reserved = (uint16_t)(id))
+#define REGION_EVENT_ID(event) ((uint16_t)(event)->reserved)
+
+typedef struct region_table region_table;
+
+typedef struct {
+  region_table* volatile active_table;
+  volatile uint32_t reader_seq; // odd while the hook thread reads the active table
+  // Hook thread state
+  uint16_t hover_id; // topmost region under the pointer, 0 - none
+} region_index;
+
+typedef struct {
+  uint16_t id; // topmost region under the pointer, 0 - none
+  uint32_t types; // bit per event type the region wants
+  uint16_t left; // the pointer left this region with the event, 0 - none
+  bool entered; // the pointer entered `id` with the event
+} region_hit;
+
+void regions_init(region_index* index);
+
+// The hook thread must not use the index anymore.
+void regions_destroy(region_index* index);
+
+// Replaces all regions. `data` is a sequence of [id, x, y, width, height,
+// event types], later regions are on top of earlier ones.
+// Called from the JS thread, safe while the hook is running.
+int regions_set(region_index* index, const int32_t* data, size_t length);
+
+// Hit-tests a mouse or wheel event, called from the hook thread. Returns
+// false when no regions are registered, mouse events are not filtered then.
+// Enter and leave transitions are reported either way.
+bool regions_match(region_index* index, const uiohook_event* event, region_hit* hit);
+
+#endif // !ADDON_SRC_REGIONS_H_
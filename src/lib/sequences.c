@@ -0,0 +1,262 @@
+#include <stdlib.h>
+#include <string.h>
+#include "atomic_helpers.h"
+#include "hotkeys.h"
+#include "sequences.h"
+
+// Sequences are compiled into an Aho-Corasick automaton: a trie of strokes
+// where every state also links to the longest proper suffix of its path
+// that is in the trie. A key press advances one state, following those
+// links when the trie has no edge for it, so no typed text is kept and
+// the cost doesn't grow with the number of sequences. Trie edges are an
+// open addressing hash table of (state, stroke) -> state, like hotkey
+// chords. Setting new sequences restarts matching from the root state.
+
+typedef struct {
+  uint64_t key; // (state << 32) | stroke, 0 - empty
+  uint32_t next;
+} sequence_edge;
+
+typedef struct {
+  uint32_t fail; // longest proper suffix in the trie, 0 - the root
+  uint32_t output; // nearest state on the fail chain where a sequence ends, 0 - none
+  uint32_t id;
+  uint16_t depth;
+  bool is_end;
+} sequence_state;
+
+struct sequence_table {
+  uint32_t generation;
+  sequence_backspace backspace;
+  bool reset_on_click;
+  uint32_t edge_mask;
+  sequence_edge* edges;
+  sequence_state* states;
+};
+
+static uint32_t hash_key(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xFF51AFD7ED558CCDull;
+  key ^= key >> 33;
+  return (uint32_t)key;
+}
+
+static uint64_t make_key(uint32_t state, uint32_t stroke) {
+  // +1 so the root state never produces an empty key
+  return ((uint64_t)(state + 1) << 32) | stroke;
+}
+
+static sequence_edge* edge_find(sequence_table* table, uint64_t key, bool insert) {
+  for (uint32_t i = hash_key(key) & table->edge_mask;; i = (i + 1) & table->edge_mask) {
+    sequence_edge* edge = &table->edges[i];
+    if (edge->key == key) return edge;
+    if (edge->key == 0) {
+      if (!insert) return NULL;
+      edge->key = key;
+      return edge;
+    }
+  }
+}
+
+static void table_free(sequence_table* table) {
+  if (table == NULL) return;
+  free(table->edges);
+  free(table->states);
+  free(table);
+}
+
+// The state after `stroke`, falling back to shorter suffixes until one
+// continues with it.
+static uint32_t table_step(sequence_table* table, uint32_t state, uint32_t stroke) {
+  for (;;) {
+    sequence_edge* edge = edge_find(table, make_key(state, stroke), false);
+    if (edge != NULL) return edge->next;
+    if (state == 0) return 0;
+    state = table->states[state].fail;
+  }
+}
+
+static sequence_table* table_build(const uint32_t* data, size_t length, uint32_t strokes) {
+  sequence_table* table = calloc(1, sizeof(sequence_table));
+  if (table == NULL) return NULL;
+
+  uint32_t size = 16;
+  while (size < strokes * 2) {
+    size <<= 1;
+  }
+  table->edge_mask = size - 1;
+  table->edges = calloc(size, sizeof(sequence_edge));
+  table->states = calloc(strokes + 1, sizeof(sequence_state));
+  // Per state: the state it was entered from and with which stroke
+  uint32_t* parents = malloc((strokes + 1) * sizeof(uint32_t));
+  uint32_t* entered_with = malloc((strokes + 1) * sizeof(uint32_t));
+  uint32_t* order = malloc((strokes + 1) * sizeof(uint32_t));
+  if (table->edges == NULL || table->states == NULL || parents == NULL || entered_with == NULL || order == NULL) {
+    free(parents);
+    free(entered_with);
+    free(order);
+    table_free(table);
+    return NULL;
+  }
+
+  // The trie
+  uint32_t state_count = 1;
+  for (size_t i = 0; i < length;) {
+    uint32_t id = data[i];
+    uint32_t count = data[i + 1];
+    const uint32_t* sequence = &data[i + 2];
+    i += 2 + count;
+
+    uint32_t state = 0;
+    for (uint32_t s = 0; s < count; s++) {
+      sequence_edge* edge = edge_find(table, make_key(state, sequence[s]), true);
+      if (edge->next == 0) {
+        edge->next = state_count;
+        parents[state_count] = state;
+        entered_with[state_count] = sequence[s];
+        table->states[state_count].depth = table->states[state].depth + 1;
+        state_count++;
+      }
+      state = edge->next;
+    }
+    // The same strokes registered twice, the later id wins.
+    table->states[state].is_end = true;
+    table->states[state].id = id;
+  }
+
+  // Suffix links are resolved in breadth-first order, a suffix is always
+  // shallower than the state itself. States are sorted by depth first.
+  uint32_t depth_start[SEQUENCE_MAX_STROKES + 2] = { 0 };
+  for (uint32_t state = 1; state < state_count; state++) {
+    depth_start[table->states[state].depth + 1]++;
+  }
+  for (uint32_t depth = 1; depth <= SEQUENCE_MAX_STROKES + 1; depth++) {
+    depth_start[depth] += depth_start[depth - 1];
+  }
+  for (uint32_t state = 1; state < state_count; state++) {
+    order[depth_start[table->states[state].depth]++] = state;
+  }
+
+  for (uint32_t i = 0; i < state_count - 1; i++) {
+    uint32_t state = order[i];
+    uint32_t parent = parents[state];
+    sequence_state* current = &table->states[state];
+
+    current->fail = (parent != 0) ? table_step(table, table->states[parent].fail, entered_with[state]) : 0;
+    const sequence_state* fail = &table->states[current->fail];
+    current->output = fail->is_end ? current->fail : fail->output;
+  }
+
+  free(parents);
+  free(entered_with);
+  free(order);
+  return table;
+}
+
+void sequences_init(sequence_matcher* matcher) {
+  memset(matcher, 0, sizeof(sequence_matcher));
+}
+
+void sequences_destroy(sequence_matcher* matcher) {
+  table_free(matcher->active_table);
+  matcher->active_table = NULL;
+}
+
+int sequences_set(sequence_matcher* matcher, const uint32_t* data, size_t length,
+                  sequence_backspace backspace, bool reset_on_click) {
+  sequence_table* table = NULL;
+
+  if (length != 0) {
+    // Validate and count strokes to size the table.
+    size_t strokes = 0;
+    size_t sequences = 0;
+    for (size_t i = 0; i < length;) {
+      if (i + 2 > length) return -1;
+      uint32_t count = data[i + 1];
+      if (count == 0 || count > SEQUENCE_MAX_STROKES || i + 2 + count > length) return -1;
+      strokes += count;
+      sequences++;
+      i += 2 + count;
+    }
+    if (sequences > SEQUENCE_MAX_COUNT) return -1;
+
+    table = table_build(data, length, (uint32_t)strokes);
+    if (table == NULL) return -1;
+    table->generation = ++matcher->table_generation;
+    table->backspace = backspace;
+    table->reset_on_click = reset_on_click;
+  }
+
+  // Published and retired the same way as hotkey tables, see hotkeys_set()
+  sequence_table* old_table = atomic_exchange_ptr((void* volatile*)&matcher->active_table, table);
+
+  // Wait for the hook thread to leave the old table.
+  uint32_t seq = atomic_load_u32(&matcher->reader_seq);
+  if (seq & 1) {
+    while (atomic_load_u32(&matcher->reader_seq) == seq) {}
+  }
+  table_free(old_table);
+  return 0;
+}
+
+static void matcher_reset(sequence_matcher* matcher) {
+  matcher->state = 0;
+  matcher->history_top = 0;
+  matcher->history_length = 0;
+}
+
+uint32_t sequences_push(sequence_matcher* matcher, const uiohook_event* event, sequence_match* matches) {
+  if (atomic_load_ptr((void* volatile*)&matcher->active_table) == NULL) return 0;
+
+  atomic_add_u32(&matcher->reader_seq, 1);
+
+  uint32_t count = 0;
+  sequence_table* table = atomic_load_ptr((void* volatile*)&matcher->active_table);
+  if (table != NULL) {
+    if (table->generation != matcher->generation) {
+      matcher->generation = table->generation;
+      matcher_reset(matcher);
+    }
+
+    uint16_t keycode = event->data.keyboard.keycode;
+    if (event->type == EVENT_MOUSE_PRESSED) {
+      if (table->reset_on_click) {
+        matcher_reset(matcher);
+      }
+    }
+    else if (hotkey_is_modifier_key(keycode)) {
+      // Part of the next stroke
+    }
+    else if (keycode == VC_BACKSPACE && table->backspace != sequence_backspace_stroke) {
+      if (table->backspace == sequence_backspace_undo && matcher->history_length != 0) {
+        matcher->history_top = (matcher->history_top + SEQUENCE_MAX_STROKES - 1) % SEQUENCE_MAX_STROKES;
+        matcher->history_length--;
+        matcher->state = matcher->history[matcher->history_top];
+      }
+      else {
+        matcher_reset(matcher);
+      }
+    }
+    else {
+      matcher->history[matcher->history_top] = matcher->state;
+      matcher->history_top = (matcher->history_top + 1) % SEQUENCE_MAX_STROKES;
+      if (matcher->history_length < SEQUENCE_MAX_STROKES) {
+        matcher->history_length++;
+      }
+
+      matcher->state = table_step(table, matcher->state, hotkey_event_stroke(event));
+
+      const sequence_state* state = &table->states[matcher->state];
+      uint32_t end = state->is_end ? matcher->state : state->output;
+      while (end != 0 && count < SEQUENCE_MAX_MATCHES) {
+        matches[count].id = table->states[end].id;
+        matches[count].length = table->states[end].depth;
+        count++;
+        end = table->states[end].output;
+      }
+    }
+  }
+
+  atomic_add_u32(&matcher->reader_seq, 1);
+  return count;
+}
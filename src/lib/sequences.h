@@ -0,0 +1,67 @@
+#ifndef ADDON_SRC_SEQUENCES_H_
+#define ADDON_SRC_SEQUENCES_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <uiohook.h>
+
+// Typed sequences, such as text expansion abbreviations, matched on the
+// hook thread. Strokes are the same as for hotkeys, see HOTKEY_STROKE().
+
+// EVENT_SEQUENCE carries the id in the keyboard data, the number of
+// strokes matched in the reserved field.
+#define SEQUENCE_EVENT_SET(event, id, length) \
+  do { \
+    (event)->data.keyboard.keycode = (uint16_t)((id) & 0xFFFF); \
+    (event)->data.keyboard.rawcode = (uint16_t)((id) >> 16); \
+    (event)->reserved = (uint16_t)(length); \
+  } while (0)
+#define SEQUENCE_EVENT_ID(event) \
+  ((uint32_t)(event)->data.keyboard.keycode | ((uint32_t)(event)->data.keyboard.rawcode << 16))
+
+#define SEQUENCE_MAX_STROKES 64
+#define SEQUENCE_MAX_COUNT 16384
+#define SEQUENCE_MAX_MATCHES 8 // reported per key press, longest first
+
+typedef enum {
+  sequence_backspace_undo, // steps back one stroke
+  sequence_backspace_reset,
+  sequence_backspace_stroke // an ordinary stroke
+} sequence_backspace;
+
+typedef struct sequence_table sequence_table;
+
+typedef struct {
+  sequence_table* volatile active_table;
+  uint32_t table_generation;
+  volatile uint32_t reader_seq; // odd while the hook thread reads the active table
+  // Hook thread state
+  uint32_t generation;
+  uint32_t state;
+  uint32_t history[SEQUENCE_MAX_STROKES]; // states before the last strokes, for backspace
+  uint32_t history_top;
+  uint32_t history_length;
+} sequence_matcher;
+
+typedef struct {
+  uint32_t id;
+  uint32_t length; // strokes
+} sequence_match;
+
+void sequences_init(sequence_matcher* matcher);
+
+// The hook thread must not use the matcher anymore.
+void sequences_destroy(sequence_matcher* matcher);
+
+// Replaces all registered sequences. `data` is a sequence of
+// [id, stroke count, strokes...], like for hotkeys_set().
+// Called from the JS thread, safe while the hook is running.
+int sequences_set(sequence_matcher* matcher, const uint32_t* data, size_t length,
+                  sequence_backspace backspace, bool reset_on_click);
+
+// Advances the matcher with a key or mouse button press, called from the
+// hook thread. Returns the number of sequences ending with this press.
+uint32_t sequences_push(sequence_matcher* matcher, const uiohook_event* event, sequence_match* matches);
+
+#endif // !ADDON_SRC_SEQUENCES_H_
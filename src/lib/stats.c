@@ -0,0 +1,65 @@
+#include <string.h>
+#include "stats.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+
+static uint32_t highest_bit(uint64_t value) {
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return (uint32_t)index;
+}
+#else
+static uint32_t highest_bit(uint64_t value) {
+  return 63 - (uint32_t)__builtin_clzll(value);
+}
+#endif
+
+static uint32_t bucket_index(uint64_t value) {
+  if (value < STATS_SUB_BUCKETS) return (uint32_t)value;
+
+  uint32_t magnitude = highest_bit(value);
+  if (magnitude > STATS_MAX_MAGNITUDE) return STATS_HISTOGRAM_BUCKETS - 1;
+
+  uint32_t sub_bucket = (uint32_t)(value >> (magnitude - 4)) & (STATS_SUB_BUCKETS - 1);
+  return (magnitude - 3) * STATS_SUB_BUCKETS + sub_bucket;
+}
+
+uint64_t stats_bucket_upper(uint32_t index) {
+  if (index < STATS_SUB_BUCKETS) return index;
+  if (index == STATS_HISTOGRAM_BUCKETS - 1) return UINT64_MAX;
+
+  uint32_t magnitude = index / STATS_SUB_BUCKETS + 3;
+  uint64_t sub_bucket = index % STATS_SUB_BUCKETS;
+  uint64_t width = 1ull << (magnitude - 4);
+  return ((STATS_SUB_BUCKETS + sub_bucket) << (magnitude - 4)) + width - 1;
+}
+
+void stats_histogram_reset(stats_histogram* histogram) {
+  memset(histogram, 0, sizeof(stats_histogram));
+}
+
+void stats_histogram_record(stats_histogram* histogram, uint64_t value) {
+  histogram->counts[bucket_index(value)]++;
+  if (histogram->count == 0 || value < histogram->min) histogram->min = value;
+  if (value > histogram->max) histogram->max = value;
+  histogram->sum += (double)value;
+  histogram->count++;
+}
+
+uint64_t stats_histogram_percentile(const stats_histogram* histogram, double quantile) {
+  if (histogram->count == 0) return 0;
+
+  uint64_t rank = (uint64_t)(quantile * (double)histogram->count);
+  if (rank >= histogram->count) rank = histogram->count - 1;
+
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+    seen += histogram->counts[i];
+    if (seen > rank) {
+      uint64_t upper = stats_bucket_upper(i);
+      return (upper < histogram->max) ? upper : histogram->max;
+    }
+  }
+  return histogram->max;
+}
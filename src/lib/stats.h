@@ -0,0 +1,32 @@
+#ifndef ADDON_SRC_STATS_H_
+#define ADDON_SRC_STATS_H_
+
+#include <stdint.h>
+
+// Log-linear buckets like HdrHistogram: values below 16 are exact, above
+// that every power of two is split into 16 buckets (~6% precision).
+// The last bucket holds everything from 2^39 ns (~9 minutes) up.
+#define STATS_SUB_BUCKETS 16
+#define STATS_MAX_MAGNITUDE 39
+#define STATS_HISTOGRAM_BUCKETS ((STATS_MAX_MAGNITUDE - 2) * STATS_SUB_BUCKETS)
+
+typedef struct {
+  uint64_t counts[STATS_HISTOGRAM_BUCKETS];
+  uint64_t count;
+  uint64_t min;
+  uint64_t max;
+  double sum;
+} stats_histogram;
+
+void stats_histogram_reset(stats_histogram* histogram);
+
+// Not thread safe, every histogram has a single writer.
+void stats_histogram_record(stats_histogram* histogram, uint64_t value);
+
+// Highest value that falls into the bucket.
+uint64_t stats_bucket_upper(uint32_t index);
+
+// Upper bound of the bucket that holds the `quantile`, clamped to max.
+uint64_t stats_histogram_percentile(const stats_histogram* histogram, double quantile);
+
+#endif // !ADDON_SRC_STATS_H_
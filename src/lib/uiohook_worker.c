@@ -1,5 +1,10 @@
+#ifdef __linux__
+#define _GNU_SOURCE // pthread_setaffinity_np
+#endif
+
+#include <errno.h>
 #include <stdarg.h>
-#include <stdio.h>
+#include <string.h>
 #include <uiohook.h>
 #include <uv.h>
 
@@ -8,8 +13,12 @@
 #else
 #include <pthread.h>
 #include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #endif
 
+#include "atomic_helpers.h"
+#include "log_ring.h"
 #include "uiohook_worker.h"
 
 // Thread and mutex variables.
@@ -19,22 +28,180 @@ static uv_mutex_t hook_running_mutex;
 static uv_mutex_t hook_control_mutex;
 static uv_cond_t hook_control_cond;
 
-static dispatcher_t user_dispatcher = NULL;
-
+static worker_dispatcher_t user_dispatcher = NULL;
+static volatile bool capture_timestamps = false;
+
+static worker_thread_options thread_options;
+static volatile uint32_t measure_jitter = 0; // thread_options.measure_jitter for the hook thread
+static worker_thread_report thread_report;
+static volatile uint32_t buffer_memory_error = 0; // of the last addon buffer, kept across starts
+// Written before the hook thread signals hook_control_cond
+static worker_start_times start_times;
+static volatile uint64_t locked_bytes = 0; // the hook thread stack and addon buffers
+static uintptr_t locked_stack = 0; // hook thread only, the range is below its frames
+// Hook thread only
+static stats_histogram jitter_histogram;
+static int64_t jitter_min_offset;
+
+// One bit per keycode and per mouse button, written only by the hook thread.
+#define KEY_STATE_WORDS (0x10000 / 32)
+static volatile uint32_t key_state[KEY_STATE_WORDS];
+static volatile uint32_t button_state = 0;
+// x and y as uint16_t, CURSOR_KNOWN once a mouse event was seen
+#define CURSOR_KNOWN ((uint64_t)1 << 32)
+static volatile uint64_t cursor_state = 0;
+// Auto-repeat counts of held keys, hook thread only. Only the last pressed
+// key repeats, so a few slots cover keys held together.
+#define REPEAT_SLOTS 8
+static struct {
+  uint16_t keycode;
+  uint16_t count; // 0 - free
+} repeat_slots[REPEAT_SLOTS];
+static uint32_t repeat_next_slot = 0;
+static uint16_t dispatch_repeat = 0; // of the event being dispatched
+
+// Formats into the log ring, stderr or the JS log handler is written by
+// the drain thread so the hook thread never waits on it.
 bool logger_proc(unsigned int level, const char* format, ...) {
-  bool status = false;
-
   va_list args;
-  switch (level) {
-  case LOG_LEVEL_WARN:
-  case LOG_LEVEL_ERROR:
-    va_start(args, format);
-    status = vfprintf(stderr, format, args) >= 0;
-    va_end(args);
+  va_start(args, format);
+  bool status = log_ring_push(level, format, args);
+  va_end(args);
+
+  return status;
+}
+
+static void input_state_reset() {
+  for (uint32_t i = 0; i < KEY_STATE_WORDS; i++) {
+    atomic_store_u32(&key_state[i], 0);
+  }
+  atomic_store_u32(&button_state, 0);
+  atomic_store_u64(&cursor_state, 0);
+  memset(repeat_slots, 0, sizeof(repeat_slots));
+}
+
+static uint16_t repeat_counted(uint16_t keycode) {
+  for (uint32_t i = 0; i < REPEAT_SLOTS; i++) {
+    if (repeat_slots[i].count != 0 && repeat_slots[i].keycode == keycode) {
+      if (repeat_slots[i].count < UINT16_MAX) {
+        repeat_slots[i].count++;
+      }
+      return repeat_slots[i].count;
+    }
+  }
+
+  // Take a free slot, or the oldest one if all are taken
+  uint32_t slot = repeat_next_slot++ % REPEAT_SLOTS;
+  for (uint32_t i = 0; i < REPEAT_SLOTS; i++) {
+    if (repeat_slots[i].count == 0) {
+      slot = i;
+      break;
+    }
+  }
+  repeat_slots[slot].keycode = keycode;
+  repeat_slots[slot].count = 1;
+  return 1;
+}
+
+static uint16_t repeat_released(uint16_t keycode) {
+  for (uint32_t i = 0; i < REPEAT_SLOTS; i++) {
+    if (repeat_slots[i].count != 0 && repeat_slots[i].keycode == keycode) {
+      uint16_t count = repeat_slots[i].count;
+      repeat_slots[i].count = 0;
+      return count;
+    }
+  }
+  return 0;
+}
+
+static void cursor_update(int16_t x, int16_t y) {
+  atomic_store_u64(&cursor_state, CURSOR_KNOWN | ((uint64_t)(uint16_t)y << 16) | (uint16_t)x);
+}
+
+static void input_state_update(const uiohook_event* event) {
+  dispatch_repeat = 0;
+
+  switch (event->type) {
+  case EVENT_KEY_PRESSED: {
+    uint16_t keycode = event->data.keyboard.keycode;
+    if (uiohook_worker_key_down(keycode)) {
+      dispatch_repeat = repeat_counted(keycode);
+    }
+    atomic_or_u32(&key_state[keycode / 32], 1u << (keycode % 32));
+    break;
+  }
+  case EVENT_KEY_RELEASED: {
+    uint16_t keycode = event->data.keyboard.keycode;
+    dispatch_repeat = repeat_released(keycode);
+    atomic_and_u32(&key_state[keycode / 32], ~(1u << (keycode % 32)));
     break;
   }
+  case EVENT_MOUSE_PRESSED:
+    if (event->data.mouse.button < 32) {
+      atomic_or_u32(&button_state, 1u << event->data.mouse.button);
+    }
+    cursor_update(event->data.mouse.x, event->data.mouse.y);
+    break;
+  case EVENT_MOUSE_RELEASED:
+    if (event->data.mouse.button < 32) {
+      atomic_and_u32(&button_state, ~(1u << event->data.mouse.button));
+    }
+    cursor_update(event->data.mouse.x, event->data.mouse.y);
+    break;
+  case EVENT_MOUSE_CLICKED:
+  case EVENT_MOUSE_MOVED:
+  case EVENT_MOUSE_DRAGGED:
+    cursor_update(event->data.mouse.x, event->data.mouse.y);
+    break;
+  case EVENT_MOUSE_WHEEL:
+    cursor_update(event->data.wheel.x, event->data.wheel.y);
+    break;
+  default:
+    break;
+  }
+}
 
-  return status;
+bool uiohook_worker_key_down(uint16_t keycode) {
+  return (atomic_load_u32(&key_state[keycode / 32]) >> (keycode % 32)) & 1;
+}
+
+uint16_t uiohook_worker_key_repeat() {
+  return dispatch_repeat;
+}
+
+bool uiohook_worker_button_down(uint16_t button) {
+  return button < 32 && ((atomic_load_u32(&button_state) >> button) & 1);
+}
+
+uint32_t uiohook_worker_pressed_keys(uint16_t* keycodes, uint32_t max) {
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < KEY_STATE_WORDS && count < max; i++) {
+    uint32_t word = atomic_load_u32(&key_state[i]);
+    for (uint32_t bit = 0; word != 0 && count < max; bit++, word >>= 1) {
+      if (word & 1) {
+        keycodes[count++] = (uint16_t)(i * 32 + bit);
+      }
+    }
+  }
+  return count;
+}
+
+bool uiohook_worker_cursor(int16_t* x, int16_t* y) {
+  uint64_t cursor = atomic_load_u64(&cursor_state);
+  *x = (int16_t)(uint16_t)cursor;
+  *y = (int16_t)(uint16_t)(cursor >> 16);
+  return (cursor & CURSOR_KNOWN) != 0;
+}
+
+// Event times come from the OS input clock in ms, its offset from uv_hrtime()
+// is constant, so how much the offset exceeds the lowest one seen is how
+// late the event was dispatched compared to the best case.
+static void jitter_record(const uiohook_event* event) {
+  int64_t offset = (int64_t)uv_hrtime() - (int64_t)event->time * 1000000;
+  if (jitter_histogram.count == 0 || offset < jitter_min_offset) {
+    jitter_min_offset = offset;
+  }
+  stats_histogram_record(&jitter_histogram, (uint64_t)(offset - jitter_min_offset));
 }
 
 // NOTE: The following callback executes on the same thread that hook_run() is called 
@@ -46,6 +213,8 @@ bool logger_proc(unsigned int level, const char* format, ...) {
 void worker_dispatch_proc(uiohook_event* const event) {
   switch (event->type) {
   case EVENT_HOOK_ENABLED:
+    start_times.hook_enabled = uv_hrtime();
+
     // Lock the running mutex so we know if the hook is enabled.
     uv_mutex_lock(&hook_running_mutex);
 
@@ -72,7 +241,11 @@ void worker_dispatch_proc(uiohook_event* const event) {
   case EVENT_MOUSE_MOVED:
   case EVENT_MOUSE_DRAGGED:
   case EVENT_MOUSE_WHEEL: {
-    user_dispatcher(event);
+    if (atomic_load_u32(&measure_jitter)) {
+      jitter_record(event);
+    }
+    input_state_update(event);
+    user_dispatcher(event, capture_timestamps ? uv_hrtime() : 0);
     break;
   }
 
@@ -81,30 +254,184 @@ void worker_dispatch_proc(uiohook_event* const event) {
   }
 }
 
-void hook_thread_proc(void* arg) {
+static int memory_lock(void* address, size_t size) {
+  #ifdef _WIN32
+  if (VirtualLock(address, size) == FALSE) return (int)GetLastError();
+  #else
+  // POSIX allows requiring a page aligned address
+  uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)address & ~(page_size - 1);
+  if (mlock((void*)start, size + ((uintptr_t)address - start)) != 0) return errno;
+  #endif
+  return 0;
+}
+
+static int memory_lock_counted(void* address, size_t size) {
+  int error = memory_lock(address, size);
+  if (error != 0) {
+    logger_proc(LOG_LEVEL_WARN, "%s [%u]: Could not lock %lu bytes in memory! (%i)\n",
+      __FUNCTION__, __LINE__, (unsigned long)size, error);
+    return error;
+  }
+  atomic_add_u64(&locked_bytes, size);
+  return 0;
+}
+
+bool uiohook_worker_lock_memory(void* address, size_t size) {
+  if (!thread_options.lock_memory || size == 0) return false;
+
+  // Buffers are locked before the hook thread starts and resets its report.
+  int error = memory_lock_counted(address, size);
+  atomic_store_u32(&buffer_memory_error, (uint32_t)error);
+  return error == 0;
+}
+
+void uiohook_worker_unlock_memory(void* address, size_t size) {
+  #ifdef _WIN32
+  VirtualUnlock(address, size);
+  #else
+  uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)address & ~(page_size - 1);
+  munlock((void*)start, size + ((uintptr_t)address - start));
+  #endif
+  atomic_add_u64(&locked_bytes, (uint64_t)0 - size);
+}
+
+// Commits the part of the stack the hook is going to use and locks it,
+// the array is below the frame of the caller.
+static void stack_lock() {
+  volatile char stack[WORKER_STACK_LOCK_SIZE];
+  for (size_t i = 0; i < sizeof(stack); i += 1024) {
+    stack[i] = 0;
+  }
+  thread_report.memory_error = memory_lock_counted((void*)stack, sizeof(stack));
+  if (thread_report.memory_error == 0) {
+    locked_stack = (uintptr_t)stack;
+  }
+}
+
+static void thread_apply_scheduling() {
+  worker_sched_policy policy = thread_options.policy;
+  thread_report.policy = worker_sched_inherit;
+
   #ifdef _WIN32
-  // Attempt to set the thread priority to time critical.
   HANDLE this_thread = GetCurrentThread();
-  if (SetThreadPriority(this_thread, THREAD_PRIORITY_TIME_CRITICAL) == FALSE) {
-    logger_proc(LOG_LEVEL_WARN, "%s [%u]: Could not set thread priority %li for thread %#p! (%#lX)\n",
-      __FUNCTION__, __LINE__, (long)THREAD_PRIORITY_TIME_CRITICAL,
-      this_thread, (unsigned long)GetLastError());
+  if (policy != worker_sched_inherit) {
+    // Windows has no policies, only priorities
+    int priority = (policy == worker_sched_other) ? THREAD_PRIORITY_NORMAL : THREAD_PRIORITY_TIME_CRITICAL;
+    if (thread_options.priority != 0) {
+      priority = thread_options.priority;
+    }
+    if (SetThreadPriority(this_thread, priority) == FALSE) {
+      thread_report.sched_error = (int)GetLastError();
+      logger_proc(LOG_LEVEL_WARN, "%s [%u]: Could not set thread priority %li for thread %#p! (%#lX)\n",
+        __FUNCTION__, __LINE__, (long)priority,
+        this_thread, (unsigned long)thread_report.sched_error);
+    }
+    else {
+      thread_report.policy = policy;
+    }
   }
+  thread_report.priority = GetThreadPriority(this_thread);
   #else
-  // Raise the thread priority
   pthread_t this_thread = pthread_self();
-  struct sched_param params = {
-    .sched_priority = (sched_get_priority_max(SCHED_RR) / 2)
-  };
-  if (pthread_setschedparam(this_thread, SCHED_RR, &params) != 0) {
-    logger_proc(LOG_LEVEL_WARN, "%s [%u]: Could not set thread priority %i for thread 0x%lX!\n",
-      __FUNCTION__, __LINE__, params.sched_priority, (unsigned long)this_thread);
+  if (policy != worker_sched_inherit) {
+    int sched_policy = (policy == worker_sched_fifo) ? SCHED_FIFO : (policy == worker_sched_other) ? SCHED_OTHER : SCHED_RR;
+    struct sched_param params = {
+      .sched_priority = (thread_options.priority != 0)
+        ? thread_options.priority
+        : (sched_policy == SCHED_OTHER) ? 0 : (sched_get_priority_max(sched_policy) / 2)
+    };
+    thread_report.sched_error = pthread_setschedparam(this_thread, sched_policy, &params);
+    if (thread_report.sched_error != 0) {
+      logger_proc(LOG_LEVEL_WARN, "%s [%u]: Could not set thread priority %i for thread 0x%lX!\n",
+        __FUNCTION__, __LINE__, params.sched_priority, (unsigned long)this_thread);
+    }
+  }
+
+  int sched_policy;
+  struct sched_param params;
+  if (pthread_getschedparam(this_thread, &sched_policy, &params) == 0) {
+    thread_report.policy = (sched_policy == SCHED_FIFO) ? worker_sched_fifo
+      : (sched_policy == SCHED_RR) ? worker_sched_rr : worker_sched_other;
+    thread_report.priority = params.sched_priority;
+  }
+  #endif
+}
+
+static bool cpus_empty(const uint64_t* cpus) {
+  for (int i = 0; i < WORKER_CPU_WORDS; i++) {
+    if (cpus[i] != 0) return false;
+  }
+  return true;
+}
+
+static void thread_apply_affinity() {
+  if (cpus_empty(thread_options.cpus)) return;
+
+  #if defined(_WIN32)
+  // A thread mask only covers the first processor group, as many CPUs
+  // as DWORD_PTR has bits. Don't pin to a subset of what was asked for.
+  for (int cpu = (int)sizeof(DWORD_PTR) * 8; cpu < WORKER_MAX_CPUS; cpu++) {
+    if ((thread_options.cpus[cpu / 64] >> (cpu % 64)) & 1) {
+      thread_report.affinity_error = ERROR_NOT_SUPPORTED;
+      break;
+    }
+  }
+  if (thread_report.affinity_error == 0) {
+    DWORD_PTR mask = (DWORD_PTR)thread_options.cpus[0];
+    if (SetThreadAffinityMask(GetCurrentThread(), mask) == 0) {
+      thread_report.affinity_error = (int)GetLastError();
+    }
+    else {
+      thread_report.cpus[0] = mask;
+    }
   }
+  #elif defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu = 0; cpu < WORKER_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+    if ((thread_options.cpus[cpu / 64] >> (cpu % 64)) & 1) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  thread_report.affinity_error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (thread_report.affinity_error == 0 && pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < WORKER_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &set)) {
+        thread_report.cpus[cpu / 64] |= (uint64_t)1 << (cpu % 64);
+      }
+    }
+  }
+  #else
+  // macOS only has affinity hints between threads of a process
+  thread_report.affinity_error = ENOTSUP;
   #endif
 
+  if (thread_report.affinity_error != 0) {
+    logger_proc(LOG_LEVEL_WARN, "%s [%u]: Could not set the CPU affinity of the hook thread! (%i)\n",
+      __FUNCTION__, __LINE__, thread_report.affinity_error);
+  }
+}
+
+void hook_thread_proc(void* arg) {
+  start_times.thread_started = uv_hrtime();
+  thread_apply_scheduling();
+  thread_apply_affinity();
+  if (thread_options.lock_memory) {
+    stack_lock();
+  }
+  thread_report.started = true;
+
   // Set the hook status.
+  start_times.hook_run = uv_hrtime();
   hook_thread_status = hook_run();
 
+  if (locked_stack != 0) {
+    uiohook_worker_unlock_memory((void*)locked_stack, WORKER_STACK_LOCK_SIZE);
+    locked_stack = 0;
+  }
+
   // Make sure we signal that we have passed any exception throwing code for
   // the waiting hook_enable().
   uv_cond_signal(&hook_control_cond);
@@ -119,6 +446,7 @@ int hook_enable() {
   // Set the initial status.
   int status = UIOHOOK_FAILURE;
 
+  start_times.thread_create = uv_hrtime();
   if (uv_thread_create(&hook_thread, hook_thread_proc, NULL) == 0) {
     // Wait for the thread to indicate that it has passed the 
     // initialization portion by blocking until either a EVENT_HOOK_ENABLED 
@@ -154,7 +482,32 @@ int hook_enable() {
 }
 
 
-int uiohook_worker_start(dispatcher_t dispatch_proc) {
+void uiohook_worker_thread_options(const worker_thread_options* options) {
+  thread_options = *options;
+  // The only option the hook thread reads while it runs
+  atomic_store_u32(&measure_jitter, options->measure_jitter ? 1 : 0);
+}
+
+void uiohook_worker_thread_report(worker_thread_report* report, stats_histogram* jitter) {
+  *report = thread_report;
+  report->locked_bytes = atomic_load_u64(&locked_bytes);
+  if (report->memory_error == 0) {
+    report->memory_error = (int)atomic_load_u32(&buffer_memory_error);
+  }
+  if (jitter != NULL) {
+    *jitter = jitter_histogram;
+  }
+}
+
+void uiohook_worker_timestamps(bool enabled) {
+  capture_timestamps = enabled;
+}
+
+void uiohook_worker_start_times(worker_start_times* times) {
+  *times = start_times;
+}
+
+int uiohook_worker_start(worker_dispatcher_t dispatch_proc) {
   // Lock the thread control mutex.  This will be unlocked when the
   // thread has finished starting, or when it has fully stopped.
 
@@ -164,16 +517,22 @@ int uiohook_worker_start(dispatcher_t dispatch_proc) {
   uv_cond_init(&hook_control_cond);
 
   // Set the logger callback for library output.
+  log_ring_init();
   hook_set_logger_proc(logger_proc);
 
   // Set the event callback for uiohook events.
   hook_set_dispatch_proc(worker_dispatch_proc);
 
   user_dispatcher = dispatch_proc;
+  input_state_reset();
+  memset(&thread_report, 0, sizeof(thread_report));
+  stats_histogram_reset(&jitter_histogram);
 
   // Start the hook and block.
   // NOTE If EVENT_HOOK_ENABLED was delivered, the status will always succeed.
+  memset(&start_times, 0, sizeof(start_times));
   int status = hook_enable();
+  start_times.returned = uv_hrtime();
   if (status != UIOHOOK_SUCCESS) {
     // Close event handles for the thread hook.
     uv_mutex_destroy(&hook_running_mutex);
@@ -189,6 +548,7 @@ int uiohook_worker_stop() {
 
   if (status == UIOHOOK_SUCCESS) {
     uv_thread_join(&hook_thread);
+    input_state_reset();
 
     // Close event handles for the thread hook.
     uv_mutex_destroy(&hook_running_mutex);
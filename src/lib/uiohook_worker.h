@@ -1,12 +1,110 @@
 #ifndef ADDON_SRC_UIOHOOK_WORKER_H_
 #define ADDON_SRC_UIOHOOK_WORKER_H_
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <uiohook.h>
 
+#include "stats.h"
+
 #define UIOHOOK_ERROR_THREAD_CREATE				0x10
 
-int uiohook_worker_start(dispatcher_t dispatch_proc);
+// Events generated by the addon, delivered to JS the same way as uiohook events.
+#define EVENT_HOTKEY				16
+#define EVENT_REGION_ENTER			17
+#define EVENT_REGION_LEAVE			18
+#define EVENT_SEQUENCE				19
+
+// Key events carry uiohook_worker_key_repeat() in the otherwise unused
+// reserved field, see REGION_EVENT_ID for mouse events.
+#define KEY_EVENT_SET_REPEAT(event, count) ((event)->reserved = (uint16_t)(count))
+#define KEY_EVENT_REPEAT(event) ((uint16_t)(event)->reserved)
+
+// Called on the hook thread for input events. `captured` is uv_hrtime()
+// when the event reached the hook thread, or 0 if timestamps are disabled.
+typedef void (*worker_dispatcher_t)(uiohook_event* const event, uint64_t captured);
+
+typedef enum {
+  worker_sched_default, // SCHED_RR at half the max priority, time critical on Windows
+  worker_sched_inherit, // leave the thread as it was created
+  worker_sched_other,
+  worker_sched_rr,
+  worker_sched_fifo
+} worker_sched_policy;
+
+#define WORKER_MAX_CPUS 256
+#define WORKER_CPU_WORDS (WORKER_MAX_CPUS / 64)
+#define WORKER_STACK_LOCK_SIZE (128 * 1024) // bytes of the hook thread stack locked in memory
+
+typedef struct {
+  worker_sched_policy policy;
+  int32_t priority; // 0 - the default for the policy
+  uint64_t cpus[WORKER_CPU_WORDS]; // bit per CPU, all zero - any CPU
+  bool lock_memory; // the hook thread stack and event buffers
+  bool measure_jitter;
+} worker_thread_options;
+
+// What was applied to the hook thread when it started, errors are
+// errno or GetLastError() values, 0 on success.
+typedef struct {
+  bool started;
+  worker_sched_policy policy;
+  int32_t priority;
+  int sched_error;
+  uint64_t cpus[WORKER_CPU_WORDS]; // all zero if unknown
+  int affinity_error;
+  uint64_t locked_bytes;
+  int memory_error; // the hook thread stack, or else the last event buffer locked
+} worker_thread_report;
+
+// Applied when the hook thread starts next time.
+void uiohook_worker_thread_options(const worker_thread_options* options);
+
+// `jitter` is the dispatch delay above the lowest one seen, in ns. It is
+// written by the hook thread, so a copy taken while it runs may be slightly
+// inconsistent.
+void uiohook_worker_thread_report(worker_thread_report* report, stats_histogram* jitter);
+
+// Locks a buffer the hook thread writes into if memory locking is enabled,
+// returns true if it was locked and must be unlocked.
+bool uiohook_worker_lock_memory(void* address, size_t size);
+
+void uiohook_worker_unlock_memory(void* address, size_t size);
+
+// uv_hrtime() at each step of the last hook start, 0 for steps not reached.
+typedef struct {
+  uint64_t thread_create; // before creating the hook thread
+  uint64_t thread_started; // the hook thread is running
+  uint64_t hook_run; // scheduling, affinity and memory locking are applied
+  uint64_t hook_enabled; // EVENT_HOOK_ENABLED, the OS hook is installed
+  uint64_t returned; // uiohook_worker_start() is done waiting
+} worker_start_times;
+
+int uiohook_worker_start(worker_dispatcher_t dispatch_proc);
+
+// Only valid right after uiohook_worker_start() returned.
+void uiohook_worker_start_times(worker_start_times* times);
+
+// Can be changed while the hook is running.
+void uiohook_worker_timestamps(bool enabled);
 
 int uiohook_worker_stop();
 
+// Input state kept by the hook thread, readable from any thread. It is
+// cleared when the hook starts and stops, keys held before the hook
+// started are not known.
+bool uiohook_worker_key_down(uint16_t keycode);
+
+// Hook thread only, for the key event being dispatched: which auto-repeat
+// a press is (0 - the first press), or how many repeats preceded a release.
+uint16_t uiohook_worker_key_repeat();
+
+bool uiohook_worker_button_down(uint16_t button);
+
+// Writes up to `max` pressed keycodes in ascending order, returns the number written.
+uint32_t uiohook_worker_pressed_keys(uint16_t* keycodes, uint32_t max);
+
+// Returns false until the first mouse event.
+bool uiohook_worker_cursor(int16_t* x, int16_t* y);
+
 #endif // !ADDON_SRC_UIOHOOK_WORKER_H_